@@ -0,0 +1,58 @@
+#include "StdAfx.h"
+
+#include "AsyncClient.h"
+
+#include <memory>
+
+namespace {
+
+template<typename Reply>
+std::future<Reply> issueFuture(TestCppClient* pClient, RequestKind kind, const Contract& contract, const std::string& param)
+{
+	// std::function needs a copyable target, so the promise is shared with the callback
+	std::shared_ptr<std::promise<Reply>> promise = std::make_shared<std::promise<Reply>>();
+	std::future<Reply> future = promise->get_future();
+	pClient->issueRequest(kind, contract, param, [promise](PendingRequest& req) {
+		Reply reply;
+		takeReply(req, reply);
+		promise->set_value(std::move(reply));
+	});
+	return future;
+}
+
+}
+
+AsyncClient::AsyncClient(TestCppClient* pClient)
+	: m_pClient(pClient)
+{
+}
+
+RequestAwaiter<ContractDetailsReply> AsyncClient::contractDetails(const Contract& contract)
+{
+	return RequestAwaiter<ContractDetailsReply>(m_pClient, RK_CONTRACTDETAILS, contract, "");
+}
+
+RequestAwaiter<SnapshotReply> AsyncClient::snapshot(const Contract& contract)
+{
+	return RequestAwaiter<SnapshotReply>(m_pClient, RK_SNAPSHOT, contract, "");
+}
+
+RequestAwaiter<FundamentalsReply> AsyncClient::fundamentals(const Contract& contract, const std::string& reportType)
+{
+	return RequestAwaiter<FundamentalsReply>(m_pClient, RK_FUNDAMENTALS, contract, reportType);
+}
+
+std::future<ContractDetailsReply> AsyncClient::contractDetailsFuture(const Contract& contract)
+{
+	return issueFuture<ContractDetailsReply>(m_pClient, RK_CONTRACTDETAILS, contract, "");
+}
+
+std::future<SnapshotReply> AsyncClient::snapshotFuture(const Contract& contract)
+{
+	return issueFuture<SnapshotReply>(m_pClient, RK_SNAPSHOT, contract, "");
+}
+
+std::future<FundamentalsReply> AsyncClient::fundamentalsFuture(const Contract& contract, const std::string& reportType)
+{
+	return issueFuture<FundamentalsReply>(m_pClient, RK_FUNDAMENTALS, contract, reportType);
+}
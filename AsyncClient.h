@@ -0,0 +1,224 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_ASYNCCLIENT_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_ASYNCCLIENT_H
+
+// C++20 coroutine front end for the request registry.
+//
+//	IbTask<void> scanOne(AsyncClient& client, Contract c)
+//	{
+//		ContractDetailsReply chain = co_await client.contractDetails(c);
+//		SnapshotReply quote = co_await client.snapshot(c);
+//		...
+//	}
+//
+// A coroutine suspends at each co_await and is resumed from inside the matching end
+// callback, i.e. on the thread that runs TestCppClient::processMessages(). Any number of
+// requests can be in flight on that one thread without sleeping.
+//
+// Batch callers that are not coroutines use the *Future variants instead and collect a
+// fan-out with whenAll(). Those block, so never wait on them from the message thread.
+
+#include "TestCppClient.h"
+#include "RequestRegistry.h"
+
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <optional>
+#include <utility>
+
+struct ContractDetailsReply {
+	std::vector<ContractDetails> details;
+	int errorCode;
+	std::string errorString;
+};
+
+struct SnapshotReply {
+	SnapshotQuote quote;
+	int errorCode;
+	std::string errorString;
+};
+
+struct FundamentalsReply {
+	std::string data;
+	int errorCode;
+	std::string errorString;
+};
+
+inline void takeReply(PendingRequest& req, ContractDetailsReply& reply)
+{
+	reply.details = std::move(req.details);
+	reply.errorCode = req.errorCode;
+	reply.errorString = std::move(req.errorString);
+}
+
+inline void takeReply(PendingRequest& req, SnapshotReply& reply)
+{
+	reply.quote = req.quote;
+	reply.errorCode = req.errorCode;
+	reply.errorString = std::move(req.errorString);
+}
+
+inline void takeReply(PendingRequest& req, FundamentalsReply& reply)
+{
+	reply.data = std::move(req.data);
+	reply.errorCode = req.errorCode;
+	reply.errorString = std::move(req.errorString);
+}
+
+template<typename T> class IbTask;
+
+namespace ibtask_detail {
+
+struct PromiseBase {
+	std::coroutine_handle<> continuation;
+	std::exception_ptr error;
+	bool detached = false;
+
+	struct FinalAwaiter {
+		bool await_ready() const noexcept { return false; }
+		template<typename P>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+			PromiseBase& promise = handle.promise();
+			if (promise.continuation)
+				return promise.continuation;
+			// nobody holds the task any more, so nobody else will free the frame
+			if (promise.detached)
+				handle.destroy();
+			return std::noop_coroutine();
+		}
+		void await_resume() const noexcept {}
+	};
+
+	std::suspend_never initial_suspend() noexcept { return {}; }
+	FinalAwaiter final_suspend() noexcept { return {}; }
+	void unhandled_exception() { error = std::current_exception(); }
+};
+
+template<typename T>
+struct Promise : PromiseBase {
+	std::optional<T> value;
+
+	IbTask<T> get_return_object();
+	void return_value(T v) { value = std::move(v); }
+	T result() {
+		if (error)
+			std::rethrow_exception(error);
+		return std::move(*value);
+	}
+};
+
+template<>
+struct Promise<void> : PromiseBase {
+	IbTask<void> get_return_object();
+	void return_void() {}
+	void result() {
+		if (error)
+			std::rethrow_exception(error);
+	}
+};
+
+}
+
+// Eagerly started coroutine task. Destroying an unfinished task detaches it: the coroutine
+// keeps running and frees itself when it completes.
+template<typename T>
+class IbTask {
+public:
+	typedef ibtask_detail::Promise<T> promise_type;
+
+	explicit IbTask(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+	IbTask(IbTask&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+	IbTask(const IbTask&) = delete;
+	IbTask& operator=(const IbTask&) = delete;
+	~IbTask() {
+		if (!m_handle)
+			return;
+		if (m_handle.done())
+			m_handle.destroy();
+		else
+			m_handle.promise().detached = true;
+	}
+
+	bool done() const { return !m_handle || m_handle.done(); }
+
+	bool await_ready() const noexcept { return m_handle.done(); }
+	void await_suspend(std::coroutine_handle<> continuation) noexcept { m_handle.promise().continuation = continuation; }
+	T await_resume() { return m_handle.promise().result(); }
+
+private:
+	std::coroutine_handle<promise_type> m_handle;
+};
+
+namespace ibtask_detail {
+
+template<typename T>
+IbTask<T> Promise<T>::get_return_object()
+{
+	return IbTask<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline IbTask<void> Promise<void>::get_return_object()
+{
+	return IbTask<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+}
+
+// Awaitable for one registry request. The request is sent from await_suspend and the
+// coroutine resumes from the registry's completion callback.
+template<typename Reply>
+class RequestAwaiter {
+public:
+	RequestAwaiter(TestCppClient* pClient, RequestKind kind, const Contract& contract, const std::string& param)
+		: m_pClient(pClient), m_kind(kind), m_contract(contract), m_param(param) {}
+
+	bool await_ready() const noexcept { return false; }
+
+	void await_suspend(std::coroutine_handle<> handle) {
+		Reply* pReply = &m_reply;
+		// nothing may touch *this after issueRequest(), the callback can resume us on the reader thread first
+		m_pClient->issueRequest(m_kind, m_contract, m_param, [pReply, handle](PendingRequest& req) {
+			takeReply(req, *pReply);
+			handle.resume();
+		});
+	}
+
+	Reply await_resume() { return std::move(m_reply); }
+
+private:
+	TestCppClient* m_pClient;
+	RequestKind m_kind;
+	Contract m_contract;
+	std::string m_param;
+	Reply m_reply;
+};
+
+class AsyncClient {
+public:
+	explicit AsyncClient(TestCppClient* pClient);
+
+	RequestAwaiter<ContractDetailsReply> contractDetails(const Contract& contract);
+	RequestAwaiter<SnapshotReply> snapshot(const Contract& contract);
+	RequestAwaiter<FundamentalsReply> fundamentals(const Contract& contract, const std::string& reportType);
+
+	std::future<ContractDetailsReply> contractDetailsFuture(const Contract& contract);
+	std::future<SnapshotReply> snapshotFuture(const Contract& contract);
+	std::future<FundamentalsReply> fundamentalsFuture(const Contract& contract, const std::string& reportType);
+
+private:
+	TestCppClient* m_pClient;
+};
+
+// Waits for every future in order and moves the replies out, leaving the futures invalid.
+template<typename Reply>
+std::vector<Reply> whenAll(std::vector<std::future<Reply>>& futures)
+{
+	std::vector<Reply> replies;
+	replies.reserve(futures.size());
+	for (size_t i = 0; i < futures.size(); i++)
+		replies.push_back(futures[i].get());
+	return replies;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#include "StdAfx.h"
+
+#include "AsyncWriter.h"
+#include "WorkerPool.h"
+#include "biglog.h"
+
+namespace {
+
+// one thread keeps the writes in order
+WorkerPool& WriterThread()
+{
+	static WorkerPool writer(1);
+	return writer;
+}
+
+}
+
+void WriteFileAsync(std::string fileName, std::string data, int nFlag)
+{
+	WriterThread().post([fileName = std::move(fileName), data = std::move(data), nFlag]() {
+		gamelog::WriteLog(fileName.c_str(), data.data(), data.size(), nFlag);
+	});
+}
+
+void WriteFileAsync(std::string fileName, std::vector<uint8_t> data, int nFlag)
+{
+	WriterThread().post([fileName = std::move(fileName), data = std::move(data), nFlag]() {
+		gamelog::WriteLog(fileName.c_str(), (const char *)data.data(), data.size(), nFlag);
+	});
+}
+
+void FlushAsyncWrites()
+{
+	WriterThread().wait();
+}
@@ -0,0 +1,18 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_ASYNCWRITER_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_ASYNCWRITER_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Hands a buffer to one background thread that writes it with gamelog::WriteLog, nFlag
+// as there. The buffer is moved, not copied, and written with the length it has; writes
+// happen in the order they were asked for, so appends to one file stay in order.
+void WriteFileAsync(std::string fileName, std::string data, int nFlag);
+void WriteFileAsync(std::string fileName, std::vector<uint8_t> data, int nFlag);
+// blocks until everything asked for so far is written
+void FlushAsyncWrites();
+
+#endif
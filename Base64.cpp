@@ -0,0 +1,238 @@
+#include "StdAfx.h"
+
+#include "Base64.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BASE64_SIMD 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BASE64_TARGET(isa)
+#else
+#define BASE64_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace {
+
+const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// 0xff outside the alphabet, '=' included
+struct DecodeTable {
+	uint8_t values[256];
+
+	DecodeTable()
+	{
+		memset(values, 0xff, sizeof(values));
+		for (int i = 0; i < 64; i++)
+			values[(uint8_t)ALPHABET[i]] = (uint8_t)i;
+	}
+};
+
+const DecodeTable s_table;
+
+// decodes from nIn on into pOut + nOut, returns the end of the output
+size_t DecodeScalar(const char *pIn, size_t nSize, size_t nIn, uint8_t *pOut, size_t nOut)
+{
+	const uint8_t *values = s_table.values;
+	for (; nIn + 4 <= nSize; nIn += 4) {
+		uint32_t a = values[(uint8_t)pIn[nIn]];
+		uint32_t b = values[(uint8_t)pIn[nIn + 1]];
+		uint32_t c = values[(uint8_t)pIn[nIn + 2]];
+		uint32_t d = values[(uint8_t)pIn[nIn + 3]];
+		if ((a | b | c | d) > 63)
+			break;
+		uint32_t group = a << 18 | b << 12 | c << 6 | d;
+		pOut[nOut] = (uint8_t)(group >> 16);
+		pOut[nOut + 1] = (uint8_t)(group >> 8);
+		pOut[nOut + 2] = (uint8_t)group;
+		nOut += 3;
+	}
+	// the last, possibly short or cut off, group
+	uint32_t group = 0;
+	int nChars = 0;
+	for (; nIn < nSize && nChars < 4; nIn++, nChars++) {
+		uint32_t value = values[(uint8_t)pIn[nIn]];
+		if (value > 63)
+			break;
+		group |= value << (18 - 6 * nChars);
+	}
+	for (int i = 0; i < nChars - 1; i++)
+		pOut[nOut++] = (uint8_t)(group >> (16 - 8 * i));
+	return nOut;
+}
+
+#ifdef BASE64_SIMD
+// Translation and packing after W. Mula and D. Lemire, "Faster Base64 Encoding and
+// Decoding using AVX2 Instructions": the high and low nibble of each character index two
+// small tables whose AND is non-zero exactly for characters outside the alphabet, a
+// third table gives what to add to turn the character into its 6-bit value, and two
+// multiply-adds pack four 6-bit values into three bytes.
+BASE64_TARGET("ssse3")
+size_t DecodeSsse3(const char *pIn, size_t nSize, uint8_t *pOut)
+{
+	const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask2F = _mm_set1_epi8(0x2f);
+	const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	size_t nIn = 0;
+	size_t nOut = 0;
+	for (; nIn + 16 <= nSize; nIn += 16) {
+		__m128i chars = _mm_loadu_si128((const __m128i *)(pIn + nIn));
+		__m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(chars, 4), mask2F);
+		__m128i lo = _mm_shuffle_epi8(lutLo, _mm_and_si128(chars, mask2F));
+		__m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+		if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0)
+			break;
+		__m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(chars, mask2F), hiNibbles));
+		__m128i values = _mm_add_epi8(chars, roll);
+		__m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+		__m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+		// 12 bytes used, the caller leaves room for the other 4
+		_mm_storeu_si128((__m128i *)(pOut + nOut), _mm_shuffle_epi8(packed, pack));
+		nOut += 12;
+	}
+	return DecodeScalar(pIn, nSize, nIn, pOut, nOut);
+}
+
+BASE64_TARGET("avx2")
+size_t DecodeAvx2(const char *pIn, size_t nSize, uint8_t *pOut)
+{
+	const __m256i lutLo = _mm256_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m256i lutHi = _mm256_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lutRoll = _mm256_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i mask2F = _mm256_set1_epi8(0x2f);
+	const __m256i pack = _mm256_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+	size_t nIn = 0;
+	size_t nOut = 0;
+	for (; nIn + 32 <= nSize; nIn += 32) {
+		__m256i chars = _mm256_loadu_si256((const __m256i *)(pIn + nIn));
+		__m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(chars, 4), mask2F);
+		__m256i lo = _mm256_shuffle_epi8(lutLo, _mm256_and_si256(chars, mask2F));
+		__m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+		if (_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256())) != 0)
+			break;
+		__m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(_mm256_cmpeq_epi8(chars, mask2F), hiNibbles));
+		__m256i values = _mm256_add_epi8(chars, roll);
+		__m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+		__m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+		packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(packed, pack), lanes);
+		// 24 bytes used, the caller leaves room for the other 8
+		_mm256_storeu_si256((__m256i *)(pOut + nOut), packed);
+		nOut += 24;
+	}
+	return DecodeSsse3(pIn + nIn, nSize - nIn, pOut + nOut) + nOut;
+}
+
+bool CpuHasSsse3()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 9)) != 0;
+#else
+	return __builtin_cpu_supports("ssse3") != 0;
+#endif
+}
+
+bool CpuHasAvx2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	// the OS has to save the YMM registers too
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+}
+
+const char *Base64ImplName(Base64Impl impl)
+{
+	switch (impl) {
+	case B64_SCALAR: return "scalar";
+	case B64_SSSE3: return "ssse3";
+	case B64_AVX2: return "avx2";
+	default: return "";
+	}
+}
+
+bool Base64ImplSupported(Base64Impl impl)
+{
+	switch (impl) {
+	case B64_SCALAR: return true;
+#ifdef BASE64_SIMD
+	case B64_SSSE3: return CpuHasSsse3();
+	case B64_AVX2: return CpuHasAvx2();
+#endif
+	default: return false;
+	}
+}
+
+Base64Impl Base64BestImpl()
+{
+	static const Base64Impl best = Base64ImplSupported(B64_AVX2) ? B64_AVX2 : Base64ImplSupported(B64_SSSE3) ? B64_SSSE3 : B64_SCALAR;
+	return best;
+}
+
+std::vector<uint8_t> Base64Decode(std::string_view encoded)
+{
+	return Base64Decode(encoded, Base64BestImpl());
+}
+
+std::vector<uint8_t> Base64Decode(std::string_view encoded, Base64Impl impl)
+{
+	// room for the full-width stores of the last SIMD block
+	std::vector<uint8_t> bytes(encoded.size() / 4 * 3 + 3 + 8);
+	size_t nSize;
+	switch (impl) {
+#ifdef BASE64_SIMD
+	case B64_AVX2: nSize = DecodeAvx2(encoded.data(), encoded.size(), bytes.data()); break;
+	case B64_SSSE3: nSize = DecodeSsse3(encoded.data(), encoded.size(), bytes.data()); break;
+#endif
+	default: nSize = DecodeScalar(encoded.data(), encoded.size(), 0, bytes.data(), 0); break;
+	}
+	bytes.resize(nSize);
+	return bytes;
+}
+
+std::string Base64Encode(const uint8_t *pData, size_t nSize)
+{
+	std::string encoded;
+	encoded.reserve((nSize + 2) / 3 * 4);
+	size_t i = 0;
+	for (; i + 3 <= nSize; i += 3) {
+		uint32_t group = (uint32_t)pData[i] << 16 | (uint32_t)pData[i + 1] << 8 | pData[i + 2];
+		encoded += ALPHABET[group >> 18];
+		encoded += ALPHABET[(group >> 12) & 63];
+		encoded += ALPHABET[(group >> 6) & 63];
+		encoded += ALPHABET[group & 63];
+	}
+	if (i < nSize) {
+		uint32_t group = (uint32_t)pData[i] << 16 | (i + 1 < nSize ? (uint32_t)pData[i + 1] << 8 : 0);
+		encoded += ALPHABET[group >> 18];
+		encoded += ALPHABET[(group >> 12) & 63];
+		encoded += i + 1 < nSize ? ALPHABET[(group >> 6) & 63] : '=';
+		encoded += '=';
+	}
+	return encoded;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_BASE64_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_BASE64_H
+
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum Base64Impl { B64_SCALAR, B64_SSSE3, B64_AVX2, B64_COUNT };
+
+const char *Base64ImplName(Base64Impl impl);
+// the fastest one this CPU runs, checked once
+Base64Impl Base64BestImpl();
+bool Base64ImplSupported(Base64Impl impl);
+
+// Same result as Utils::base64_decode: decoding stops at the first '=' or character
+// outside the alphabet, and a trailing group of n < 4 characters gives n - 1 bytes.
+// The SIMD versions decode 16 or 32 characters at a time and leave any block that
+// isn't plain alphabet to the scalar one.
+std::vector<uint8_t> Base64Decode(std::string_view encoded);
+std::vector<uint8_t> Base64Decode(std::string_view encoded, Base64Impl impl);
+std::string Base64Encode(const uint8_t *pData, size_t nSize);
+
+#endif
@@ -0,0 +1,288 @@
+﻿#include "StdAfx.h"
+
+#include "ChainStore.h"
+#include "biglog.h"
+
+#include <algorithm>
+
+namespace {
+
+// held by ChainFile::open and around WriteChainFile's two renames, so no reader of this
+// process finds the name missing between them
+std::mutex ChainFileNameMutex;
+
+std::string ChainDir = "C:\\bighouse\\波动率探索器\\";
+
+void ChainFileName(const char *pszExpiry, char *pszFileName, size_t nSize)
+{
+	sprintf_s(pszFileName, nSize, "%s%s.chain", ChainDir.c_str(), pszExpiry);
+}
+
+// files earlier writes moved aside, those still mapped by a reader stay for a later write
+void RemoveOldChainFiles(const char *pszFileName)
+{
+	WIN32_FIND_DATA ffd;
+	char pszFind[MAX_PATH];
+	sprintf_s(pszFind, MAX_PATH, "%s.*.old", pszFileName);
+	HANDLE hFind = FindFirstFile(pszFind, &ffd);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return;
+	const char *pszDirEnd = strrchr(pszFileName, '\\');
+	int nDirLen = pszDirEnd != NULL ? (int)(pszDirEnd - pszFileName) + 1 : 0;
+	do {
+		char pszOldName[MAX_PATH];
+		sprintf_s(pszOldName, MAX_PATH, "%.*s%s", nDirLen, pszFileName, ffd.cFileName);
+		DeleteFile(pszOldName);
+	} while (FindNextFile(hFind, &ffd) != 0);
+	FindClose(hFind);
+}
+
+bool ReadTextChain(const char *pszFileName, std::vector<double>& strikes)
+{
+	FILE *fp;
+	if (fopen_s(&fp, pszFileName, "r") != 0)
+		return false;
+	char pszLine[256];
+	while (fgets(pszLine, sizeof(pszLine), fp) != NULL) {
+		if (pszLine[0] != '\r' && pszLine[0] != '\n' && pszLine[0] != 0x00)
+			strikes.push_back(atof(pszLine));
+	}
+	fclose(fp);
+	std::sort(strikes.begin(), strikes.end());
+	strikes.erase(std::unique(strikes.begin(), strikes.end()), strikes.end());
+	return true;
+}
+
+bool ReadTextChains(const char *pszExpiry, ChainMap& chains)
+{
+	WIN32_FIND_DATA ffd;
+	char pszFind[MAX_PATH];
+	sprintf_s(pszFind, MAX_PATH, "C:\\bighouse\\波动率探索器\\%s\\*.txt", pszExpiry);
+	HANDLE hFind = FindFirstFile(pszFind, &ffd);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return false;
+	do {
+		if ((ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || strstr(ffd.cFileName, "索引") != NULL)
+			continue;
+		std::string symbol(ffd.cFileName, strlen(ffd.cFileName) - 4);
+		char pszFileName[MAX_PATH];
+		sprintf_s(pszFileName, MAX_PATH, "C:\\bighouse\\波动率探索器\\%s\\%s", pszExpiry, ffd.cFileName);
+		std::vector<double> strikes;
+		if (ReadTextChain(pszFileName, strikes) && !strikes.empty())
+			chains[symbol].swap(strikes);
+	} while (FindNextFile(hFind, &ffd) != 0);
+	FindClose(hFind);
+	return true;
+}
+
+} // namespace
+
+ChainFile::ChainFile()
+	: m_pHeader(0)
+	, m_pSymbols(0)
+	, m_pStrikes(0)
+{
+}
+
+void SetChainDir(const char *pszDir)
+{
+	ChainDir = pszDir;
+}
+
+bool ChainFile::open(const char *pszExpiry)
+{
+	close();
+	char pszFileName[MAX_PATH];
+	ChainFileName(pszExpiry, pszFileName, MAX_PATH);
+	{
+		std::lock_guard<std::mutex> lock(ChainFileNameMutex);
+		if (!m_file.open(pszFileName))
+			return false;
+	}
+
+	const ChainFileHeader *pHeader = (const ChainFileHeader *)m_file.data();
+	if (m_file.size() < sizeof(ChainFileHeader) || pHeader->magic != CHAIN_FILE_MAGIC || pHeader->version != CHAIN_FILE_VERSION) {
+		printf("%s is not a version %u chain file\n", pszFileName, CHAIN_FILE_VERSION);
+		m_file.close();
+		return false;
+	}
+	size_t nIndexEnd = sizeof(ChainFileHeader) + (size_t)pHeader->symbolCount * sizeof(ChainFileSymbol);
+	if (m_file.size() != nIndexEnd + (size_t)pHeader->strikeCount * sizeof(double)) {
+		printf("%s is truncated\n", pszFileName);
+		m_file.close();
+		return false;
+	}
+	const ChainFileSymbol *pSymbols = (const ChainFileSymbol *)(pHeader + 1);
+	for (uint32_t i = 0; i < pHeader->symbolCount; i++) {
+		if (pSymbols[i].name[CHAIN_SYMBOL_LEN - 1] != 0x00
+			|| (uint64_t)pSymbols[i].firstStrike + pSymbols[i].strikeCount > pHeader->strikeCount) {
+			printf("%s has a bad symbol entry %u\n", pszFileName, i);
+			m_file.close();
+			return false;
+		}
+	}
+	m_pHeader = pHeader;
+	m_pSymbols = pSymbols;
+	m_pStrikes = (const double *)(m_file.data() + nIndexEnd);
+	return true;
+}
+
+void ChainFile::close()
+{
+	m_file.close();
+	m_pHeader = 0;
+	m_pSymbols = 0;
+	m_pStrikes = 0;
+}
+
+const double *ChainFile::strikes(int i, int& nCount) const
+{
+	if (i < 0 || i >= count()) {
+		nCount = 0;
+		return 0;
+	}
+	nCount = (int)m_pSymbols[i].strikeCount;
+	return m_pStrikes + m_pSymbols[i].firstStrike;
+}
+
+int ChainFile::find(const char *pszSymbol) const
+{
+	int nLow = 0;
+	int nHigh = count() - 1;
+	while (nLow <= nHigh) {
+		int nMid = (nLow + nHigh) / 2;
+		int nCmp = strcmp(m_pSymbols[nMid].name, pszSymbol);
+		if (nCmp == 0)
+			return nMid;
+		if (nCmp < 0)
+			nLow = nMid + 1;
+		else
+			nHigh = nMid - 1;
+	}
+	return -1;
+}
+
+bool WriteChainFile(const char *pszExpiry, const ChainMap& chains)
+{
+	ChainFileHeader header;
+	header.magic = CHAIN_FILE_MAGIC;
+	header.version = CHAIN_FILE_VERSION;
+	header.symbolCount = 0;
+	header.strikeCount = 0;
+	std::vector<ChainFileSymbol> symbols;
+	std::vector<double> strikes;
+	symbols.reserve(chains.size());
+	// ChainMap is ordered, so the index comes out sorted as find() needs
+	for (ChainMap::const_iterator it = chains.begin(); it != chains.end(); ++it) {
+		if (it->first.size() >= (size_t)CHAIN_SYMBOL_LEN) {
+			printf("Chain file: symbol %s is too long, skipped\n", it->first.c_str());
+			continue;
+		}
+		ChainFileSymbol symbol;
+		memset(&symbol, 0x00, sizeof(symbol));
+		memcpy(symbol.name, it->first.data(), it->first.size());
+		symbol.firstStrike = (uint32_t)strikes.size();
+		symbol.strikeCount = (uint32_t)it->second.size();
+		symbols.push_back(symbol);
+		strikes.insert(strikes.end(), it->second.begin(), it->second.end());
+	}
+	header.symbolCount = (uint32_t)symbols.size();
+	header.strikeCount = (uint32_t)strikes.size();
+
+	char pszFileName[MAX_PATH];
+	char pszTempName[MAX_PATH];
+	ChainFileName(pszExpiry, pszFileName, MAX_PATH);
+	sprintf_s(pszTempName, MAX_PATH, "%s.tmp", pszFileName);
+	HANDLE hFile = CreateFile(pszTempName, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	DWORD dwWrite;
+	bool bOk = WriteFile(hFile, &header, sizeof(header), &dwWrite, 0) != 0
+		&& (symbols.empty() || WriteFile(hFile, symbols.data(), (DWORD)(symbols.size() * sizeof(ChainFileSymbol)), &dwWrite, 0) != 0)
+		&& (strikes.empty() || WriteFile(hFile, strikes.data(), (DWORD)(strikes.size() * sizeof(double)), &dwWrite, 0) != 0)
+		&& FlushFileBuffers(hFile) != 0;
+	CloseHandle(hFile);
+	if (!bOk) {
+		printf("Chain file: can't write %s\n", pszFileName);
+		DeleteFile(pszTempName);
+		return false;
+	}
+	// A mapped file can be neither replaced nor deleted, but it can be renamed: the
+	// current file moves aside, where the readers that map it keep reading the old
+	// chains, and the new one takes its name.
+	RemoveOldChainFiles(pszFileName);
+	char pszOldName[MAX_PATH];
+	sprintf_s(pszOldName, MAX_PATH, "%s.%llu.old", pszFileName, (unsigned long long)GetTickCount64());
+	std::lock_guard<std::mutex> lock(ChainFileNameMutex);
+	bool bMovedAside = MoveFileEx(pszFileName, pszOldName, 0) != 0;
+	if (MoveFileEx(pszTempName, pszFileName, 0) == 0) {
+		printf("Chain file: can't replace %s\n", pszFileName);
+		if (bMovedAside)
+			MoveFileEx(pszOldName, pszFileName, 0);
+		DeleteFile(pszTempName);
+		return false;
+	}
+	if (bMovedAside)
+		DeleteFile(pszOldName);
+	return true;
+}
+
+bool ReadChains(const char *pszExpiry, ChainMap& chains)
+{
+	ChainFile file;
+	if (!file.open(pszExpiry))
+		return ReadTextChains(pszExpiry, chains);
+	for (int i = 0; i < file.count(); i++) {
+		int nCount;
+		const double *pStrikes = file.strikes(i, nCount);
+		chains[file.symbol(i)].assign(pStrikes, pStrikes + nCount);
+	}
+	return true;
+}
+
+bool ImportTextChains(const char *pszExpiry)
+{
+	ChainMap chains;
+	if (!ReadTextChains(pszExpiry, chains))
+		return false;
+	printf("Chain file: imported %lu text chains of %s\n", (unsigned long)chains.size(), pszExpiry);
+	return WriteChainFile(pszExpiry, chains);
+}
+
+void ChainStore::put(const std::string& expiry, const std::string& symbol, const std::vector<double>& strikes, int nRow)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::map<std::string, Expiry>::iterator it = m_expiries.find(expiry);
+	if (it == m_expiries.end()) {
+		// start from what earlier runs found, the file is rewritten whole
+		it = m_expiries.insert(std::make_pair(expiry, Expiry())).first;
+		ReadChains(expiry.c_str(), it->second.chains);
+	}
+	Expiry& data = it->second;
+	data.chains[symbol] = strikes;
+	data.nRow = (std::max)(data.nRow, nRow);
+	if (++data.nDirty >= SAVE_EVERY)
+		save(expiry, data);
+}
+
+void ChainStore::save()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (std::map<std::string, Expiry>::iterator it = m_expiries.begin(); it != m_expiries.end(); ++it) {
+		if (it->second.nDirty > 0)
+			save(it->first, it->second);
+	}
+}
+
+void ChainStore::save(const std::string& expiry, Expiry& data)
+{
+	if (!WriteChainFile(expiry.c_str(), data.chains))
+		return;
+	data.nDirty = 0;
+	// only advance the crawler's resume row once the chains before it are on disk
+	char pszFileName[256];
+	char pszRow[32];
+	sprintf_s(pszFileName, 256, "C:\\bighouse\\波动率探索器\\%s\\索引.txt", expiry.c_str());
+	sprintf_s(pszRow, 32, "%d", data.nRow);
+	gamelog::WriteLog(pszFileName, pszRow, 2);
+}
@@ -0,0 +1,95 @@
+﻿#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_CHAINSTORE_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_CHAINSTORE_H
+
+#include "MappedFile.h"
+
+#include <stdint.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One binary file of put strikes per expiry, 波动率探索器\<expiry>.chain:
+//   ChainFileHeader
+//   ChainFileSymbol[symbolCount], sorted by name
+//   double[strikeCount], each symbol's strikes contiguous and ascending
+// All fields are native little-endian, the strike array is 8-byte aligned.
+const uint32_t CHAIN_FILE_MAGIC = 0x4e48434f;	// "OCHN"
+const uint32_t CHAIN_FILE_VERSION = 1;
+const int CHAIN_SYMBOL_LEN = 16;				// including the terminating 0
+
+struct ChainFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t symbolCount;
+	uint32_t strikeCount;
+};
+
+struct ChainFileSymbol {
+	char name[CHAIN_SYMBOL_LEN];
+	uint32_t firstStrike;
+	uint32_t strikeCount;
+};
+
+// symbol -> ascending strikes
+typedef std::map<std::string, std::vector<double>> ChainMap;
+
+// Read-only, zero-copy view of one expiry's chain file.
+class ChainFile {
+public:
+	ChainFile();
+
+	bool open(const char *pszExpiry);
+	void close();
+
+	int count() const { return m_pHeader ? (int)m_pHeader->symbolCount : 0; }
+	const char *symbol(int i) const { return m_pSymbols[i].name; }
+	// ascending, points into the mapping; nCount is 0 for a bad index
+	const double *strikes(int i, int& nCount) const;
+	// binary search, -1 when the symbol has no chain
+	int find(const char *pszSymbol) const;
+
+private:
+	MappedFile m_file;
+	const ChainFileHeader *m_pHeader;
+	const ChainFileSymbol *m_pSymbols;
+	const double *m_pStrikes;
+};
+
+// Where the chain files go, with the trailing backslash; 波动率探索器\ unless set before
+// the first read or write.
+void SetChainDir(const char *pszDir);
+// Writes the file through a temporary and renames, so readers see the old or the new one;
+// one that has the old file mapped keeps it, under <file>.<tick>.old until a later write.
+bool WriteChainFile(const char *pszExpiry, const ChainMap& chains);
+// The chain file if there is one, else the legacy <expiry>\<symbol>.txt strike files.
+bool ReadChains(const char *pszExpiry, ChainMap& chains);
+// Converts the legacy text files of an expiry into its chain file.
+bool ImportTextChains(const char *pszExpiry);
+
+// Collects chains from the strike crawler and rewrites each expiry's file every
+// SAVE_EVERY chains and on save().
+class ChainStore {
+public:
+	static const int SAVE_EVERY = 200;
+
+	// nRow is the crawler row the chain came from, saved to the 索引 progress file
+	void put(const std::string& expiry, const std::string& symbol, const std::vector<double>& strikes, int nRow);
+	void save();
+
+private:
+	struct Expiry {
+		ChainMap chains;
+		int nRow = 0;
+		int nDirty = 0;
+	};
+
+	void save(const std::string& expiry, Expiry& data);
+
+	std::mutex m_mutex;
+	std::map<std::string, Expiry> m_expiries;
+};
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_CONTRACTMSG_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_CONTRACTMSG_H
+
+#include "Contract.h"
+
+// printContractMsg's lines, one emit(pszFormat, args...) each. The format is a literal
+// and strings go as char pointers, so emit can be LogDebug or LogAppendFormat.
+template<typename Emit>
+void FormatContractMsg(const Contract& contract, Emit emit)
+{
+	emit("\tConId: %ld\n", contract.conId);
+	emit("\tSymbol: %s\n", contract.symbol.c_str());
+	emit("\tSecType: %s\n", contract.secType.c_str());
+	emit("\tLastTradeDateOrContractMonth: %s\n", contract.lastTradeDateOrContractMonth.c_str());
+	emit("\tStrike: %g\n", contract.strike);
+	emit("\tRight: %s\n", contract.right.c_str());
+	emit("\tMultiplier: %s\n", contract.multiplier.c_str());
+	emit("\tExchange: %s\n", contract.exchange.c_str());
+	emit("\tPrimaryExchange: %s\n", contract.primaryExchange.c_str());
+	emit("\tCurrency: %s\n", contract.currency.c_str());
+	emit("\tLocalSymbol: %s\n", contract.localSymbol.c_str());
+	emit("\tTradingClass: %s\n", contract.tradingClass.c_str());
+}
+
+#endif
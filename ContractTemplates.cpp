@@ -0,0 +1,76 @@
+#include "StdAfx.h"
+
+#include "ContractTemplates.h"
+#include "SymbolTable.h"
+#include "Contract.h"
+
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace {
+
+enum TemplateKind { TK_STOCK, TK_OPTION_QUERY, TK_OPTION };
+
+std::shared_mutex s_mutex;
+// node based, so references into it survive later inserts
+std::unordered_map<uint64_t, Contract> s_templates;
+thread_local Contract s_scratch;
+
+Contract Build(uint32_t symbolId, TemplateKind kind, UniverseExchange primaryExchange)
+{
+	Contract contract;
+	contract.symbol = SymbolTable::instance().name(symbolId);
+	contract.exchange = "SMART";
+	contract.currency = "USD";
+	if (kind == TK_STOCK) {
+		contract.secType = "STK";
+		if (primaryExchange != UX_NONE)
+			contract.primaryExchange = UniverseExchangeName(primaryExchange);
+	}
+	else {
+		contract.secType = "OPT";
+		contract.right = "PUT";
+		if (kind == TK_OPTION)
+			contract.multiplier = "100";
+	}
+	return contract;
+}
+
+const Contract& Lookup(uint32_t symbolId, TemplateKind kind, UniverseExchange primaryExchange)
+{
+	uint64_t key = (uint64_t)symbolId << 16 | (uint64_t)kind << 8 | (uint64_t)primaryExchange;
+	{
+		std::shared_lock<std::shared_mutex> lock(s_mutex);
+		auto it = s_templates.find(key);
+		if (it != s_templates.end())
+			return it->second;
+	}
+	Contract contract = Build(symbolId, kind, primaryExchange);
+	std::unique_lock<std::shared_mutex> lock(s_mutex);
+	// keeps the first one if another thread built it meanwhile
+	return s_templates.emplace(key, contract).first->second;
+}
+
+} // namespace
+
+const Contract& ContractTemplates::stock(uint32_t symbolId, UniverseExchange primaryExchange)
+{
+	return Lookup(symbolId, TK_STOCK, primaryExchange);
+}
+
+const Contract& ContractTemplates::optionQuery(uint32_t symbolId, const char *pszExpiry)
+{
+	// assignment reuses the scratch strings' buffers
+	s_scratch = Lookup(symbolId, TK_OPTION_QUERY, UX_NONE);
+	s_scratch.lastTradeDateOrContractMonth = pszExpiry;
+	return s_scratch;
+}
+
+const Contract& ContractTemplates::option(uint32_t symbolId, const char *pszExpiry, double strike)
+{
+	s_scratch = Lookup(symbolId, TK_OPTION, UX_NONE);
+	s_scratch.lastTradeDateOrContractMonth = pszExpiry;
+	s_scratch.strike = strike;
+	return s_scratch;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_CONTRACTTEMPLATES_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_CONTRACTTEMPLATES_H
+
+#include "Universe.h"
+
+#include <stdint.h>
+
+struct Contract;
+
+// Prebuilt Contracts keyed by (SymbolTable id, secType, primary exchange), built once
+// from the same fields as the ContractSamples *ForQuery functions. Copying a template,
+// or patching the calling thread's scratch copy, replaces building every string again
+// for each request. Returned references stay valid for the whole run, except the
+// patched ones which are valid until the same thread patches again.
+class ContractTemplates {
+public:
+	// STK SMART USD, like StockForQuery and StockForQueryExchange
+	static const Contract& stock(uint32_t symbolId, UniverseExchange primaryExchange = UX_NONE);
+	// OPT SMART USD PUT, like OptionForQuery, with the expiry patched in
+	static const Contract& optionQuery(uint32_t symbolId, const char *pszExpiry);
+	// OPT SMART USD PUT x100, like USOptionContractEx, with expiry and strike patched in
+	static const Contract& option(uint32_t symbolId, const char *pszExpiry, double strike);
+};
+
+#endif
@@ -0,0 +1,313 @@
+﻿#include "StdAfx.h"
+
+#include "FundamentalFields.h"
+#include "SymbolTable.h"
+#include "WorkerPool.h"
+#include "XmlScanner.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+namespace {
+
+const size_t SYMBOL_WIDTH = 16;
+
+struct DefaultField {
+	FundamentalReport report;
+	const char *element;
+	const char *attribute;
+	const char *key;
+};
+
+const DefaultField DEFAULT_FIELDS[] = {
+	{ FR_SNAPSHOT, "Ratio", "FieldName", "MKTCAP" },
+	{ FR_SNAPSHOT, "Ratio", "FieldName", "NPRICE" },
+	{ FR_SNAPSHOT, "Ratio", "FieldName", "TTMEPSXCLX" },
+	{ FR_SNAPSHOT, "Ratio", "FieldName", "TTMREV" },
+	{ FR_SNAPSHOT, "Ratio", "FieldName", "TTMNIAC" },
+	{ FR_SNAPSHOT, "Ratio", "FieldName", "PEEXCLXOR" },
+	{ FR_SNAPSHOT, "Ratio", "FieldName", "PRICE2BK" },
+	{ FR_SNAPSHOT, "Ratio", "FieldName", "TTMROEPCT" },
+	{ FR_SNAPSHOT, "Ratio", "FieldName", "TTMGROSMGN" },
+	{ FR_SNAPSHOT, "Ratio", "FieldName", "TTMNPMGN" },
+	{ FR_SNAPSHOT, "Ratio", "FieldName", "YIELD" },
+	{ FR_SNAPSHOT, "SharesOut", "", "" },
+	{ FR_FINSTATEMENTS, "lineItem", "coaCode", "RTLR" },
+	{ FR_FINSTATEMENTS, "lineItem", "coaCode", "SGRP" },
+	{ FR_FINSTATEMENTS, "lineItem", "coaCode", "SOPI" },
+	{ FR_FINSTATEMENTS, "lineItem", "coaCode", "NINC" },
+	{ FR_FINSTATEMENTS, "lineItem", "coaCode", "SDBF" },
+	{ FR_FINSTATEMENTS, "lineItem", "coaCode", "ATOT" },
+	{ FR_FINSTATEMENTS, "lineItem", "coaCode", "LTLL" },
+	{ FR_FINSTATEMENTS, "lineItem", "coaCode", "QTLE" },
+	{ FR_FINSTATEMENTS, "lineItem", "coaCode", "OTLO" },
+	{ FR_FINSTATEMENTS, "lineItem", "coaCode", "SCEX" },
+};
+
+void ColumnFileName(FundamentalReport report, int nDate, const char *pszColumn, char *pszFileName, size_t nSize)
+{
+	sprintf_s(pszFileName, nSize, "C:\\bighouse\\美股财务数据\\字段\\%s\\%08d\\%s.col", FundamentalReportName(report), nDate, pszColumn);
+}
+
+bool ParseNumber(std::string_view text, double& value)
+{
+	while (!text.empty() && (text.front() == ' ' || text.front() == '\t' || text.front() == '\r' || text.front() == '\n'))
+		text.remove_prefix(1);
+	while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r' || text.back() == '\n'))
+		text.remove_suffix(1);
+	char pszNumber[64];
+	if (text.empty() || text.size() >= sizeof(pszNumber))
+		return false;
+	memcpy(pszNumber, text.data(), text.size());
+	pszNumber[text.size()] = 0;
+	char *pEnd = NULL;
+	value = strtod(pszNumber, &pEnd);
+	return pEnd == pszNumber + text.size();
+}
+
+// Fills values[i] from the first match of fields[i]; values start out NaN.
+class FieldExtractor : public XmlHandler {
+public:
+	FieldExtractor(const std::vector<FundamentalField>& fields, double *pValues)
+		: m_fields(fields), m_pValues(pValues), m_nDepth(0), m_nCapture(-1), m_nCaptureDepth(0)
+	{
+	}
+
+	void startElement(std::string_view name, const XmlAttributes& attributes)
+	{
+		m_nDepth++;
+		if (m_nCapture >= 0)
+			return;
+		for (size_t i = 0; i < m_fields.size(); i++) {
+			const FundamentalField& field = m_fields[i];
+			if (!isnan(m_pValues[i]) || name != field.element)
+				continue;
+			if (!field.attribute.empty() && attributes.find(field.attribute) != field.key)
+				continue;
+			m_nCapture = (int)i;
+			m_nCaptureDepth = m_nDepth;
+			return;
+		}
+	}
+
+	// the first non-blank text inside the element, which for the nested forecast values
+	// is the first <Value>
+	void text(std::string_view text)
+	{
+		if (m_nCapture < 0 || text.find_first_not_of(" \t\r\n") == std::string_view::npos)
+			return;
+		double value;
+		if (ParseNumber(text, value))
+			m_pValues[m_nCapture] = value;
+		m_nCapture = -1;
+	}
+
+	void endElement(std::string_view /*name*/)
+	{
+		if (m_nCapture >= 0 && m_nDepth == m_nCaptureDepth)
+			m_nCapture = -1;
+		m_nDepth--;
+	}
+
+private:
+	const std::vector<FundamentalField>& m_fields;
+	double *m_pValues;
+	int m_nDepth;
+	int m_nCapture;
+	int m_nCaptureDepth;
+};
+
+bool WriteColumnFile(const char *pszFileName, const void *pData, uint32_t nCount, size_t nWidth)
+{
+	FundamentalColumnHeader header;
+	header.magic = FUNDAMENTAL_COLUMN_MAGIC;
+	header.version = FUNDAMENTAL_COLUMN_VERSION;
+	header.count = nCount;
+	header.reserved = 0;
+	char pszTempName[MAX_PATH];
+	sprintf_s(pszTempName, MAX_PATH, "%s.tmp", pszFileName);
+	HANDLE hFile = CreateFile(pszTempName, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	DWORD dwWrite;
+	bool bOk = WriteFile(hFile, &header, sizeof(header), &dwWrite, 0) != 0
+		&& (nCount == 0 || WriteFile(hFile, pData, (DWORD)(nCount * nWidth), &dwWrite, 0) != 0);
+	CloseHandle(hFile);
+	if (!bOk || MoveFileEx(pszTempName, pszFileName, MOVEFILE_REPLACE_EXISTING) == 0) {
+		DeleteFile(pszTempName);
+		return false;
+	}
+	return true;
+}
+
+}
+
+const char *FundamentalReportName(FundamentalReport report)
+{
+	switch (report) {
+	case FR_SNAPSHOT: return "ReportSnapshot";
+	case FR_FINSTATEMENTS: return "ReportsFinStatements";
+	default: return "";
+	}
+}
+
+FundamentalTable::FundamentalTable(FundamentalReport report)
+	: m_report(report)
+{
+	for (size_t i = 0; i < sizeof(DEFAULT_FIELDS) / sizeof(DEFAULT_FIELDS[0]); i++) {
+		const DefaultField& def = DEFAULT_FIELDS[i];
+		if (def.report != report)
+			continue;
+		FundamentalField field;
+		field.element = def.element;
+		field.attribute = def.attribute;
+		field.key = def.key;
+		field.column = def.key[0] != 0 ? def.key : def.element;
+		m_fields.push_back(field);
+	}
+}
+
+bool FundamentalTable::loadFields(const char *pszFileName)
+{
+	FILE *pFile = NULL;
+	if (fopen_s(&pFile, pszFileName, "r") != 0 || pFile == NULL) {
+		printf("Can't open field list %s\n", pszFileName);
+		return false;
+	}
+	std::vector<FundamentalField> fields;
+	char pszLine[512];
+	int nLine = 0;
+	while (fgets(pszLine, sizeof(pszLine), pFile) != NULL) {
+		nLine++;
+		char *pComment = strchr(pszLine, '#');
+		if (pComment != NULL)
+			*pComment = 0;
+		char pszElement[128], pszAttribute[128], pszKey[128], pszColumn[128] = "";
+		int nCount = sscanf(pszLine, "%127s %127s %127s %127s", pszElement, pszAttribute, pszKey, pszColumn);
+		if (nCount <= 0)
+			continue;
+		if (nCount < 3) {
+			printf("%s:%d: expected \"element attribute key [column]\"\n", pszFileName, nLine);
+			fclose(pFile);
+			return false;
+		}
+		FundamentalField field;
+		field.element = pszElement;
+		if (strcmp(pszAttribute, "-") != 0) {
+			field.attribute = pszAttribute;
+			field.key = pszKey;
+		}
+		field.column = nCount == 4 ? pszColumn : pszKey;
+		fields.push_back(field);
+	}
+	fclose(pFile);
+	if (fields.empty() || fields.size() > MAX_FIELDS) {
+		printf("%s: between 1 and %u fields expected\n", pszFileName, (unsigned)MAX_FIELDS);
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_fields = fields;
+	m_columns.clear();
+	m_rows.clear();
+	m_symbols.clear();
+	return true;
+}
+
+bool FundamentalTable::extract(uint32_t symbolId, std::string_view report)
+{
+	double values[MAX_FIELDS];
+	size_t nFields = m_fields.size() < MAX_FIELDS ? m_fields.size() : MAX_FIELDS;
+	for (size_t i = 0; i < nFields; i++)
+		values[i] = NAN;
+	FieldExtractor extractor(m_fields, values);
+	if (!ScanXml(report, extractor))
+		printf("%s for %s is truncated\n", FundamentalReportName(m_report), SymbolTable::instance().name(symbolId).c_str());
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_columns.size() != nFields)
+		m_columns.resize(nFields);
+	auto it = m_rows.find(symbolId);
+	if (it == m_rows.end()) {
+		it = m_rows.emplace(symbolId, (uint32_t)m_symbols.size()).first;
+		m_symbols.push_back(symbolId);
+		for (size_t i = 0; i < nFields; i++)
+			m_columns[i].push_back(values[i]);
+	}
+	else {
+		for (size_t i = 0; i < nFields; i++)
+			m_columns[i][it->second] = values[i];
+	}
+	return true;
+}
+
+bool FundamentalTable::save(int nDate)
+{
+	WorkerPool::shared().wait();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	char pszFileName[MAX_PATH];
+	sprintf_s(pszFileName, MAX_PATH, "C:\\bighouse\\美股财务数据\\字段");
+	CreateDirectory(pszFileName, NULL);
+	sprintf_s(pszFileName, MAX_PATH, "C:\\bighouse\\美股财务数据\\字段\\%s", FundamentalReportName(m_report));
+	CreateDirectory(pszFileName, NULL);
+	sprintf_s(pszFileName, MAX_PATH, "C:\\bighouse\\美股财务数据\\字段\\%s\\%08d", FundamentalReportName(m_report), nDate);
+	CreateDirectory(pszFileName, NULL);
+
+	uint32_t nCount = (uint32_t)m_symbols.size();
+	std::vector<char> names(nCount * SYMBOL_WIDTH, 0);
+	for (uint32_t i = 0; i < nCount; i++) {
+		const std::string& name = SymbolTable::instance().name(m_symbols[i]);
+		memcpy(&names[i * SYMBOL_WIDTH], name.c_str(), (std::min)(name.size(), SYMBOL_WIDTH - 1));
+	}
+	ColumnFileName(m_report, nDate, "symbols", pszFileName, MAX_PATH);
+	bool bOk = WriteColumnFile(pszFileName, nCount > 0 ? &names[0] : NULL, nCount, SYMBOL_WIDTH);
+	for (size_t i = 0; bOk && i < m_columns.size(); i++) {
+		ColumnFileName(m_report, nDate, m_fields[i].column.c_str(), pszFileName, MAX_PATH);
+		bOk = WriteColumnFile(pszFileName, nCount > 0 ? &m_columns[i][0] : NULL, nCount, sizeof(double));
+	}
+	if (!bOk) {
+		printf("Can't write %s\n", pszFileName);
+		return false;
+	}
+	printf("%s: %u symbols x %u fields saved\n", FundamentalReportName(m_report), nCount, (unsigned)m_columns.size());
+	m_rows.clear();
+	m_symbols.clear();
+	m_columns.clear();
+	return true;
+}
+
+bool FundamentalColumn::open(FundamentalReport report, int nDate, const char *pszColumn)
+{
+	m_nCount = 0;
+	m_nWidth = strcmp(pszColumn, "symbols") == 0 ? SYMBOL_WIDTH : sizeof(double);
+	char pszFileName[MAX_PATH];
+	ColumnFileName(report, nDate, pszColumn, pszFileName, MAX_PATH);
+	if (!m_file.open(pszFileName))
+		return false;
+	const FundamentalColumnHeader *pHeader = (const FundamentalColumnHeader *)m_file.data();
+	if (m_file.size() < sizeof(FundamentalColumnHeader) || pHeader->magic != FUNDAMENTAL_COLUMN_MAGIC || pHeader->version != FUNDAMENTAL_COLUMN_VERSION
+		|| m_file.size() != sizeof(FundamentalColumnHeader) + (size_t)pHeader->count * m_nWidth) {
+		printf("%s is not a version %u column file\n", pszFileName, FUNDAMENTAL_COLUMN_VERSION);
+		m_file.close();
+		return false;
+	}
+	m_nCount = pHeader->count;
+	return true;
+}
+
+double FundamentalColumn::value(uint32_t nRow) const
+{
+	if (nRow >= m_nCount || m_nWidth != sizeof(double))
+		return NAN;
+	double value;
+	memcpy(&value, m_file.data() + sizeof(FundamentalColumnHeader) + nRow * sizeof(double), sizeof(double));
+	return value;
+}
+
+const char *FundamentalColumn::symbol(uint32_t nRow) const
+{
+	if (nRow >= m_nCount || m_nWidth != SYMBOL_WIDTH)
+		return "";
+	return m_file.data() + sizeof(FundamentalColumnHeader) + nRow * SYMBOL_WIDTH;
+}
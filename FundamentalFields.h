@@ -0,0 +1,86 @@
+﻿#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_FUNDAMENTALFIELDS_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_FUNDAMENTALFIELDS_H
+
+#include "MappedFile.h"
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+enum FundamentalReport { FR_SNAPSHOT, FR_FINSTATEMENTS, FR_COUNT };
+
+// ReportSnapshot, ReportsFinStatements
+const char *FundamentalReportName(FundamentalReport report);
+
+// One number taken from a report: the text of the first <element attribute="key">
+// in document order, or of the first <element> when attribute is empty. Financial
+// statements list the latest annual period first, so first match is the latest year.
+struct FundamentalField {
+	std::string element;
+	std::string attribute;
+	std::string key;
+	std::string column;
+};
+
+// The configured fields of one report kind as a table with a row per symbol and a
+// column per field, NaN where a report lacked the field. Saved one file per column,
+// 美股财务数据\字段\<report>\<YYYYMMDD>\<column>.col, next to symbols.col:
+//   FundamentalColumnHeader, then count doubles (count char[16] names in symbols.col)
+const uint32_t FUNDAMENTAL_COLUMN_MAGIC = 0x4c4f4346;	// "FCOL"
+const uint32_t FUNDAMENTAL_COLUMN_VERSION = 1;
+
+struct FundamentalColumnHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t reserved;
+};
+
+class FundamentalTable {
+public:
+	static const size_t MAX_FIELDS = 64;
+
+	explicit FundamentalTable(FundamentalReport report);
+
+	// replaces the built-in fields with "element attribute key [column]" lines, '-' for
+	// no attribute, '#' starts a comment; call before any report arrives
+	bool loadFields(const char *pszFileName);
+	const std::vector<FundamentalField>& fields() const { return m_fields; }
+
+	// extracts the fields on the calling thread, a later report for a symbol replaces its row
+	bool extract(uint32_t symbolId, std::string_view report);
+	// waits for reports posted to WorkerPool::shared(), writes the table for nDate and
+	// starts an empty one
+	bool save(int nDate);
+
+private:
+	FundamentalReport m_report;
+	std::vector<FundamentalField> m_fields;
+	std::mutex m_mutex;
+	std::unordered_map<uint32_t, uint32_t> m_rows;
+	std::vector<uint32_t> m_symbols;
+	std::vector<std::vector<double>> m_columns;
+};
+
+// One saved column, read through a mapping.
+class FundamentalColumn {
+public:
+	bool open(FundamentalReport report, int nDate, const char *pszColumn);
+	uint32_t count() const { return m_nCount; }
+	// for a value column
+	double value(uint32_t nRow) const;
+	// for symbols.col
+	const char *symbol(uint32_t nRow) const;
+
+private:
+	MappedFile m_file;
+	uint32_t m_nCount = 0;
+	size_t m_nWidth = 0;
+};
+
+#endif
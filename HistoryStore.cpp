@@ -0,0 +1,358 @@
+﻿#include "StdAfx.h"
+
+#include "HistoryStore.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "SymbolTable.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace {
+
+const char *HISTORY_DIR = "C:\\bighouse\\波动率探索器\\历史";
+const char *HISTORY_DATA = "C:\\bighouse\\波动率探索器\\历史\\history.dat";
+const char *HISTORY_LOG = "C:\\bighouse\\波动率探索器\\历史\\history.log";
+
+int CompareKey(const HistoryRecord& a, const HistoryRecord& b)
+{
+	int nCmp = strncmp(a.symbol, b.symbol, sizeof(a.symbol));
+	if (nCmp != 0)
+		return nCmp;
+	if (a.expiry != b.expiry)
+		return a.expiry < b.expiry ? -1 : 1;
+	if (a.date != b.date)
+		return a.date < b.date ? -1 : 1;
+	return 0;
+}
+
+bool KeyLess(const HistoryRecord& a, const HistoryRecord& b)
+{
+	return CompareKey(a, b) < 0;
+}
+
+bool ToRecord(const HistoryPoint& point, HistoryRecord& record)
+{
+	const std::string& name = SymbolTable::instance().name(point.symbolId);
+	if (name.size() >= sizeof(record.symbol))
+		return false;
+	memset(&record, 0x00, sizeof(record));
+	memcpy(record.symbol, name.data(), name.size());
+	record.expiry = point.expiry;
+	record.date = point.date;
+	record.strike = point.strike;
+	record.price = point.price;
+	record.yield = point.yield;
+	record.iv = point.iv;
+	return true;
+}
+
+HistoryPoint ToPoint(const HistoryRecord& record)
+{
+	HistoryPoint point;
+	point.symbolId = SymbolTable::instance().intern(std::string_view(record.symbol, strnlen(record.symbol, sizeof(record.symbol))));
+	point.expiry = record.expiry;
+	point.date = record.date;
+	point.strike = record.strike;
+	point.price = record.price;
+	point.yield = record.yield;
+	point.iv = record.iv;
+	return point;
+}
+
+} // namespace
+
+HistoryStore& HistoryStore::instance()
+{
+	static HistoryStore store;
+	return store;
+}
+
+HistoryStore::HistoryStore()
+	: m_bOpened(false)
+	, m_hLog(INVALID_HANDLE_VALUE)
+{
+}
+
+const HistoryRecord *HistoryStore::records() const
+{
+	return (const HistoryRecord *)(m_data.data() + sizeof(HistoryFileHeader));
+}
+
+uint32_t HistoryStore::recordCount() const
+{
+	return m_data.size() == 0 ? 0 : ((const HistoryFileHeader *)m_data.data())->count;
+}
+
+void HistoryStore::openLocked()
+{
+	m_bOpened = true;
+	CreateDirectory(HISTORY_DIR, NULL);
+	if (m_data.open(HISTORY_DATA)) {
+		const HistoryFileHeader *pHeader = (const HistoryFileHeader *)m_data.data();
+		if (m_data.size() < sizeof(HistoryFileHeader) || pHeader->magic != HISTORY_FILE_MAGIC || pHeader->version != HISTORY_FILE_VERSION
+			|| m_data.size() != sizeof(HistoryFileHeader) + (size_t)pHeader->count * sizeof(HistoryRecord)) {
+			printf("%s is not a version %u history file, ignored\n", HISTORY_DATA, HISTORY_FILE_VERSION);
+			m_data.close();
+		}
+	}
+	buildIndexLocked();
+
+	// replay what arrived after the last compaction; a torn last record is dropped
+	MappedFile log;
+	if (log.open(HISTORY_LOG)) {
+		size_t nCount = log.size() / sizeof(HistoryRecord);
+		m_tail.resize(nCount);
+		if (nCount > 0)
+			memcpy(&m_tail[0], log.data(), nCount * sizeof(HistoryRecord));
+		log.close();
+	}
+	m_hLog = CreateFile(HISTORY_LOG, GENERIC_WRITE, FILE_SHARE_READ, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (m_hLog != INVALID_HANDLE_VALUE)
+		SetFilePointer(m_hLog, (long)(m_tail.size() * sizeof(HistoryRecord)), 0, FILE_BEGIN);
+}
+
+void HistoryStore::buildIndexLocked()
+{
+	m_blocks.clear();
+	const HistoryRecord *pRecords = records();
+	uint32_t nCount = recordCount();
+	for (uint32_t i = 0; i < nCount; i += BLOCK_SIZE) {
+		BlockIndex block;
+		memcpy(block.firstSymbol, pRecords[i].symbol, sizeof(block.firstSymbol));
+		block.minDate = 0xffffffff;
+		block.maxDate = 0;
+		for (uint32_t j = i; j < nCount && j < i + BLOCK_SIZE; j++) {
+			block.minDate = (std::min)(block.minDate, pRecords[j].date);
+			block.maxDate = (std::max)(block.maxDate, pRecords[j].date);
+		}
+		m_blocks.push_back(block);
+	}
+}
+
+void HistoryStore::append(const HistoryPoint& point)
+{
+	HistoryRecord record;
+	if (!ToRecord(point, record))
+		return;
+	std::unique_lock<std::shared_mutex> lock(m_mutex);
+	if (!m_bOpened)
+		openLocked();
+	m_tail.push_back(record);
+	DWORD dwWrite;
+	if (m_hLog != INVALID_HANDLE_VALUE && WriteFile(m_hLog, &record, sizeof(record), &dwWrite, 0))
+		metrics::BytesWritten.inc(MW_HISTORY, dwWrite);
+}
+
+std::vector<HistoryPoint> HistoryStore::symbolHistory(uint32_t symbolId, uint32_t fromDate, uint32_t toDate)
+{
+	HistoryPoint probe = { symbolId, 0, 0, 0, 0, 0, 0 };
+	HistoryRecord key;
+	std::vector<HistoryPoint> result;
+	if (!ToRecord(probe, key))
+		return result;
+	{
+		std::unique_lock<std::shared_mutex> lock(m_mutex);
+		if (!m_bOpened)
+			openLocked();
+	}
+	std::shared_lock<std::shared_mutex> lock(m_mutex);
+	// (expiry, date) -> point, the log overrides history.dat
+	std::map<uint64_t, HistoryPoint> points;
+
+	// the symbol starts in the last block whose first symbol sorts before it
+	size_t nBlock = 0;
+	size_t nLow = 0;
+	size_t nHigh = m_blocks.size();
+	while (nLow < nHigh) {
+		size_t nMid = (nLow + nHigh) / 2;
+		if (strncmp(m_blocks[nMid].firstSymbol, key.symbol, sizeof(key.symbol)) < 0) {
+			nBlock = nMid;
+			nLow = nMid + 1;
+		}
+		else {
+			nHigh = nMid;
+		}
+	}
+	const HistoryRecord *pRecords = records();
+	uint32_t nCount = recordCount();
+	for (uint32_t i = (uint32_t)(nBlock * BLOCK_SIZE); i < nCount; i++) {
+		int nCmp = strncmp(pRecords[i].symbol, key.symbol, sizeof(key.symbol));
+		if (nCmp > 0)
+			break;
+		if (nCmp == 0 && pRecords[i].date >= fromDate && pRecords[i].date <= toDate)
+			points[(uint64_t)pRecords[i].expiry << 32 | pRecords[i].date] = ToPoint(pRecords[i]);
+	}
+	for (size_t i = 0; i < m_tail.size(); i++) {
+		const HistoryRecord& record = m_tail[i];
+		if (strncmp(record.symbol, key.symbol, sizeof(key.symbol)) == 0 && record.date >= fromDate && record.date <= toDate)
+			points[(uint64_t)record.expiry << 32 | record.date] = ToPoint(record);
+	}
+	result.reserve(points.size());
+	for (std::map<uint64_t, HistoryPoint>::iterator it = points.begin(); it != points.end(); ++it)
+		result.push_back(it->second);
+	return result;
+}
+
+std::vector<HistoryPoint> HistoryStore::onDate(uint32_t date)
+{
+	{
+		std::unique_lock<std::shared_mutex> lock(m_mutex);
+		if (!m_bOpened)
+			openLocked();
+	}
+	std::shared_lock<std::shared_mutex> lock(m_mutex);
+	std::map<std::pair<std::string, uint32_t>, HistoryPoint> points;
+	const HistoryRecord *pRecords = records();
+	uint32_t nCount = recordCount();
+	// only blocks whose date range covers the date are read
+	for (size_t b = 0; b < m_blocks.size(); b++) {
+		if (date < m_blocks[b].minDate || date > m_blocks[b].maxDate)
+			continue;
+		for (uint32_t i = (uint32_t)(b * BLOCK_SIZE); i < nCount && i < (b + 1) * BLOCK_SIZE; i++) {
+			if (pRecords[i].date == date)
+				points[std::make_pair(std::string(pRecords[i].symbol, strnlen(pRecords[i].symbol, 16)), pRecords[i].expiry)] = ToPoint(pRecords[i]);
+		}
+	}
+	for (size_t i = 0; i < m_tail.size(); i++) {
+		if (m_tail[i].date == date)
+			points[std::make_pair(std::string(m_tail[i].symbol, strnlen(m_tail[i].symbol, 16)), m_tail[i].expiry)] = ToPoint(m_tail[i]);
+	}
+	std::vector<HistoryPoint> result;
+	result.reserve(points.size());
+	for (std::map<std::pair<std::string, uint32_t>, HistoryPoint>::iterator it = points.begin(); it != points.end(); ++it)
+		result.push_back(it->second);
+	return result;
+}
+
+bool HistoryStore::compact()
+{
+	std::unique_lock<std::shared_mutex> lock(m_mutex);
+	if (!m_bOpened)
+		openLocked();
+	return compactLocked();
+}
+
+bool HistoryStore::compactIfDue()
+{
+	std::unique_lock<std::shared_mutex> lock(m_mutex);
+	if (!m_bOpened)
+		openLocked();
+	if ((int)m_tail.size() < COMPACT_EVERY)
+		return true;
+	return compactLocked();
+}
+
+bool HistoryStore::compactLocked()
+{
+	if (m_tail.empty())
+		return true;
+	TraceSpan span("history compact", "disk", "records", (int64_t)m_tail.size());
+	std::vector<HistoryRecord> all(records(), records() + recordCount());
+	all.insert(all.end(), m_tail.begin(), m_tail.end());
+	// stable, so of equal keys the log's, and among those the latest, comes last
+	std::stable_sort(all.begin(), all.end(), KeyLess);
+	size_t nOut = 0;
+	for (size_t i = 0; i < all.size(); i++) {
+		if (i + 1 < all.size() && CompareKey(all[i], all[i + 1]) == 0)
+			continue;
+		all[nOut++] = all[i];
+	}
+	all.resize(nOut);
+
+	HistoryFileHeader header;
+	header.magic = HISTORY_FILE_MAGIC;
+	header.version = HISTORY_FILE_VERSION;
+	header.count = (uint32_t)all.size();
+	header.reserved = 0;
+	char pszTempName[MAX_PATH];
+	sprintf_s(pszTempName, MAX_PATH, "%s.tmp", HISTORY_DATA);
+	HANDLE hFile = CreateFile(pszTempName, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	DWORD dwWrite;
+	bool bOk = WriteFile(hFile, &header, sizeof(header), &dwWrite, 0) != 0
+		&& (all.empty() || WriteFile(hFile, &all[0], (DWORD)(all.size() * sizeof(HistoryRecord)), &dwWrite, 0) != 0)
+		&& FlushFileBuffers(hFile) != 0;
+	CloseHandle(hFile);
+	// a mapped file can't be replaced
+	m_data.close();
+	if (!bOk || MoveFileEx(pszTempName, HISTORY_DATA, MOVEFILE_REPLACE_EXISTING) == 0) {
+		printf("History: can't write %s\n", HISTORY_DATA);
+		DeleteFile(pszTempName);
+		m_data.open(HISTORY_DATA);
+		return false;
+	}
+	m_data.open(HISTORY_DATA);
+	buildIndexLocked();
+
+	// if this is lost, the next start replays records history.dat already has, harmlessly
+	if (m_hLog != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hLog);
+	m_hLog = CreateFile(HISTORY_LOG, GENERIC_WRITE, FILE_SHARE_READ, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	m_tail.clear();
+	printf("History: compacted to %lu records\n", (unsigned long)all.size());
+	return true;
+}
+
+int HistoryStore::importTextHistory()
+{
+	std::unique_lock<std::shared_mutex> lock(m_mutex);
+	if (!m_bOpened)
+		openLocked();
+	if (recordCount() != 0 || !m_tail.empty())
+		return 0;
+
+	int nImported = 0;
+	WIN32_FIND_DATA dirData;
+	HANDLE hDirs = FindFirstFile("C:\\bighouse\\波动率探索器\\利率\\*", &dirData);
+	if (hDirs == INVALID_HANDLE_VALUE)
+		return 0;
+	do {
+		if ((dirData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 || dirData.cFileName[0] == '.')
+			continue;
+		uint32_t nExpiry = (uint32_t)atoi(dirData.cFileName);
+		char pszFind[MAX_PATH];
+		sprintf_s(pszFind, MAX_PATH, "C:\\bighouse\\波动率探索器\\利率\\%s\\*_*.txt", dirData.cFileName);
+		WIN32_FIND_DATA fileData;
+		HANDLE hFiles = FindFirstFile(pszFind, &fileData);
+		if (hFiles == INVALID_HANDLE_VALUE)
+			continue;
+		do {
+			// <expiry>_<date>.txt of "symbol,strike,yield" lines
+			uint32_t nDate = (uint32_t)atoi(strchr(fileData.cFileName, '_') + 1);
+			char pszFileName[MAX_PATH];
+			sprintf_s(pszFileName, MAX_PATH, "C:\\bighouse\\波动率探索器\\利率\\%s\\%s", dirData.cFileName, fileData.cFileName);
+			FILE *fp;
+			if (fopen_s(&fp, pszFileName, "r") != 0)
+				continue;
+			char pszLine[256];
+			while (fgets(pszLine, sizeof(pszLine), fp) != NULL) {
+				char *pStrike = strchr(pszLine, ',');
+				char *pYield = pStrike ? strchr(pStrike + 1, ',') : NULL;
+				if (pYield == NULL || pStrike - pszLine >= 16)
+					continue;
+				HistoryRecord record;
+				memset(&record, 0x00, sizeof(record));
+				memcpy(record.symbol, pszLine, pStrike - pszLine);
+				record.expiry = nExpiry;
+				record.date = nDate;
+				record.strike = atof(pStrike + 1);
+				record.price = NAN;
+				record.yield = atof(pYield + 1);
+				record.iv = NAN;
+				m_tail.push_back(record);
+				nImported++;
+			}
+			fclose(fp);
+		} while (FindNextFile(hFiles, &fileData) != 0);
+		FindClose(hFiles);
+	} while (FindNextFile(hDirs, &dirData) != 0);
+	FindClose(hDirs);
+	compactLocked();
+	return nImported;
+}
@@ -0,0 +1,92 @@
+﻿#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_HISTORYSTORE_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_HISTORYSTORE_H
+
+#include "MappedFile.h"
+
+#include <stdint.h>
+
+#include <shared_mutex>
+#include <vector>
+
+// One scan result per (symbol, expiry, date); a later one on the same day replaces it.
+struct HistoryPoint {
+	uint32_t symbolId;	// SymbolTable id, stored on disk by name
+	uint32_t expiry;	// YYYYMMDD
+	uint32_t date;		// YYYYMMDD of the scan
+	double strike;
+	double price;		// option price the yield was computed from
+	double yield;
+	double iv;
+};
+
+// On disk, 波动率探索器\历史\:
+//   history.dat  HistoryFileHeader then HistoryRecord[count] sorted by (symbol, expiry, date),
+//                rewritten atomically by compaction and read through a mapping
+//   history.log  HistoryRecord appended as results arrive, folded into history.dat by
+//                compactIfDue() at the end of a scan once it holds COMPACT_EVERY records
+const uint32_t HISTORY_FILE_MAGIC = 0x54534948;	// "HIST"
+const uint32_t HISTORY_FILE_VERSION = 1;
+
+struct HistoryFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t reserved;
+};
+
+struct HistoryRecord {
+	char symbol[16];
+	uint32_t expiry;
+	uint32_t date;
+	double strike;
+	double price;
+	double yield;
+	double iv;
+};
+
+class HistoryStore {
+public:
+	static const int COMPACT_EVERY = 50000;
+	// one sparse index entry per block of this many history.dat records
+	static const int BLOCK_SIZE = 64;
+
+	static HistoryStore& instance();
+
+	void append(const HistoryPoint& point);
+	// yield/IV history of one symbol, all expiries, oldest first per expiry
+	std::vector<HistoryPoint> symbolHistory(uint32_t symbolId, uint32_t fromDate = 0, uint32_t toDate = 0xffffffff);
+	// every symbol scanned on one date
+	std::vector<HistoryPoint> onDate(uint32_t date);
+	// folds history.log into history.dat
+	bool compact();
+	// compact() once history.log holds COMPACT_EVERY records; rewrites all of history.dat,
+	// so the scan calls it as it saves, never append() on the tick path
+	bool compactIfDue();
+	// loads the legacy 利率\<expiry>\<expiry>_<date>.txt files, once, into an empty store
+	int importTextHistory();
+
+private:
+	struct BlockIndex {
+		char firstSymbol[16];
+		uint32_t minDate;
+		uint32_t maxDate;
+	};
+
+	HistoryStore();
+	void openLocked();
+	void buildIndexLocked();
+	bool compactLocked();
+	const HistoryRecord *records() const;
+	uint32_t recordCount() const;
+
+	std::shared_mutex m_mutex;
+	bool m_bOpened;
+	HANDLE m_hLog;
+	MappedFile m_data;
+	std::vector<BlockIndex> m_blocks;
+	// history.log in memory, in arrival order
+	std::vector<HistoryRecord> m_tail;
+};
+
+#endif
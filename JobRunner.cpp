@@ -0,0 +1,178 @@
+#include "StdAfx.h"
+
+#include "JobRunner.h"
+#include "TestCppClient.h"
+
+#include <stdio.h>
+
+namespace {
+
+std::map<std::string, JobFactory>& Registry()
+{
+	// function local so registrars in other translation units can run in any order
+	static std::map<std::string, JobFactory> registry;
+	return registry;
+}
+
+thread_local int t_idBase = 0;
+
+std::string Trim(const std::string& s)
+{
+	size_t first = s.find_first_not_of(" \t\r\n");
+	if (first == std::string::npos)
+		return "";
+	size_t last = s.find_last_not_of(" \t\r\n");
+	return s.substr(first, last - first + 1);
+}
+
+bool ParseParam(const std::string& item, JobParams& params, std::string& key)
+{
+	size_t eq = item.find('=');
+	if (eq == std::string::npos)
+		return false;
+	key = Trim(item.substr(0, eq));
+	params[key] = Trim(item.substr(eq + 1));
+	return true;
+}
+
+}
+
+std::vector<std::string> SplitJobList(const std::string& value)
+{
+	std::vector<std::string> items;
+	size_t start = 0;
+	for (;;) {
+		size_t comma = value.find(',', start);
+		std::string item = Trim(value.substr(start, comma == std::string::npos ? std::string::npos : comma - start));
+		if (!item.empty())
+			items.push_back(item);
+		if (comma == std::string::npos)
+			break;
+		start = comma + 1;
+	}
+	return items;
+}
+
+void JobRunner::registerJob(const char* name, JobFactory factory)
+{
+	Registry()[name] = factory;
+}
+
+std::vector<std::string> JobRunner::jobNames()
+{
+	std::vector<std::string> names;
+	for (auto it = Registry().begin(); it != Registry().end(); ++it)
+		names.push_back(it->first);
+	return names;
+}
+
+int JobRunner::idBase()
+{
+	return t_idBase;
+}
+
+void JobRunner::setIdBase(int idBase)
+{
+	t_idBase = idBase;
+}
+
+bool JobRunner::addJob(const std::string& spec)
+{
+	size_t colon = spec.find(':');
+	JobParams params;
+	if (colon != std::string::npos) {
+		std::string list = spec.substr(colon + 1);
+		std::string key;
+		size_t start = 0;
+		for (;;) {
+			size_t comma = list.find(',', start);
+			std::string item = list.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+			// "expiries=20240119,20240216" keeps its commas, only key=value items start a new param
+			if (!ParseParam(item, params, key) && !key.empty())
+				params[key] += "," + Trim(item);
+			if (comma == std::string::npos)
+				break;
+			start = comma + 1;
+		}
+	}
+	return addJob(Trim(spec.substr(0, colon)), params);
+}
+
+bool JobRunner::addJob(const std::string& name, const JobParams& params)
+{
+	auto it = Registry().find(name);
+	if (it == Registry().end()) {
+		printf("Unknown job: %s\n", name.c_str());
+		return false;
+	}
+	m_jobs.push_back(it->second());
+	m_params.push_back(params);
+	return true;
+}
+
+bool JobRunner::loadConfig(const char* pszFileName)
+{
+	FILE *fp;
+	int nRet = fopen_s(&fp, pszFileName, "r");
+	if (nRet != 0) {
+		printf("Cannot open job config %s\n", pszFileName);
+		return false;
+	}
+	char pszLine[1024] = "";
+	std::string name;
+	JobParams params;
+	std::string key;
+	bool bOk = true;
+	while (bOk && fgets(pszLine, sizeof(pszLine), fp) != NULL) {
+		std::string line = Trim(pszLine);
+		if (line.empty() || line[0] == '#')
+			continue;
+		if (line[0] == '[' && line[line.size() - 1] == ']') {
+			if (!name.empty())
+				bOk = addJob(name, params);
+			name = Trim(line.substr(1, line.size() - 2));
+			params.clear();
+		}
+		else if (name.empty() || !ParseParam(line, params, key)) {
+			printf("Bad line in job config %s: %s\n", pszFileName, line.c_str());
+			bOk = false;
+		}
+	}
+	fclose(fp);
+	if (bOk && !name.empty())
+		bOk = addJob(name, params);
+	return bOk;
+}
+
+void JobRunner::start(TestCppClient* pClient)
+{
+	for (size_t i = 0; i < m_jobs.size(); i++)
+		m_jobs[i]->configure(m_params[i]);
+	m_running = (int)m_jobs.size();
+	m_started = true;
+	for (size_t i = 0; i < m_jobs.size(); i++) {
+		Job* pJob = m_jobs[i].get();
+		int idBase = (int)(i + 1) * JOB_ID_SPAN;
+		std::atomic<int>* pRunning = &m_running;
+		m_threads.push_back(std::thread([pJob, pClient, idBase, pRunning]() {
+			t_idBase = idBase;
+			pJob->run(pClient);
+			--*pRunning;
+		}));
+	}
+}
+
+void JobRunner::join()
+{
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_threads[i].join();
+	m_threads.clear();
+}
+
+bool JobRunner::dispatchFundamentalData(int reqId, std::string_view data)
+{
+	int slot = reqId / JOB_ID_SPAN - 1;
+	if (slot < 0 || slot >= (int)m_jobs.size())
+		return false;
+	return m_jobs[slot]->onFundamentalData(reqId % JOB_ID_SPAN, data);
+}
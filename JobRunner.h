@@ -0,0 +1,79 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_JOBRUNNER_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_JOBRUNNER_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class TestCppClient;
+
+typedef std::map<std::string, std::string> JobParams;
+
+// Each running job sends its requests with ids offset by (slot + 1) * JOB_ID_SPAN, so jobs
+// that number their requests from 0 can run side by side. Callbacks reduce an id modulo
+// JOB_ID_SPAN before decoding the crawler's own ranges.
+const int JOB_ID_SPAN = 1000000;
+
+class Job {
+public:
+	virtual ~Job() {}
+
+	// called for every job before any of them starts, on the main thread
+	virtual void configure(const JobParams& /*params*/) {}
+	// runs on the job's own thread
+	virtual void run(TestCppClient* pClient) = 0;
+	// fundamentalData for one of this job's requests, localId is the id the job used
+	virtual bool onFundamentalData(int /*localId*/, std::string_view /*data*/) { return false; }
+};
+
+typedef std::unique_ptr<Job> (*JobFactory)();
+
+class JobRunner {
+public:
+	static void registerJob(const char* name, JobFactory factory);
+	static std::vector<std::string> jobNames();
+
+	// id offset of the job running on the calling thread, 0 on any other thread
+	static int idBase();
+	// for threads a job starts itself, so their requests carry the job's offset too
+	static void setIdBase(int idBase);
+
+	// "name" or "name:key=value,key=value"
+	bool addJob(const std::string& spec);
+	// one [name] section per job followed by key=value lines, '#' starts a comment
+	bool loadConfig(const char* pszFileName);
+	bool empty() const { return m_jobs.empty(); }
+
+	void start(TestCppClient* pClient);
+	// true once every started job has returned
+	bool finished() const { return m_started && m_running == 0; }
+	void join();
+
+	bool dispatchFundamentalData(int reqId, std::string_view data);
+
+private:
+	bool addJob(const std::string& name, const JobParams& params);
+
+	std::vector<std::unique_ptr<Job>> m_jobs;
+	std::vector<JobParams> m_params;
+	std::vector<std::thread> m_threads;
+	bool m_started = false;
+	std::atomic<int> m_running{0};
+};
+
+template<typename T>
+class JobRegistrar {
+public:
+	explicit JobRegistrar(const char* name) { JobRunner::registerJob(name, &create); }
+	static std::unique_ptr<Job> create() { return std::unique_ptr<Job>(new T()); }
+};
+
+// "a,b,c" -> {"a", "b", "c"}
+std::vector<std::string> SplitJobList(const std::string& value);
+
+#endif
@@ -0,0 +1,183 @@
+#include "StdAfx.h"
+
+#include "Latency.h"
+#include "Log.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+const int64_t EMPTY_KEY = -1;
+
+int BitWidth(uint64_t value)
+{
+	int nBits = 0;
+	while (value != 0) {
+		nBits++;
+		value >>= 1;
+	}
+	return nBits;
+}
+
+const double Quantiles[] = { 0.5, 0.99, 0.999 };
+const char *const QuantileNames[] = { "0.5", "0.99", "0.999" };
+
+}
+
+HdrHistogram::HdrHistogram()
+	: m_sum(0)
+{
+	for (int i = 0; i < BUCKETS; i++)
+		m_counts[i].store(0, std::memory_order_relaxed);
+}
+
+int HdrHistogram::index(uint64_t value)
+{
+	if (value < 2 * SUB_BUCKETS)
+		return (int)value;
+	int nShift = BitWidth(value) - SUB_BITS - 1;
+	if (nShift > MAX_BITS - SUB_BITS - 1)
+		return BUCKETS - 1;
+	return 2 * SUB_BUCKETS + (nShift - 1) * SUB_BUCKETS + (int)(value >> nShift) - SUB_BUCKETS;
+}
+
+uint64_t HdrHistogram::highestEquivalent(int nIndex)
+{
+	if (nIndex < 2 * SUB_BUCKETS)
+		return nIndex;
+	int nShift = (nIndex - 2 * SUB_BUCKETS) / SUB_BUCKETS + 1;
+	uint64_t top = (nIndex - 2 * SUB_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+	return ((top + 1) << nShift) - 1;
+}
+
+void HdrHistogram::record(uint64_t value)
+{
+	m_counts[index(value)].fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+uint64_t HdrHistogram::count() const
+{
+	uint64_t nCount = 0;
+	for (int i = 0; i < BUCKETS; i++)
+		nCount += m_counts[i].load(std::memory_order_relaxed);
+	return nCount;
+}
+
+uint64_t HdrHistogram::percentile(double quantile) const
+{
+	uint64_t nCount = count();
+	if (nCount == 0)
+		return 0;
+	uint64_t nTarget = (uint64_t)(quantile * nCount + 0.5);
+	if (nTarget < 1)
+		nTarget = 1;
+	uint64_t nSeen = 0;
+	for (int i = 0; i < BUCKETS; i++) {
+		nSeen += m_counts[i].load(std::memory_order_relaxed);
+		if (nSeen >= nTarget)
+			return highestEquivalent(i);
+	}
+	return highestEquivalent(BUCKETS - 1);
+}
+
+LatencyMetric::LatencyMetric(const char *pszName, const char *pszHelp, const MetricLabels& calls)
+	: Metric(pszName, pszHelp, "summary")
+	, m_calls(calls)
+{
+	for (int i = 0; i < CAPACITY; i++)
+		m_keys[i].store(EMPTY_KEY, std::memory_order_relaxed);
+}
+
+HdrHistogram *LatencyMetric::find(int64_t key)
+{
+	int i = (int)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >> 58) & (CAPACITY - 1);
+	for (int nProbe = 0; nProbe < CAPACITY; nProbe++, i = (i + 1) & (CAPACITY - 1)) {
+		int64_t current = m_keys[i].load(std::memory_order_acquire);
+		if (current == EMPTY_KEY) {
+			if (m_keys[i].compare_exchange_strong(current, key, std::memory_order_acq_rel))
+				return &m_histograms[i];
+		}
+		if (current == key)
+			return &m_histograms[i];
+	}
+	return NULL;
+}
+
+void LatencyMetric::record(int nCall, const std::string& exchange, uint64_t micros)
+{
+	int64_t key = (int64_t)(nCall & 0x7f) << 56;
+	for (size_t i = 0; i < exchange.size() && i < 7; i++)
+		key |= (int64_t)(unsigned char)exchange[i] << (8 * (6 - i));
+	HdrHistogram *pHistogram = find(key);
+	if (pHistogram != NULL)
+		pHistogram->record(micros);
+}
+
+void LatencyMetric::appendLabels(std::string& out, int64_t key) const
+{
+	int nCall = (int)(key >> 56);
+	out += "call=\"";
+	if (nCall < m_calls.nNames)
+		out += m_calls.ppszNames[nCall];
+	else
+		out += std::to_string(nCall);
+	out += "\",exchange=\"";
+	for (int i = 0; i < 7; i++) {
+		char c = (char)(key >> (8 * (6 - i)));
+		if (c == 0)
+			break;
+		out += c;
+	}
+	out += '"';
+}
+
+void LatencyMetric::writeSamples(std::string& out) const
+{
+	std::vector<std::pair<int64_t, int>> series;
+	for (int i = 0; i < CAPACITY; i++) {
+		int64_t key = m_keys[i].load(std::memory_order_acquire);
+		if (key != EMPTY_KEY)
+			series.push_back(std::make_pair(key, i));
+	}
+	std::sort(series.begin(), series.end());
+	char pszValue[64];
+	for (size_t k = 0; k < series.size(); k++) {
+		const HdrHistogram& histogram = m_histograms[series[k].second];
+		for (int q = 0; q < 3; q++) {
+			out += name();
+			out += '{';
+			appendLabels(out, series[k].first);
+			sprintf_s(pszValue, sizeof(pszValue), ",quantile=\"%s\"} %llu\n", QuantileNames[q], (unsigned long long)histogram.percentile(Quantiles[q]));
+			out += pszValue;
+		}
+		out += name();
+		out += "_sum{";
+		appendLabels(out, series[k].first);
+		sprintf_s(pszValue, sizeof(pszValue), "} %llu\n", (unsigned long long)histogram.sum());
+		out += pszValue;
+		out += name();
+		out += "_count{";
+		appendLabels(out, series[k].first);
+		sprintf_s(pszValue, sizeof(pszValue), "} %llu\n", (unsigned long long)histogram.count());
+		out += pszValue;
+	}
+}
+
+void LatencyMetric::logSummary() const
+{
+	std::string labels;
+	for (int i = 0; i < CAPACITY; i++) {
+		int64_t key = m_keys[i].load(std::memory_order_acquire);
+		if (key == EMPTY_KEY)
+			continue;
+		const HdrHistogram& histogram = m_histograms[i];
+		labels.clear();
+		appendLabels(labels, key);
+		LogInfo("latency %s: %llu samples, p50 %.1f ms, p99 %.1f ms, p999 %.1f ms\n", labels, (unsigned long long)histogram.count(),
+			histogram.percentile(0.5) / 1000.0, histogram.percentile(0.99) / 1000.0, histogram.percentile(0.999) / 1000.0);
+	}
+}
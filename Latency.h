@@ -0,0 +1,70 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_LATENCY_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_LATENCY_H
+
+#include "Metrics.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+// Log-linear histogram in the HdrHistogram layout: values below 2 * SUB_BUCKETS are
+// exact, above that each power of two is split into SUB_BUCKETS, so any value is known
+// to within 1 / SUB_BUCKETS (about 3%). Recording is one relaxed increment.
+class HdrHistogram {
+public:
+	static const int SUB_BITS = 5;
+	static const int SUB_BUCKETS = 1 << SUB_BITS;
+	// up to 2^40 microseconds, about 12 days
+	static const int MAX_BITS = 40;
+	static const int BUCKETS = 2 * SUB_BUCKETS + (MAX_BITS - SUB_BITS - 1) * SUB_BUCKETS;
+
+	HdrHistogram();
+
+	void record(uint64_t value);
+	uint64_t count() const;
+	uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+	// smallest bucket bound with at least quantile of the samples at or below it
+	uint64_t percentile(double quantile) const;
+
+private:
+	static int index(uint64_t value);
+	static uint64_t highestEquivalent(int nIndex);
+
+	std::atomic<uint64_t> m_counts[BUCKETS];
+	std::atomic<uint64_t> m_sum;
+};
+
+// Request-to-response latency in microseconds, one HdrHistogram per (API call, exchange),
+// exported as a Prometheus summary with the p50, p99 and p999.
+class LatencyMetric : public Metric {
+public:
+	static const int CAPACITY = 64;
+
+	LatencyMetric(const char *pszName, const char *pszHelp, const MetricLabels& calls);
+
+	void record(int nCall, const std::string& exchange, uint64_t micros);
+	// one line per series to the log, for the end of a run
+	void logSummary() const;
+
+protected:
+	void writeSamples(std::string& out) const;
+
+private:
+	HdrHistogram *find(int64_t key);
+	void appendLabels(std::string& out, int64_t key) const;
+
+	MetricLabels m_calls;
+	// the call in the top byte, up to seven characters of the exchange below
+	std::atomic<int64_t> m_keys[CAPACITY];
+	HdrHistogram m_histograms[CAPACITY];
+};
+
+namespace metrics {
+	// reqMktData to the first LAST, reqMktData snapshots to tickSnapshotEnd,
+	// reqContractDetails to contractDetailsEnd, reqFundamentalData to fundamentalData
+	extern LatencyMetric RequestLatency;
+}
+
+#endif
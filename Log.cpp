@@ -0,0 +1,141 @@
+#include "StdAfx.h"
+
+#include "Log.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Callers only take a lock and append; the log thread wakes every WAKE_MS, or sooner
+// when WAKE_BACKLOG messages are waiting, and writes them out in one go.
+const int WAKE_MS = 20;
+const size_t WAKE_BACKLOG = 1024;
+
+class LogThread {
+public:
+	LogThread() : m_bStop(false), m_nSubmitted(0), m_nWritten(0), m_nFlushTarget(0), m_thread(&LogThread::run, this) {}
+
+	~LogThread()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_bStop = true;
+		}
+		m_wake.notify_one();
+		m_thread.join();
+	}
+
+	void submit(const LogRecord& record)
+	{
+		bool bWake;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending.push_back(record);
+			m_nSubmitted++;
+			bWake = m_pending.size() == WAKE_BACKLOG;
+			metrics::LogQueueDepth.set((int64_t)m_pending.size());
+		}
+		if (bWake)
+			m_wake.notify_one();
+	}
+
+	void flush()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		uint64_t nTarget = m_nSubmitted;
+		if (m_nFlushTarget < nTarget)
+			m_nFlushTarget = nTarget;
+		m_wake.notify_one();
+		m_written.wait(lock, [&]() { return m_nWritten >= nTarget; });
+	}
+
+private:
+	void run()
+	{
+		TraceThreadName("log");
+		std::vector<LogRecord> batch;
+		std::string out;
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;) {
+			m_wake.wait_for(lock, std::chrono::milliseconds(WAKE_MS), [this]() { return m_bStop || m_pending.size() >= WAKE_BACKLOG || m_nWritten < m_nFlushTarget; });
+			batch.swap(m_pending);
+			metrics::LogQueueDepth.set(0);
+			bool bStop = m_bStop;
+			lock.unlock();
+
+			out.clear();
+			for (size_t i = 0; i < batch.size(); i++)
+				batch[i].format(batch[i], out);
+			if (!out.empty()) {
+				TraceSpan span("log write", "disk", "records", (int64_t)batch.size());
+				fwrite(out.data(), 1, out.size(), stdout);
+				fflush(stdout);
+			}
+
+			lock.lock();
+			m_nWritten += batch.size();
+			batch.clear();
+			m_written.notify_all();
+			if (bStop && m_pending.empty())
+				return;
+		}
+	}
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_written;
+	std::vector<LogRecord> m_pending;
+	bool m_bStop;
+	uint64_t m_nSubmitted;
+	uint64_t m_nWritten;
+	uint64_t m_nFlushTarget;
+	std::thread m_thread;
+};
+
+LogThread& Instance()
+{
+	static LogThread logThread;
+	return logThread;
+}
+
+}
+
+void LogSubmit(const LogRecord& record)
+{
+	Instance().submit(record);
+}
+
+void LogFlush()
+{
+	Instance().flush();
+}
+
+void LogAppendFormat(std::string& out, const char *pszFormat, ...)
+{
+	char pszBuffer[1024];
+	va_list args;
+	va_start(args, pszFormat);
+	int nLength = vsnprintf(pszBuffer, sizeof(pszBuffer), pszFormat, args);
+	va_end(args);
+	if (nLength < 0)
+		return;
+	if ((size_t)nLength < sizeof(pszBuffer)) {
+		out.append(pszBuffer, nLength);
+		return;
+	}
+	size_t nStart = out.size();
+	out.resize(nStart + nLength + 1);
+	va_start(args, pszFormat);
+	vsnprintf(&out[nStart], nLength + 1, pszFormat, args);
+	va_end(args);
+	out.resize(nStart + nLength);
+}
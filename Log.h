@@ -0,0 +1,138 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_LOG_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+enum LogLevel { LL_TRACE, LL_DEBUG, LL_INFO, LL_WARN, LL_ERROR, LL_OFF };
+
+// Messages below LOG_LEVEL are compiled out, arguments and all. Builds that want the
+// callback diagnostics back define LOG_LEVEL=LL_DEBUG or LL_TRACE.
+#ifndef LOG_LEVEL
+#ifdef _DEBUG
+#define LOG_LEVEL LL_DEBUG
+#else
+#define LOG_LEVEL LL_INFO
+#endif
+#endif
+
+// One message waiting for the log thread: the format, which has to be a string literal,
+// and the arguments in binary. Formatting happens on the log thread.
+struct LogRecord {
+	static const size_t PAYLOAD = 240;
+
+	const char *pszFormat;
+	void (*format)(const LogRecord& record, std::string& out);
+	char payload[PAYLOAD];
+};
+
+void LogSubmit(const LogRecord& record);
+// blocks until every message submitted so far is on stdout
+void LogFlush();
+void LogAppendFormat(std::string& out, const char *pszFormat, ...);
+
+// How one printf argument travels in a LogRecord. Scalars and pointers are copied as
+// they are; strings are copied in, length first, and cut to what the record has left.
+template<typename T, typename Enable = void>
+struct LogArg {
+	static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+		"log arguments are numbers, enums, pointers and strings");
+	typedef T Decoded;
+	static const size_t FIXED = sizeof(T);
+
+	static void encode(char*& p, size_t& /*nStringRoom*/, T value)
+	{
+		memcpy(p, &value, sizeof(T));
+		p += sizeof(T);
+	}
+	static T decode(const char*& p)
+	{
+		T value;
+		memcpy(&value, p, sizeof(T));
+		p += sizeof(T);
+		return value;
+	}
+};
+
+struct LogStringArg {
+	typedef const char *Decoded;
+	static const size_t FIXED = sizeof(uint16_t) + 1;
+
+	static void encodeString(char*& p, size_t& nStringRoom, const char *pszValue, size_t nLength)
+	{
+		uint16_t nStored = (uint16_t)(nLength < nStringRoom ? nLength : nStringRoom);
+		nStringRoom -= nStored;
+		memcpy(p, &nStored, sizeof(nStored));
+		memcpy(p + sizeof(nStored), pszValue, nStored);
+		p[sizeof(nStored) + nStored] = 0;
+		p += sizeof(nStored) + nStored + 1;
+	}
+	static const char *decode(const char*& p)
+	{
+		uint16_t nStored;
+		memcpy(&nStored, p, sizeof(nStored));
+		const char *pszValue = p + sizeof(nStored);
+		p += sizeof(nStored) + nStored + 1;
+		return pszValue;
+	}
+};
+
+template<>
+struct LogArg<const char *> : LogStringArg {
+	static void encode(char*& p, size_t& nStringRoom, const char *pszValue)
+	{
+		if (pszValue == NULL)
+			pszValue = "(null)";
+		encodeString(p, nStringRoom, pszValue, strlen(pszValue));
+	}
+};
+
+template<>
+struct LogArg<char *> : LogArg<const char *> {};
+
+template<>
+struct LogArg<std::string> : LogStringArg {
+	static void encode(char*& p, size_t& nStringRoom, const std::string& value) { encodeString(p, nStringRoom, value.data(), value.size()); }
+};
+
+template<typename... Args>
+void LogFormatRecord(const LogRecord& record, std::string& out)
+{
+	const char *p = record.payload;
+	// braces evaluate left to right, in the order the arguments were stored
+	std::tuple<typename LogArg<Args>::Decoded...> args{ LogArg<Args>::decode(p)... };
+	std::apply([&](auto... values) { LogAppendFormat(out, record.pszFormat, values...); }, args);
+}
+
+// Log<LL_DEBUG>("Tick Price. Ticker Id: %ld ...\n", tickerId, ...): printf formats, with
+// std::string taken for %s as well. Below LOG_LEVEL this is nothing at all; otherwise
+// the caller pays for copying the arguments and the log thread for printf.
+template<LogLevel level, typename... Args>
+inline void Log(const char *pszFormat, const Args&... args)
+{
+	if constexpr (level >= LOG_LEVEL) {
+		const size_t nFixed = (size_t(0) + ... + LogArg<std::decay_t<Args>>::FIXED);
+		static_assert(nFixed <= LogRecord::PAYLOAD, "too many log arguments");
+		LogRecord record;
+		record.pszFormat = pszFormat;
+		record.format = &LogFormatRecord<std::decay_t<Args>...>;
+		char *p = record.payload;
+		size_t nStringRoom = LogRecord::PAYLOAD - nFixed;
+		(LogArg<std::decay_t<Args>>::encode(p, nStringRoom, args), ...);
+		LogSubmit(record);
+	}
+}
+
+template<typename... Args> inline void LogTrace(const char *pszFormat, const Args&... args) { Log<LL_TRACE>(pszFormat, args...); }
+template<typename... Args> inline void LogDebug(const char *pszFormat, const Args&... args) { Log<LL_DEBUG>(pszFormat, args...); }
+template<typename... Args> inline void LogInfo(const char *pszFormat, const Args&... args) { Log<LL_INFO>(pszFormat, args...); }
+template<typename... Args> inline void LogWarn(const char *pszFormat, const Args&... args) { Log<LL_WARN>(pszFormat, args...); }
+template<typename... Args> inline void LogError(const char *pszFormat, const Args&... args) { Log<LL_ERROR>(pszFormat, args...); }
+
+#endif
@@ -0,0 +1,120 @@
+/* Copyright (C) 2019 Interactive Brokers LLC. All rights reserved. This code is subject to the terms
+ * and conditions of the IB API Non-Commercial License or the IB API Commercial License, as applicable. */
+
+#include "StdAfx.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "TestCppClient.h"
+#include "JobRunner.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+const unsigned MAX_ATTEMPTS = 50;
+// reconnect backoff: a random delay between half and all of min(cap, base * 2^failures)
+const unsigned RECONNECT_BASE_MS = 250;
+const unsigned RECONNECT_CAP_MS = 8000;
+
+/* IMPORTANT: always use your paper trading account. The code below will submit orders as part of the demonstration. */
+/* IB will not be responsible for accidental executions on your live account. */
+/* Any stock or option symbols displayed are for illustrative purposes only and are not intended to portray a recommendation. */
+/* Before contacting our API support team please refer to the available documentation. */
+//
+// TestCppClient [host] [port] [connectOptions] [--job name[:key=value,...]]... [--config file]
+//               [--metrics port] [--status seconds] [--trace dir]
+//
+// With any --job or --config the client runs headless: the selected jobs start as soon as
+// the connection is up, instead of the sample state machine. --metrics serves Prometheus
+// metrics on 127.0.0.1:port, --status prints a one-line summary every so many seconds.
+// --trace records request, crawler batch, pacing and disk spans and writes them to dir as
+// Chrome trace-event JSON at the end of each scan and crawl, and at exit.
+int main(int argc, char** argv)
+{
+	TraceThreadName("main");
+	JobRunner jobs;
+	std::vector<const char*> args;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--job") == 0 && i + 1 < argc) {
+			if (!jobs.addJob(argv[++i]))
+				return 1;
+		}
+		else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+			if (!jobs.loadConfig(argv[++i]))
+				return 1;
+		}
+		else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+			if (!StartMetricsServer(atoi(argv[++i])))
+				return 1;
+		}
+		else if (strcmp(argv[i], "--status") == 0 && i + 1 < argc) {
+			StartMetricsStatus(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			StartTrace(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--list-jobs") == 0) {
+			std::vector<std::string> names = JobRunner::jobNames();
+			for (size_t k = 0; k < names.size(); k++)
+				printf( "%s\n", names[k].c_str());
+			return 0;
+		}
+		else
+			args.push_back(argv[i]);
+	}
+
+	const char* host = args.size() > 0 ? args[0] : "";
+	int port = args.size() > 1 ? atoi(args[1]) : 0;
+	if (port <= 0)
+		port = 7496;
+	const char* connectOptions = args.size() > 2 ? args[2] : "+PACEAPI";
+	int clientId = 0;
+
+	unsigned attempt = 0;
+	printf( "Start of C++ Socket Client Test %u\n", attempt);
+
+	// One client for the whole run: its subscriptions, pending requests and crawl state
+	// survive a Gateway restart and are replayed on the next connectAck.
+	TestCppClient client;
+	if( connectOptions) {
+		client.setConnectOptions( connectOptions);
+	}
+	if( !jobs.empty()) {
+		client.setJobRunner( &jobs);
+	}
+
+	std::mt19937 rng(std::random_device{}());
+	for (;;) {
+		++attempt;
+		printf( "Attempt %u of %u\n", attempt, MAX_ATTEMPTS);
+
+		if( client.connect( host, port, clientId)) {
+			// count consecutive failures only
+			attempt = 0;
+			while( client.isConnected()) {
+				client.processMessages();
+			}
+		}
+		if( jobs.finished()) {
+			break;
+		}
+		if( attempt >= MAX_ATTEMPTS) {
+			break;
+		}
+
+		unsigned ceiling = (std::min)(RECONNECT_CAP_MS, RECONNECT_BASE_MS << (std::min)(attempt, 5u));
+		unsigned delay = std::uniform_int_distribution<unsigned>(ceiling / 2, ceiling)(rng);
+		printf( "Sleeping %u ms before next attempt\n", delay);
+		std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+	}
+
+	jobs.join();
+	printf ( "End of C++ Socket Client Test\n");
+}
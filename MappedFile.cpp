@@ -0,0 +1,52 @@
+#include "StdAfx.h"
+
+#include "MappedFile.h"
+
+MappedFile::MappedFile()
+	: m_hFile(INVALID_HANDLE_VALUE)
+	, m_hMapping(0)
+	, m_pData(0)
+	, m_nSize(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char *pszFileName)
+{
+	close();
+	// FILE_SHARE_DELETE lets a writer rename the file away while it is mapped, the mapping
+	// keeps the old contents (see WriteChainFile)
+	m_hFile = CreateFile(pszFileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return false;
+	m_nSize = GetFileSize(m_hFile, 0);
+	// a zero length file cannot be mapped, but it is a valid empty file
+	if (m_nSize == 0)
+		return true;
+	m_hMapping = CreateFileMapping(m_hFile, 0, PAGE_READONLY, 0, 0, 0);
+	if (m_hMapping != 0)
+		m_pData = (const char *)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (m_pData == 0) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_pData != 0)
+		UnmapViewOfFile(m_pData);
+	if (m_hMapping != 0)
+		CloseHandle(m_hMapping);
+	if (m_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hFile);
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_hMapping = 0;
+	m_pData = 0;
+	m_nSize = 0;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_MAPPEDFILE_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_MAPPEDFILE_H
+
+#include <stddef.h>
+
+// Read-only memory mapping of a whole file. An empty file opens fine with size 0.
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char *pszFileName);
+	void close();
+
+	const char *data() const { return m_pData; }
+	size_t size() const { return m_nSize; }
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	HANDLE m_hFile;
+	HANDLE m_hMapping;
+	const char *m_pData;
+	size_t m_nSize;
+};
+
+#endif
@@ -0,0 +1,309 @@
+#include "StdAfx.h"
+
+#include "Metrics.h"
+#include "Latency.h"
+#include "Log.h"
+#include "EPosixClientSocketPlatform.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+std::atomic<Metric *> MetricList(NULL);
+
+// LabeledMetric keys that no caller uses
+const int64_t EMPTY_KEY = INT64_MIN;
+const int64_t OVERFLOW_KEY = INT64_MIN + 1;
+
+int BitWidth(uint64_t value)
+{
+	if (value == 0)
+		return 0;
+#ifdef _MSC_VER
+	unsigned long nIndex;
+	_BitScanReverse64(&nIndex, value);
+	return (int)nIndex + 1;
+#else
+	return 64 - __builtin_clzll(value);
+#endif
+}
+
+void AppendNumber(std::string& out, const char *pszFormat, long long value)
+{
+	char pszBuffer[32];
+	sprintf_s(pszBuffer, sizeof(pszBuffer), pszFormat, value);
+	out += pszBuffer;
+}
+
+}
+
+Metric::Metric(const char *pszName, const char *pszHelp, const char *pszType)
+	: m_pszName(pszName)
+	, m_pszHelp(pszHelp)
+	, m_pszType(pszType)
+	, m_pNext(MetricList.load(std::memory_order_relaxed))
+{
+	while (!MetricList.compare_exchange_weak(m_pNext, this, std::memory_order_release, std::memory_order_relaxed))
+		;
+}
+
+void Metric::write(std::string& out) const
+{
+	out += "# HELP ";
+	out += m_pszName;
+	out += ' ';
+	out += m_pszHelp;
+	out += "\n# TYPE ";
+	out += m_pszName;
+	out += ' ';
+	out += m_pszType;
+	out += '\n';
+	writeSamples(out);
+}
+
+void Counter::writeSamples(std::string& out) const
+{
+	out += name();
+	AppendNumber(out, " %llu\n", (long long)value());
+}
+
+void Gauge::writeSamples(std::string& out) const
+{
+	out += name();
+	AppendNumber(out, " %lld\n", (long long)value());
+}
+
+Histogram::Histogram(const char *pszName, const char *pszHelp)
+	: Metric(pszName, pszHelp, "histogram")
+	, m_sum(0)
+{
+	for (int i = 0; i <= BUCKETS; i++)
+		m_buckets[i].store(0, std::memory_order_relaxed);
+}
+
+void Histogram::observe(uint64_t value)
+{
+	int nBucket = BitWidth(value);
+	m_buckets[nBucket < BUCKETS ? nBucket : BUCKETS].fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+void Histogram::writeSamples(std::string& out) const
+{
+	// Prometheus buckets are cumulative
+	uint64_t nCount = 0;
+	for (int i = 0; i < BUCKETS; i++) {
+		nCount += m_buckets[i].load(std::memory_order_relaxed);
+		out += name();
+		AppendNumber(out, "_bucket{le=\"%llu\"}", (long long)((1ull << i) - 1));
+		AppendNumber(out, " %llu\n", (long long)nCount);
+	}
+	nCount += m_buckets[BUCKETS].load(std::memory_order_relaxed);
+	out += name();
+	AppendNumber(out, "_bucket{le=\"+Inf\"} %llu\n", (long long)nCount);
+	out += name();
+	AppendNumber(out, "_sum %llu\n", (long long)m_sum.load(std::memory_order_relaxed));
+	out += name();
+	AppendNumber(out, "_count %llu\n", (long long)nCount);
+}
+
+LabeledMetric::LabeledMetric(const char *pszName, const char *pszHelp, const char *pszType, const MetricLabels& labels)
+	: Metric(pszName, pszHelp, pszType)
+	, m_labels(labels)
+	, m_overflow(0)
+{
+	// named keys sit at their own index, so the enum labelled metrics never hash
+	for (int i = 0; i < CAPACITY; i++) {
+		m_keys[i].store(i < labels.nNames ? i : EMPTY_KEY, std::memory_order_relaxed);
+		m_values[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+std::atomic<int64_t>& LabeledMetric::slot(int64_t key)
+{
+	if (key >= 0 && key < m_labels.nNames)
+		return m_values[key];
+	if (key == EMPTY_KEY || key == OVERFLOW_KEY)
+		return m_overflow;
+	int i = (int)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >> 56) & (CAPACITY - 1);
+	for (int nProbe = 0; nProbe < CAPACITY; nProbe++, i = (i + 1) & (CAPACITY - 1)) {
+		int64_t current = m_keys[i].load(std::memory_order_acquire);
+		if (current == EMPTY_KEY) {
+			// claim the slot; losing the race to the same key is as good as winning
+			if (m_keys[i].compare_exchange_strong(current, key, std::memory_order_acq_rel))
+				return m_values[i];
+		}
+		if (current == key)
+			return m_values[i];
+	}
+	return m_overflow;
+}
+
+int64_t LabeledMetric::total() const
+{
+	int64_t nTotal = m_overflow.load(std::memory_order_relaxed);
+	for (int i = 0; i < CAPACITY; i++) {
+		if (m_keys[i].load(std::memory_order_acquire) != EMPTY_KEY)
+			nTotal += m_values[i].load(std::memory_order_relaxed);
+	}
+	return nTotal;
+}
+
+void LabeledMetric::appendLabel(std::string& out, int64_t key) const
+{
+	out += '{';
+	out += m_labels.pszLabel;
+	out += "=\"";
+	if (key == OVERFLOW_KEY)
+		out += "other";
+	else if (key >= 0 && key < m_labels.nNames)
+		out += m_labels.ppszNames[key];
+	else
+		AppendNumber(out, "%lld", (long long)key);
+	out += "\"}";
+}
+
+void LabeledMetric::writeSamples(std::string& out) const
+{
+	std::vector<std::pair<int64_t, int64_t>> series;
+	for (int i = 0; i < CAPACITY; i++) {
+		int64_t key = m_keys[i].load(std::memory_order_acquire);
+		if (key != EMPTY_KEY)
+			series.push_back(std::make_pair(key, m_values[i].load(std::memory_order_relaxed)));
+	}
+	int64_t nOverflow = m_overflow.load(std::memory_order_relaxed);
+	if (nOverflow != 0)
+		series.push_back(std::make_pair(OVERFLOW_KEY, nOverflow));
+	std::sort(series.begin(), series.end());
+	for (size_t i = 0; i < series.size(); i++) {
+		out += name();
+		appendLabel(out, series[i].first);
+		AppendNumber(out, " %lld\n", (long long)series[i].second);
+	}
+}
+
+void WriteMetrics(std::string& out)
+{
+	for (Metric *pMetric = MetricList.load(std::memory_order_acquire); pMetric != NULL; pMetric = pMetric->m_pNext)
+		pMetric->write(out);
+}
+
+namespace {
+
+void ServeMetrics(int nListen)
+{
+	std::string body;
+	std::string response;
+	char pszRequest[1024];
+	for (;;) {
+		int nSocket = (int)accept(nListen, NULL, NULL);
+		if (nSocket < 0)
+			break;
+		// the request line is all we look at, any path gets the metrics
+		recv(nSocket, pszRequest, sizeof(pszRequest), 0);
+		body.clear();
+		WriteMetrics(body);
+		response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: ";
+		AppendNumber(response, "%lld\r\nConnection: close\r\n\r\n", (long long)body.size());
+		response += body;
+		size_t nSent = 0;
+		while (nSent < response.size()) {
+			int nResult = send(nSocket, response.data() + nSent, (int)(response.size() - nSent), 0);
+			if (nResult <= 0)
+				break;
+			nSent += nResult;
+		}
+		SocketClose(nSocket);
+	}
+	SocketClose(nListen);
+}
+
+}
+
+bool StartMetricsServer(int nPort)
+{
+	if (!SocketsInit()) {
+		printf("metrics: socket init failed\n");
+		return false;
+	}
+	int nListen = (int)socket(AF_INET, SOCK_STREAM, 0);
+	if (nListen < 0) {
+		printf("metrics: socket failed\n");
+		return false;
+	}
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons((unsigned short)nPort);
+	// local only, the endpoint has no authentication
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(nListen, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(nListen, 8) != 0) {
+		printf("metrics: cannot listen on port %d\n", nPort);
+		SocketClose(nListen);
+		return false;
+	}
+	std::thread(ServeMetrics, nListen).detach();
+	printf("metrics: http://127.0.0.1:%d/metrics\n", nPort);
+	return true;
+}
+
+void StartMetricsStatus(int nSeconds)
+{
+	if (nSeconds <= 0)
+		return;
+	std::thread([nSeconds]() {
+		for (;;) {
+			std::this_thread::sleep_for(std::chrono::seconds(nSeconds));
+			LogInfo("status: sent %lld, responses %lld, errors %lld, lines %lld, written %.1f MB, queued %lld tasks %lld log, scan %lld/%lld, results %lld\n",
+				(long long)metrics::RequestsSent.total(), (long long)metrics::Responses.total(), (long long)metrics::Errors.total(),
+				(long long)metrics::MarketDataLines.value(), metrics::BytesWritten.total() / 1048576.0,
+				(long long)metrics::WorkerQueueDepth.value(), (long long)metrics::LogQueueDepth.value(),
+				(long long)metrics::ScanRequested.total(), (long long)metrics::ScanSymbols.total(), (long long)metrics::ScanResults.total());
+		}
+	}).detach();
+}
+
+namespace {
+
+const char *const ApiCallNames[AC_COUNT] = {
+	"reqContractDetails", "reqMktDataSnapshot", "reqFundamentalData", "reqMktData", "cancelMktData", "cancelFundamentalData"
+};
+
+const char *const ApiCallbackNames[CB_COUNT] = {
+	"tickPrice", "tickSize", "tickOptionComputation", "tickGeneric", "tickString", "tickSnapshotEnd",
+	"contractDetails", "contractDetailsEnd", "fundamentalData", "historicalData", "newsArticle", "error"
+};
+
+const char *const MetricWriterNames[MW_COUNT] = { "log", "scan", "history", "archive" };
+
+const MetricLabels CallLabels = { "call", ApiCallNames, AC_COUNT };
+const MetricLabels CallbackLabels = { "callback", ApiCallbackNames, CB_COUNT };
+const MetricLabels CodeLabels = { "code", NULL, 0 };
+const MetricLabels WriterLabels = { "writer", MetricWriterNames, MW_COUNT };
+const MetricLabels ExpiryLabels = { "expiry", NULL, 0 };
+
+}
+
+namespace metrics {
+	LabeledCounter RequestsSent("tws_requests_sent_total", "Requests sent to TWS by API call.", CallLabels);
+	LabeledCounter RequestsSkipped("tws_requests_skipped_total", "Requests not sent because the negative cache knows they fail.", CallLabels);
+	LabeledCounter RequestsTimedOut("tws_requests_timed_out_total", "Requests unanswered past their deadline.", CallLabels);
+	LabeledCounter RequestsRetried("tws_requests_retried_total", "Requests sent again after a timeout.", CallLabels);
+	LabeledCounter Responses("tws_responses_total", "Callbacks received by EWrapper method.", CallbackLabels);
+	LabeledCounter Errors("tws_errors_total", "error() callbacks by error code.", CodeLabels);
+	LabeledCounter BytesWritten("tws_bytes_written_total", "Bytes written to disk by writer.", WriterLabels);
+	Gauge MarketDataLines("tws_market_data_lines", "Streaming market data subscriptions plus pending snapshots.");
+	Gauge WorkerQueueDepth("tws_worker_queue_depth", "Tasks waiting in the worker pools.");
+	Gauge LogQueueDepth("tws_log_queue_depth", "Messages waiting for the log thread.");
+	LabeledGauge ScanSymbols("tws_scan_symbols", "Symbols in the rate scan's chain file by expiry.", ExpiryLabels);
+	LabeledGauge ScanRequested("tws_scan_requested", "Underlyings the rate scan has requested by expiry.", ExpiryLabels);
+	LabeledCounter ScanResults("tws_scan_results_total", "Put yields the rate scan has written by expiry.", ExpiryLabels);
+	Histogram ReportBytes("tws_fundamental_report_bytes", "Sizes of fundamentalData payloads.");
+	LatencyMetric RequestLatency("tws_request_latency_us", "Microseconds from sending a request to its response.", CallLabels);
+}
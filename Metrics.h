@@ -0,0 +1,188 @@
+﻿#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_METRICS_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_METRICS_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+// Counters, gauges and histograms updated with relaxed atomics, so recording an event
+// costs one uncontended increment. Every metric links itself into a global list when
+// constructed; WriteMetrics renders the list in the Prometheus text format.
+class Metric {
+public:
+	Metric(const char *pszName, const char *pszHelp, const char *pszType);
+	virtual ~Metric() {}
+
+	const char *name() const { return m_pszName; }
+	// the HELP and TYPE lines, then the samples
+	void write(std::string& out) const;
+
+protected:
+	virtual void writeSamples(std::string& out) const = 0;
+
+private:
+	friend void WriteMetrics(std::string& out);
+
+	const char *m_pszName;
+	const char *m_pszHelp;
+	const char *m_pszType;
+	Metric *m_pNext;
+};
+
+class Counter : public Metric {
+public:
+	Counter(const char *pszName, const char *pszHelp) : Metric(pszName, pszHelp, "counter"), m_value(0) {}
+
+	void inc(uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+	uint64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+protected:
+	void writeSamples(std::string& out) const;
+
+private:
+	std::atomic<uint64_t> m_value;
+};
+
+class Gauge : public Metric {
+public:
+	Gauge(const char *pszName, const char *pszHelp) : Metric(pszName, pszHelp, "gauge"), m_value(0) {}
+
+	void set(int64_t value) { m_value.store(value, std::memory_order_relaxed); }
+	void add(int64_t delta) { m_value.fetch_add(delta, std::memory_order_relaxed); }
+	int64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+protected:
+	void writeSamples(std::string& out) const;
+
+private:
+	std::atomic<int64_t> m_value;
+};
+
+// Bucket i holds the values that need i bits, so the bounds are 0, 1, 3, 7, ... 2^i - 1.
+class Histogram : public Metric {
+public:
+	static const int BUCKETS = 40;
+
+	Histogram(const char *pszName, const char *pszHelp);
+
+	void observe(uint64_t value);
+
+protected:
+	void writeSamples(std::string& out) const;
+
+private:
+	std::atomic<uint64_t> m_buckets[BUCKETS + 1];
+	std::atomic<uint64_t> m_sum;
+};
+
+// Names the label values of a labeled metric. Keys in [0, nNames) take the name from the
+// table; any other key, or every key without a table, is printed as a number.
+struct MetricLabels {
+	const char *pszLabel;
+	const char *const *ppszNames;
+	int nNames;
+};
+
+// One series per label value, in a fixed open addressed table that is filled lock-free.
+// Keys with a name take the slot of the same index up front. A value that arrives once
+// the table is full is counted under "other".
+class LabeledMetric : public Metric {
+public:
+	static const int CAPACITY = 256;
+
+	LabeledMetric(const char *pszName, const char *pszHelp, const char *pszType, const MetricLabels& labels);
+
+	// sum over every label value
+	int64_t total() const;
+
+protected:
+	std::atomic<int64_t>& slot(int64_t key);
+	void writeSamples(std::string& out) const;
+
+private:
+	void appendLabel(std::string& out, int64_t key) const;
+
+	MetricLabels m_labels;
+	std::atomic<int64_t> m_keys[CAPACITY];
+	std::atomic<int64_t> m_values[CAPACITY];
+	std::atomic<int64_t> m_overflow;
+};
+
+class LabeledCounter : public LabeledMetric {
+public:
+	LabeledCounter(const char *pszName, const char *pszHelp, const MetricLabels& labels) : LabeledMetric(pszName, pszHelp, "counter", labels) {}
+
+	void inc(int64_t key, int64_t n = 1) { slot(key).fetch_add(n, std::memory_order_relaxed); }
+};
+
+class LabeledGauge : public LabeledMetric {
+public:
+	LabeledGauge(const char *pszName, const char *pszHelp, const MetricLabels& labels) : LabeledMetric(pszName, pszHelp, "gauge", labels) {}
+
+	void set(int64_t key, int64_t value) { slot(key).store(value, std::memory_order_relaxed); }
+	void add(int64_t key, int64_t delta) { slot(key).fetch_add(delta, std::memory_order_relaxed); }
+};
+
+void WriteMetrics(std::string& out);
+
+// Serves WriteMetrics at http://127.0.0.1:<port>/metrics from a thread of its own.
+bool StartMetricsServer(int nPort);
+// Prints a one-line summary every nSeconds from a thread of its own.
+void StartMetricsStatus(int nSeconds);
+
+// The client's metrics. Keys of the labeled ones are the enums below, error codes and
+// expiry dates.
+enum ApiCall {
+	AC_REQCONTRACTDETAILS,
+	AC_REQMKTDATASNAPSHOT,
+	AC_REQFUNDAMENTALDATA,
+	AC_REQMKTDATA,
+	AC_CANCELMKTDATA,
+	AC_CANCELFUNDAMENTALDATA,
+	AC_COUNT
+};
+
+enum ApiCallback {
+	CB_TICKPRICE,
+	CB_TICKSIZE,
+	CB_TICKOPTIONCOMPUTATION,
+	CB_TICKGENERIC,
+	CB_TICKSTRING,
+	CB_TICKSNAPSHOTEND,
+	CB_CONTRACTDETAILS,
+	CB_CONTRACTDETAILSEND,
+	CB_FUNDAMENTALDATA,
+	CB_HISTORICALDATA,
+	CB_NEWSARTICLE,
+	CB_ERROR,
+	CB_COUNT
+};
+
+enum MetricWriter {
+	MW_LOG,			// gamelog text files
+	MW_SCAN,		// 结果\<date>.scan
+	MW_HISTORY,		// 历史\history.log
+	MW_ARCHIVE,		// 归档\*.arc
+	MW_COUNT
+};
+
+namespace metrics {
+	extern LabeledCounter RequestsSent;		// by ApiCall
+	extern LabeledCounter RequestsSkipped;	// by ApiCall, answered by the negative cache
+	extern LabeledCounter RequestsTimedOut;	// by ApiCall, sends past their deadline
+	extern LabeledCounter RequestsRetried;	// by ApiCall, sent again after a timeout
+	extern LabeledCounter Responses;		// by ApiCallback
+	extern LabeledCounter Errors;			// by error code
+	extern LabeledCounter BytesWritten;		// by MetricWriter
+	extern Gauge MarketDataLines;			// streaming subscriptions plus pending snapshots
+	extern Gauge WorkerQueueDepth;			// tasks waiting in every WorkerPool
+	extern Gauge LogQueueDepth;				// messages waiting for the log thread
+	extern LabeledGauge ScanSymbols;		// by expiry, symbols in the expiry's chain file
+	extern LabeledGauge ScanRequested;		// by expiry, underlyings requested so far
+	extern LabeledCounter ScanResults;		// by expiry, yields written
+	extern Histogram ReportBytes;			// fundamentalData payload sizes
+}
+
+#endif
@@ -0,0 +1,195 @@
+﻿#include "StdAfx.h"
+
+#include "NegativeCache.h"
+#include "SymbolTable.h"
+#include "Metrics.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <vector>
+
+namespace {
+
+const char *const NEGATIVE_CACHE_FILE = "C:\\bighouse\\波动率探索器\\negative.dat";
+
+}
+
+NegativeCache& NegativeCache::instance()
+{
+	static NegativeCache cache;
+	return cache;
+}
+
+NegativeCache::NegativeCache()
+	: m_bLoaded(false)
+{
+}
+
+int NegativeCache::ttlDays(NegativeReason reason)
+{
+	switch (reason) {
+		case NR_NO_OPTIONS: return 7;
+		case NR_NO_DEFINITION: return 14;
+		case NR_NO_PERMISSION: return 1;
+		case NR_NO_FUNDAMENTALS: return 30;
+		default: return 0;
+	}
+}
+
+bool NegativeCache::makeKey(const Contract& contract, Key& key, bool bIntern)
+{
+	if (contract.symbol.empty())
+		return false;
+	key.symbolId = bIntern ? SymbolTable::instance().intern(contract.symbol) : SymbolTable::instance().find(contract.symbol);
+	if (key.symbolId == INVALID_SYMBOL)
+		return false;
+	key.expiry = (uint32_t)atoi(contract.lastTradeDateOrContractMonth.c_str());
+	key.strike = contract.strike > 0 && contract.strike < 4.0e7 ? (uint32_t)llround(contract.strike * 100) : 0;
+	return true;
+}
+
+// e.g. no definition for a stock's quote says nothing about its option chains
+uint32_t NegativeCache::blockedKinds(NegativeReason reason, RequestKind kind)
+{
+	if (reason == NR_NO_PERMISSION)
+		return (1u << RK_MKTDATA) | (1u << RK_SNAPSHOT);
+	return 1u << kind;
+}
+
+bool NegativeCache::blockedLocked(const Key& key, RequestKind kind, time_t now) const
+{
+	auto it = m_entries.find(key);
+	if (it == m_entries.end() || now - it->second.timestamp >= ttlDays(it->second.reason) * 86400LL)
+		return false;
+	return (it->second.kinds & (1u << kind)) != 0;
+}
+
+bool NegativeCache::skip(RequestKind kind, const Contract& contract, time_t now)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_bLoaded)
+		loadLocked();
+	// only symbols the cache has seen are interned by now
+	Key key;
+	if (m_entries.empty() || !makeKey(contract, key, false))
+		return false;
+	Key symbolKey = { key.symbolId, 0, 0 };
+	Key expiryKey = { key.symbolId, key.expiry, 0 };
+	return blockedLocked(symbolKey, kind, now)
+		|| (key.expiry != 0 && blockedLocked(expiryKey, kind, now))
+		|| (key.strike != 0 && blockedLocked(key, kind, now));
+}
+
+void NegativeCache::record(const Contract& contract, NegativeReason reason, RequestKind kind, time_t now)
+{
+	Key key;
+	if (!makeKey(contract, key, true))
+		return;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_bLoaded)
+		loadLocked();
+	auto it = m_entries.find(key);
+	// the same failure of another kind adds to the entry, a different one replaces it
+	uint32_t nKinds = blockedKinds(reason, kind);
+	if (it != m_entries.end() && it->second.reason == reason && now - it->second.timestamp < ttlDays(reason) * 86400LL)
+		nKinds |= it->second.kinds;
+	Entry& entry = m_entries[key];
+	entry.reason = reason;
+	entry.kinds = nKinds;
+	entry.timestamp = now;
+}
+
+void NegativeCache::recordError(RequestKind kind, const Contract& contract, int errorCode)
+{
+	switch (errorCode) {
+		case 200:
+			record(contract, NR_NO_DEFINITION, kind);
+			break;
+		case 354:
+			if (kind == RK_MKTDATA || kind == RK_SNAPSHOT)
+				record(contract, NR_NO_PERMISSION, kind);
+			break;
+		case 430:
+			if (kind == RK_FUNDAMENTALS)
+				record(contract, NR_NO_FUNDAMENTALS, kind);
+			break;
+	}
+}
+
+void NegativeCache::loadLocked()
+{
+	m_bLoaded = true;
+	FILE *pFile = NULL;
+	if (fopen_s(&pFile, NEGATIVE_CACHE_FILE, "rb") != 0 || pFile == NULL)
+		return;
+	NegativeCacheHeader header;
+	if (fread(&header, sizeof(header), 1, pFile) != 1 || header.magic != NEGATIVE_CACHE_MAGIC || header.version != NEGATIVE_CACHE_VERSION) {
+		printf("%s is not a version %u negative cache, ignored\n", NEGATIVE_CACHE_FILE, NEGATIVE_CACHE_VERSION);
+		fclose(pFile);
+		return;
+	}
+	time_t now = time(NULL);
+	NegativeCacheRecord record;
+	for (uint32_t i = 0; i < header.count && fread(&record, sizeof(record), 1, pFile) == 1; i++) {
+		// without kinds it isn't known what failed, it is learned again
+		if (memchr(record.symbol, 0, sizeof(record.symbol)) == NULL || record.reason >= NR_COUNT || record.kinds == 0)
+			continue;
+		if (now - record.timestamp >= ttlDays((NegativeReason)record.reason) * 86400LL)
+			continue;
+		Key key = { SymbolTable::instance().intern(record.symbol), record.expiry, record.strike };
+		Entry entry = { (NegativeReason)record.reason, record.kinds, record.timestamp };
+		m_entries[key] = entry;
+	}
+	fclose(pFile);
+}
+
+bool NegativeCache::save()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_bLoaded)
+		return true;
+	time_t now = time(NULL);
+	std::vector<NegativeCacheRecord> records;
+	records.reserve(m_entries.size());
+	for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+		if (now - it->second.timestamp >= ttlDays(it->second.reason) * 86400LL)
+			continue;
+		const std::string& name = SymbolTable::instance().name(it->first.symbolId);
+		if (name.empty() || name.size() >= sizeof(NegativeCacheRecord::symbol))
+			continue;
+		NegativeCacheRecord record;
+		memset(&record, 0, sizeof(record));
+		memcpy(record.symbol, name.c_str(), name.size());
+		record.expiry = it->first.expiry;
+		record.strike = it->first.strike;
+		record.reason = it->second.reason;
+		record.kinds = it->second.kinds;
+		record.timestamp = it->second.timestamp;
+		records.push_back(record);
+	}
+
+	NegativeCacheHeader header;
+	header.magic = NEGATIVE_CACHE_MAGIC;
+	header.version = NEGATIVE_CACHE_VERSION;
+	header.count = (uint32_t)records.size();
+	header.reserved = 0;
+	char pszTempName[MAX_PATH];
+	sprintf_s(pszTempName, MAX_PATH, "%s.tmp", NEGATIVE_CACHE_FILE);
+	HANDLE hFile = CreateFile(pszTempName, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	DWORD dwWrite;
+	bool bOk = WriteFile(hFile, &header, sizeof(header), &dwWrite, 0) != 0
+		&& (records.empty() || WriteFile(hFile, &records[0], (DWORD)(records.size() * sizeof(NegativeCacheRecord)), &dwWrite, 0) != 0)
+		&& FlushFileBuffers(hFile) != 0;
+	CloseHandle(hFile);
+	if (!bOk || MoveFileEx(pszTempName, NEGATIVE_CACHE_FILE, MOVEFILE_REPLACE_EXISTING) == 0) {
+		printf("Can't write %s\n", NEGATIVE_CACHE_FILE);
+		DeleteFile(pszTempName);
+		return false;
+	}
+	printf("Negative cache: %lu entries, %llu requests skipped this run\n", (unsigned long)records.size(),
+		(unsigned long long)metrics::RequestsSkipped.total());
+	return true;
+}
@@ -0,0 +1,91 @@
+﻿#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_NEGATIVECACHE_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_NEGATIVECACHE_H
+
+#include "RequestRegistry.h"
+
+#include <stdint.h>
+#include <time.h>
+
+#include <mutex>
+#include <unordered_map>
+
+// Why a request for a contract is known to come back empty. Each reason expires after
+// its own number of days, then the contract is asked about again. An entry only blocks
+// the request kind that failed, market data and snapshots share their permission.
+enum NegativeReason {
+	NR_NO_OPTIONS,			// contract details of the expiry had no puts, 7 days
+	NR_NO_DEFINITION,		// error 200, no security definition, 14 days
+	NR_NO_PERMISSION,		// error 354, no market data subscription, market data only, 1 day
+	NR_NO_FUNDAMENTALS,		// error 430, no fundamentals for the security, fundamentals only, 30 days
+	NR_COUNT
+};
+
+// 波动率探索器\negative.dat: NegativeCacheHeader then NegativeCacheRecord[count]
+const uint32_t NEGATIVE_CACHE_MAGIC = 0x4347454e;	// "NEGC"
+const uint32_t NEGATIVE_CACHE_VERSION = 1;
+
+struct NegativeCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t reserved;
+};
+
+struct NegativeCacheRecord {
+	char symbol[16];
+	uint32_t expiry;		// YYYYMMDD, 0 for the symbol itself
+	uint32_t strike;		// in cents, 0 for the whole expiry
+	uint32_t reason;
+	uint32_t kinds;			// bit per RequestKind blocked, 0 in files written before it
+	int64_t timestamp;		// time() of the failure
+};
+
+// Symbols, expiries and strikes whose requests are known to fail, consulted by the
+// crawler request calls before they spend pacing budget. An entry for the symbol covers
+// every expiry, one for an expiry every strike of it.
+class NegativeCache {
+public:
+	static NegativeCache& instance();
+	static int ttlDays(NegativeReason reason);
+
+	// true when the request should not be sent
+	bool skip(RequestKind kind, const Contract& contract, time_t now = time(NULL));
+	void record(const Contract& contract, NegativeReason reason, RequestKind kind, time_t now = time(NULL));
+	// records the error codes that mean the contract has nothing to give, ignores the rest
+	void recordError(RequestKind kind, const Contract& contract, int errorCode);
+	// drops expired entries
+	bool save();
+
+private:
+	struct Key {
+		uint32_t symbolId;
+		uint32_t expiry;
+		uint32_t strike;
+
+		bool operator==(const Key& other) const { return symbolId == other.symbolId && expiry == other.expiry && strike == other.strike; }
+	};
+
+	struct KeyHash {
+		size_t operator()(const Key& key) const { return (((uint64_t)key.symbolId << 32) | key.expiry) * 31 + key.strike; }
+	};
+
+	struct Entry {
+		NegativeReason reason;
+		uint32_t kinds;
+		int64_t timestamp;
+	};
+
+	NegativeCache();
+	static bool makeKey(const Contract& contract, Key& key, bool bIntern);
+	static uint32_t blockedKinds(NegativeReason reason, RequestKind kind);
+	void loadLocked();
+	// a live entry for the key that applies to kind
+	bool blockedLocked(const Key& key, RequestKind kind, time_t now) const;
+
+	std::mutex m_mutex;
+	bool m_bLoaded;
+	std::unordered_map<Key, Entry, KeyHash> m_entries;
+};
+
+#endif
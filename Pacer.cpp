@@ -0,0 +1,35 @@
+#include "StdAfx.h"
+
+#include "Pacer.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <thread>
+
+Pacer::Pacer(double ratePerSecond, int burst)
+	: m_rate(ratePerSecond)
+	, m_burst(burst)
+	, m_tokens(burst)
+	, m_last(std::chrono::steady_clock::now())
+{
+}
+
+void Pacer::acquire()
+{
+	std::chrono::duration<double> wait(0);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		std::chrono::duration<double> elapsed = now - m_last;
+		m_last = now;
+		m_tokens = (std::min)(m_burst, m_tokens + elapsed.count() * m_rate);
+		// take the token now even if it is not there yet, the deficit is our place in line
+		m_tokens -= 1;
+		if (m_tokens < 0)
+			wait = std::chrono::duration<double>(-m_tokens / m_rate);
+	}
+	if (wait.count() > 0) {
+		TraceSpan span("pacer wait", "pacing");
+		std::this_thread::sleep_for(wait);
+	}
+}
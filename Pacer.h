@@ -0,0 +1,25 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_PACER_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_PACER_H
+
+#include <chrono>
+#include <mutex>
+
+// Token bucket shared by every thread that sends requests, so concurrent jobs together
+// stay under the API message rate instead of each pacing itself.
+class Pacer {
+public:
+	Pacer(double ratePerSecond, int burst);
+
+	// blocks until the caller may send one message
+	void acquire();
+
+private:
+	std::mutex m_mutex;
+	double m_rate;
+	double m_burst;
+	double m_tokens;
+	std::chrono::steady_clock::time_point m_last;
+};
+
+#endif
@@ -0,0 +1,79 @@
+﻿#include "StdAfx.h"
+
+#include "RateMath.h"
+
+#include <math.h>
+#include <stdio.h>
+
+time_t convert(int year, int month, int day)
+{
+	tm info = {};
+	info.tm_year = year - 1900;
+	info.tm_mon = month - 1;
+	info.tm_mday = day;
+	return mktime(&info);
+
+}
+int  get_days(const char* from, const char* to)
+{
+	int year, month, day;
+	sscanf(from, "%4d%2d%2d", &year, &month, &day);
+	int fromSecond = (int)convert(year, month, day);
+	sscanf(to, "%4d%2d%2d", &year, &month, &day);
+	int toSecond = (int)convert(year, month, day);
+	return (toSecond - fromSecond) / 24 / 3600;
+}
+
+double StrikeTarget(double price)
+{
+	double ppp = price *0.9;
+	double target = price;
+	//股价大于1000，起跳价50 
+	//股价大于500,起跳价20
+	//股价大于200到500,起跳价10
+	//股价大于80小于200，起跳价5
+	//股价大于50小于80，起跳价2.5
+	//股价大于20小于50，起跳价1
+	//股价大于0小于20，起跳价0.5
+	static const double fpa[7] = { 1000,500,200,80,50,20,0 };
+	static const double fbb[7] = { 50,20,10,5,2.5,1,0.5 };
+	for (int k = 0; k < 7; k++)
+	{
+		if (ppp >= fpa[k])
+		{
+			double fVlaue = fmod(ppp, fbb[k]);
+			double ftemp = ppp - fVlaue;
+			if (ppp > ftemp + fbb[k] / 2)
+			{
+				ftemp += fbb[k];
+			}
+			target = ftemp;
+			break;
+
+		}
+	}
+	return target;
+}
+
+double PickStrike(const double *strikes, int nCount, double target)
+{
+	//从列表中得出估算出最优的行权价
+	for (int k = 0; k < nCount; k++)
+	{
+		if (target <= strikes[k])
+			return strikes[k];
+	}
+	return 0;
+}
+
+double PutYield(double strike, double premium, int days)
+{
+	double fddd = strike - premium;
+	double fRa = premium / fddd;
+	return fRa * 365 / days * 100;
+}
+
+int FormatRateLine(char *pszBuffer, size_t nSize, const char *pszSymbol, double strike, double yield)
+{
+	return sprintf_s(pszBuffer, nSize, "%s,%g,%0.2f\n", pszSymbol, strike, yield);
+}
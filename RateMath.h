@@ -0,0 +1,24 @@
+﻿#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_RATEMATH_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_RATEMATH_H
+
+#include <stddef.h>
+#include <time.h>
+
+// The rate scan's arithmetic, kept apart from the client so it can be benchmarked alone.
+
+time_t convert(int year, int month, int day);
+// whole days from one YYYYMMDD date to another
+int  get_days(const char* from, const char* to);
+
+// 90% of the underlying rounded to the strike step of its price band, the put strike the
+// scan aims for
+double StrikeTarget(double price);
+// first strike of an ascending list at or above target, 0 when there is none
+double PickStrike(const double *strikes, int nCount, double target);
+// annualised yield in percent of selling the put for premium, days to expiry
+double PutYield(double strike, double premium, int days);
+// one "symbol,strike,yield" line of the 期权利率 text files
+int FormatRateLine(char *pszBuffer, size_t nSize, const char *pszSymbol, double strike, double yield);
+
+#endif
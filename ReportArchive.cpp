@@ -0,0 +1,468 @@
+﻿#include "StdAfx.h"
+
+#include "ReportArchive.h"
+#include "Metrics.h"
+
+#include <algorithm>
+
+#ifdef REPORT_ARCHIVE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+namespace {
+
+const uint32_t MAX_REPORT_SIZE = 64 * 1024 * 1024;
+
+bool SymbolLess(const ArchiveIndexEntry& a, const ArchiveIndexEntry& b)
+{
+	return strncmp(a.symbol, b.symbol, sizeof(a.symbol)) < 0;
+}
+
+void CopySymbol(char *pDest, const char *pszSymbol)
+{
+	memset(pDest, 0, 16);
+	size_t nLength = strlen(pszSymbol);
+	memcpy(pDest, pszSymbol, nLength < 15 ? nLength : 15);
+}
+
+// AC_LZ: sequences of a token holding the literal count and the match length - 4 in
+// 4 bits each, 15 continued in bytes that add up to 255 each, then the literals and a
+// 2-byte offset back to the match. The last sequence is literals only.
+const size_t LZ_MIN_MATCH = 4;
+const size_t LZ_MAX_OFFSET = 65535;
+// a match stops this far before the end, so the match search never reads past it
+const size_t LZ_LAST_LITERALS = 5;
+const int LZ_HASH_BITS = 14;
+
+uint32_t LzHash(const char *p)
+{
+	uint32_t nValue;
+	memcpy(&nValue, p, sizeof(nValue));
+	return (nValue * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+void LzPutLength(std::vector<char>& out, size_t nLength)
+{
+	for (; nLength >= 255; nLength -= 255)
+		out.push_back((char)255);
+	out.push_back((char)nLength);
+}
+
+void LzPutLiterals(std::vector<char>& out, const char *pLiterals, size_t nLiterals, size_t nMatchCode)
+{
+	out.push_back((char)(((nLiterals < 15 ? nLiterals : 15) << 4) | (nMatchCode < 15 ? nMatchCode : 15)));
+	if (nLiterals >= 15)
+		LzPutLength(out, nLiterals - 15);
+	out.insert(out.end(), pLiterals, pLiterals + nLiterals);
+}
+
+void LzCompress(std::string_view data, std::vector<char>& out)
+{
+	out.clear();
+	std::vector<int32_t> table((size_t)1 << LZ_HASH_BITS, -1);
+	const char *p = data.data();
+	size_t nSize = data.size();
+	size_t nAnchor = 0;
+	size_t i = 0;
+	while (i + LZ_MIN_MATCH + LZ_LAST_LITERALS <= nSize) {
+		uint32_t nHash = LzHash(p + i);
+		int32_t nCandidate = table[nHash];
+		table[nHash] = (int32_t)i;
+		if (nCandidate < 0 || i - nCandidate > LZ_MAX_OFFSET || memcmp(p + nCandidate, p + i, LZ_MIN_MATCH) != 0) {
+			i++;
+			continue;
+		}
+		size_t nMatch = LZ_MIN_MATCH;
+		while (i + nMatch < nSize - LZ_LAST_LITERALS && p[nCandidate + nMatch] == p[i + nMatch])
+			nMatch++;
+		size_t nMatchCode = nMatch - LZ_MIN_MATCH;
+		LzPutLiterals(out, p + nAnchor, i - nAnchor, nMatchCode);
+		size_t nOffset = i - nCandidate;
+		out.push_back((char)(nOffset & 0xff));
+		out.push_back((char)(nOffset >> 8));
+		if (nMatchCode >= 15)
+			LzPutLength(out, nMatchCode - 15);
+		i += nMatch;
+		nAnchor = i;
+	}
+	LzPutLiterals(out, p + nAnchor, nSize - nAnchor, 0);
+}
+
+// false on anything that isn't exactly nSize bytes of output
+bool LzDecompress(const char *pIn, size_t nIn, char *pOut, size_t nSize)
+{
+	const uint8_t *pSrc = (const uint8_t *)pIn;
+	const uint8_t *pEnd = pSrc + nIn;
+	size_t nOut = 0;
+	while (pSrc < pEnd) {
+		unsigned nToken = *pSrc++;
+		size_t nLiterals = nToken >> 4;
+		if (nLiterals == 15) {
+			unsigned nByte;
+			do {
+				if (pSrc == pEnd)
+					return false;
+				nByte = *pSrc++;
+				nLiterals += nByte;
+			} while (nByte == 255);
+		}
+		if ((size_t)(pEnd - pSrc) < nLiterals || nSize - nOut < nLiterals)
+			return false;
+		memcpy(pOut + nOut, pSrc, nLiterals);
+		pSrc += nLiterals;
+		nOut += nLiterals;
+		if (pSrc == pEnd)
+			break;
+		if (pEnd - pSrc < 2)
+			return false;
+		size_t nOffset = pSrc[0] | ((size_t)pSrc[1] << 8);
+		pSrc += 2;
+		size_t nMatch = nToken & 15;
+		if (nMatch == 15) {
+			unsigned nByte;
+			do {
+				if (pSrc == pEnd)
+					return false;
+				nByte = *pSrc++;
+				nMatch += nByte;
+			} while (nByte == 255);
+		}
+		nMatch += LZ_MIN_MATCH;
+		if (nOffset == 0 || nOffset > nOut || nSize - nOut < nMatch)
+			return false;
+		// byte by byte, a match may overlap what it copies
+		for (size_t k = 0; k < nMatch; k++, nOut++)
+			pOut[nOut] = pOut[nOut - nOffset];
+	}
+	return nOut == nSize;
+}
+
+}
+
+void ReportArchiveFileName(const char *pszReport, int nDate, char *pszFileName, size_t nSize)
+{
+	sprintf_s(pszFileName, nSize, "C:\\bighouse\\美股财务数据\\归档\\%s_%08d.arc", pszReport, nDate);
+}
+
+ReportArchiveWriter::ReportArchiveWriter()
+	: m_hFile(INVALID_HANDLE_VALUE)
+	, m_nOffset(0)
+	, m_nDictionaryOffset(0)
+	, m_bTrained(false)
+	, m_pCCtx(NULL)
+	, m_pCDict(NULL)
+{
+}
+
+ReportArchiveWriter::~ReportArchiveWriter()
+{
+	close();
+}
+
+bool ReportArchiveWriter::open(const char *pszFileName)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	closeLocked();
+	CreateDirectory("C:\\bighouse\\美股财务数据\\归档", NULL);
+	m_fileName = pszFileName;
+	std::string tempName = m_fileName + ".tmp";
+	m_hFile = CreateFile(tempName.c_str(), GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (m_hFile == INVALID_HANDLE_VALUE) {
+		printf("Can't create %s\n", tempName.c_str());
+		return false;
+	}
+	m_nOffset = 0;
+	m_nDictionaryOffset = 0;
+#ifdef REPORT_ARCHIVE_ZSTD
+	m_bTrained = false;
+	m_pCCtx = ZSTD_createCCtx();
+#else
+	m_bTrained = true;
+#endif
+	ArchiveFileHeader header = { ARCHIVE_FILE_MAGIC, ARCHIVE_FILE_VERSION };
+	return writeLocked(&header, sizeof(header));
+}
+
+bool ReportArchiveWriter::isOpen()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_hFile != INVALID_HANDLE_VALUE;
+}
+
+bool ReportArchiveWriter::writeLocked(const void *pData, size_t nSize)
+{
+	DWORD dwWrite;
+	if (WriteFile(m_hFile, pData, (DWORD)nSize, &dwWrite, 0) == 0 || dwWrite != nSize)
+		return false;
+	m_nOffset += nSize;
+	metrics::BytesWritten.inc(MW_ARCHIVE, nSize);
+	return true;
+}
+
+bool ReportArchiveWriter::writeBlockLocked(const char *pszSymbol, ArchiveBlockType type, std::string_view data)
+{
+	ArchiveBlockHeader header;
+	CopySymbol(header.symbol, pszSymbol);
+	header.type = (uint8_t)type;
+	header.codec = AC_STORED;
+	header.reserved = 0;
+	header.rawSize = (uint32_t)data.size();
+	const char *pStored = data.data();
+	size_t nStored = data.size();
+#ifdef REPORT_ARCHIVE_ZSTD
+	if (type == AB_REPORT) {
+		m_buffer.resize(ZSTD_compressBound(data.size()));
+		size_t nResult = m_pCDict != NULL
+			? ZSTD_compress_usingCDict((ZSTD_CCtx *)m_pCCtx, &m_buffer[0], m_buffer.size(), data.data(), data.size(), (ZSTD_CDict *)m_pCDict)
+			: ZSTD_compressCCtx((ZSTD_CCtx *)m_pCCtx, &m_buffer[0], m_buffer.size(), data.data(), data.size(), LEVEL);
+		if (!ZSTD_isError(nResult) && nResult < data.size()) {
+			header.codec = m_pCDict != NULL ? AC_ZSTD_DICT : AC_ZSTD;
+			pStored = &m_buffer[0];
+			nStored = nResult;
+		}
+	}
+#else
+	if (type == AB_REPORT) {
+		LzCompress(data, m_buffer);
+		if (m_buffer.size() < data.size()) {
+			header.codec = AC_LZ;
+			pStored = &m_buffer[0];
+			nStored = m_buffer.size();
+		}
+	}
+#endif
+	header.storedSize = (uint32_t)nStored;
+
+	uint64_t nBlockOffset = m_nOffset;
+	if (!writeLocked(&header, sizeof(header)) || !writeLocked(pStored, nStored)) {
+		printf("Can't write to %s.tmp\n", m_fileName.c_str());
+		return false;
+	}
+	if (type == AB_DICTIONARY)
+		m_nDictionaryOffset = nBlockOffset;
+	else {
+		ArchiveIndexEntry entry;
+		memcpy(entry.symbol, header.symbol, sizeof(entry.symbol));
+		entry.offset = nBlockOffset;
+		m_index.push_back(entry);
+	}
+	return true;
+}
+
+// The reports of one kind share most of their markup, which a dictionary trained on the
+// first few hundred captures. With too few of them to train on, or if training fails,
+// the reports are compressed on their own.
+void ReportArchiveWriter::trainLocked()
+{
+	m_bTrained = true;
+#ifdef REPORT_ARCHIVE_ZSTD
+	if (m_pending.size() >= 16) {
+		std::string samples;
+		std::vector<size_t> sizes;
+		for (size_t i = 0; i < m_pending.size(); i++) {
+			samples += m_pending[i].report;
+			sizes.push_back(m_pending[i].report.size());
+		}
+		std::vector<char> dictionary(DICTIONARY_SIZE);
+		size_t nSize = ZDICT_trainFromBuffer(&dictionary[0], dictionary.size(), samples.data(), &sizes[0], (unsigned)sizes.size());
+		if (!ZDICT_isError(nSize) && writeBlockLocked("", AB_DICTIONARY, std::string_view(&dictionary[0], nSize)))
+			m_pCDict = ZSTD_createCDict(&dictionary[0], nSize, LEVEL);
+	}
+#endif
+	for (size_t i = 0; i < m_pending.size(); i++)
+		writeBlockLocked(m_pending[i].symbol.c_str(), AB_REPORT, m_pending[i].report);
+	m_pending.clear();
+}
+
+bool ReportArchiveWriter::add(const char *pszSymbol, std::string_view report)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_hFile == INVALID_HANDLE_VALUE || report.size() > MAX_REPORT_SIZE)
+		return false;
+	if (!m_bTrained) {
+		Pending pending;
+		pending.symbol = pszSymbol;
+		pending.report.assign(report.data(), report.size());
+		m_pending.push_back(std::move(pending));
+		if (m_pending.size() >= TRAIN_REPORTS)
+			trainLocked();
+		return true;
+	}
+	return writeBlockLocked(pszSymbol, AB_REPORT, report);
+}
+
+bool ReportArchiveWriter::close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return closeLocked();
+}
+
+bool ReportArchiveWriter::closeLocked()
+{
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return true;
+	if (!m_bTrained)
+		trainLocked();
+
+	std::stable_sort(m_index.begin(), m_index.end(), SymbolLess);
+	size_t nOut = 0;
+	for (size_t i = 0; i < m_index.size(); i++) {
+		if (nOut > 0 && strncmp(m_index[nOut - 1].symbol, m_index[i].symbol, sizeof(m_index[i].symbol)) == 0)
+			m_index[nOut - 1] = m_index[i];
+		else
+			m_index[nOut++] = m_index[i];
+	}
+	m_index.resize(nOut);
+
+	// the index is read in place, so it starts 8-byte aligned
+	static const char PADDING[8] = { 0 };
+	bool bOk = writeLocked(PADDING, (size_t)((8 - m_nOffset % 8) % 8));
+	ArchiveFooter footer;
+	footer.indexOffset = m_nOffset;
+	footer.dictionaryOffset = m_nDictionaryOffset;
+	footer.count = (uint32_t)m_index.size();
+	footer.magic = ARCHIVE_FOOTER_MAGIC;
+	bOk = bOk && (m_index.empty() || writeLocked(&m_index[0], m_index.size() * sizeof(ArchiveIndexEntry)))
+		&& writeLocked(&footer, sizeof(footer)) && FlushFileBuffers(m_hFile) != 0;
+	CloseHandle(m_hFile);
+	m_hFile = INVALID_HANDLE_VALUE;
+
+	std::string tempName = m_fileName + ".tmp";
+	if (!bOk || MoveFileEx(tempName.c_str(), m_fileName.c_str(), MOVEFILE_REPLACE_EXISTING) == 0) {
+		printf("Can't write %s\n", m_fileName.c_str());
+		DeleteFile(tempName.c_str());
+		bOk = false;
+	}
+	else
+		printf("%s: %u reports, %llu bytes\n", m_fileName.c_str(), footer.count, (unsigned long long)m_nOffset);
+#ifdef REPORT_ARCHIVE_ZSTD
+	ZSTD_freeCDict((ZSTD_CDict *)m_pCDict);
+	ZSTD_freeCCtx((ZSTD_CCtx *)m_pCCtx);
+#endif
+	m_pCDict = NULL;
+	m_pCCtx = NULL;
+	m_index.clear();
+	m_pending.clear();
+	std::vector<char>().swap(m_buffer);
+	return bOk;
+}
+
+ReportArchiveReader::ReportArchiveReader()
+	: m_pIndex(NULL)
+	, m_nCount(0)
+	, m_pDCtx(NULL)
+	, m_pDDict(NULL)
+{
+}
+
+ReportArchiveReader::~ReportArchiveReader()
+{
+	reset();
+}
+
+void ReportArchiveReader::reset()
+{
+#ifdef REPORT_ARCHIVE_ZSTD
+	ZSTD_freeDDict((ZSTD_DDict *)m_pDDict);
+	ZSTD_freeDCtx((ZSTD_DCtx *)m_pDCtx);
+#endif
+	m_pDDict = NULL;
+	m_pDCtx = NULL;
+	m_pIndex = NULL;
+	m_nCount = 0;
+	m_file.close();
+}
+
+bool ReportArchiveReader::open(const char *pszFileName)
+{
+	reset();
+	if (!m_file.open(pszFileName))
+		return false;
+	ArchiveFileHeader header;
+	ArchiveFooter footer;
+	size_t nSize = m_file.size();
+	if (nSize >= sizeof(header) + sizeof(footer)) {
+		memcpy(&header, m_file.data(), sizeof(header));
+		memcpy(&footer, m_file.data() + nSize - sizeof(footer), sizeof(footer));
+	}
+	if (nSize < sizeof(header) + sizeof(footer) || header.magic != ARCHIVE_FILE_MAGIC || header.version != ARCHIVE_FILE_VERSION
+		|| footer.magic != ARCHIVE_FOOTER_MAGIC || footer.indexOffset % 8 != 0
+		|| footer.indexOffset + (uint64_t)footer.count * sizeof(ArchiveIndexEntry) != nSize - sizeof(footer)) {
+		printf("%s is not a version %u report archive\n", pszFileName, ARCHIVE_FILE_VERSION);
+		m_file.close();
+		return false;
+	}
+	m_pIndex = (const ArchiveIndexEntry *)(m_file.data() + footer.indexOffset);
+	m_nCount = footer.count;
+
+#ifdef REPORT_ARCHIVE_ZSTD
+	m_pDCtx = ZSTD_createDCtx();
+	if (footer.dictionaryOffset != 0 && footer.dictionaryOffset + sizeof(ArchiveBlockHeader) <= footer.indexOffset) {
+		ArchiveBlockHeader block;
+		memcpy(&block, m_file.data() + footer.dictionaryOffset, sizeof(block));
+		if (block.type == AB_DICTIONARY && footer.dictionaryOffset + sizeof(block) + block.storedSize <= footer.indexOffset)
+			m_pDDict = ZSTD_createDDict(m_file.data() + footer.dictionaryOffset + sizeof(block), block.storedSize);
+	}
+#endif
+	return true;
+}
+
+const char *ReportArchiveReader::symbol(uint32_t i) const
+{
+	return i < m_nCount ? m_pIndex[i].symbol : "";
+}
+
+bool ReportArchiveReader::read(uint32_t i, std::string& report)
+{
+	if (i >= m_nCount)
+		return false;
+	uint64_t nOffset = m_pIndex[i].offset;
+	ArchiveBlockHeader block;
+	uint64_t nIndexOffset = (const char *)m_pIndex - m_file.data();
+	if (nOffset + sizeof(block) > nIndexOffset)
+		return false;
+	memcpy(&block, m_file.data() + nOffset, sizeof(block));
+	const char *pStored = m_file.data() + nOffset + sizeof(block);
+	if (block.type != AB_REPORT || nOffset + sizeof(block) + block.storedSize > nIndexOffset || block.rawSize > MAX_REPORT_SIZE)
+		return false;
+
+	if (block.codec == AC_STORED) {
+		if (block.storedSize != block.rawSize)
+			return false;
+		report.assign(pStored, block.storedSize);
+		return true;
+	}
+	if (block.codec == AC_LZ) {
+		report.resize(block.rawSize);
+		if (LzDecompress(pStored, block.storedSize, &report[0], report.size()))
+			return true;
+		report.clear();
+		return false;
+	}
+#ifdef REPORT_ARCHIVE_ZSTD
+	if (block.codec == AC_ZSTD_DICT && m_pDDict == NULL)
+		return false;
+	report.resize(block.rawSize);
+	size_t nResult = block.codec == AC_ZSTD_DICT
+		? ZSTD_decompress_usingDDict((ZSTD_DCtx *)m_pDCtx, &report[0], report.size(), pStored, block.storedSize, (ZSTD_DDict *)m_pDDict)
+		: ZSTD_decompressDCtx((ZSTD_DCtx *)m_pDCtx, &report[0], report.size(), pStored, block.storedSize);
+	if (!ZSTD_isError(nResult) && nResult == block.rawSize)
+		return true;
+	report.clear();
+#else
+	printf("Report archive built without REPORT_ARCHIVE_ZSTD can't read compressed reports\n");
+#endif
+	return false;
+}
+
+bool ReportArchiveReader::find(const char *pszSymbol, std::string& report)
+{
+	ArchiveIndexEntry key;
+	CopySymbol(key.symbol, pszSymbol);
+	const ArchiveIndexEntry *pEnd = m_pIndex + m_nCount;
+	const ArchiveIndexEntry *pFound = std::lower_bound(m_pIndex, pEnd, key, SymbolLess);
+	if (pFound == pEnd || strncmp(pFound->symbol, key.symbol, sizeof(key.symbol)) != 0)
+		return false;
+	return read((uint32_t)(pFound - m_pIndex), report);
+}
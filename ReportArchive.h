@@ -0,0 +1,128 @@
+﻿#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_REPORTARCHIVE_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_REPORTARCHIVE_H
+
+#include "MappedFile.h"
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One archive per crawl keeps the raw fundamental reports in place of a text file per
+// symbol, 美股财务数据\归档\<report>_<YYYYMMDD>.arc:
+//   ArchiveFileHeader
+//   blocks, each ArchiveBlockHeader then storedSize bytes; at most one dictionary block,
+//   written before the first report compressed with it
+//   ArchiveIndexEntry[count] sorted by symbol, the last report of a symbol wins
+//   ArchiveFooter
+// Reports are compressed with the built-in LZ codec (AC_LZ, LZ4's block layout). Build
+// with REPORT_ARCHIVE_ZSTD defined and libzstd linked to compress them with zstd and a
+// dictionary trained on the first reports of the crawl instead; without it an archive
+// with zstd blocks can't be read. A report that doesn't shrink is stored as it is.
+const uint32_t ARCHIVE_FILE_MAGIC = 0x43524152;		// "RARC"
+const uint32_t ARCHIVE_FOOTER_MAGIC = 0x58444952;	// "RIDX"
+const uint32_t ARCHIVE_FILE_VERSION = 1;
+
+enum ArchiveBlockType { AB_REPORT, AB_DICTIONARY };
+enum ArchiveCodec { AC_STORED, AC_ZSTD, AC_ZSTD_DICT, AC_LZ };
+
+struct ArchiveFileHeader {
+	uint32_t magic;
+	uint32_t version;
+};
+
+struct ArchiveBlockHeader {
+	char symbol[16];
+	uint8_t type;
+	uint8_t codec;
+	uint16_t reserved;
+	uint32_t rawSize;
+	uint32_t storedSize;
+};
+
+struct ArchiveIndexEntry {
+	char symbol[16];
+	uint64_t offset;		// of the ArchiveBlockHeader
+};
+
+struct ArchiveFooter {
+	uint64_t indexOffset;
+	uint64_t dictionaryOffset;	// 0 without a dictionary
+	uint32_t count;
+	uint32_t magic;
+};
+
+void ReportArchiveFileName(const char *pszReport, int nDate, char *pszFileName, size_t nSize);
+
+// Appends reports as they arrive; safe to call from several threads.
+class ReportArchiveWriter {
+public:
+	// reports held back to train the dictionary on
+	static const size_t TRAIN_REPORTS = 200;
+	static const size_t DICTIONARY_SIZE = 112 * 1024;
+	static const int LEVEL = 9;
+
+	ReportArchiveWriter();
+	~ReportArchiveWriter();
+
+	bool open(const char *pszFileName);
+	bool isOpen();
+	bool add(const char *pszSymbol, std::string_view report);
+	// writes what is held back and the index
+	bool close();
+
+private:
+	ReportArchiveWriter(const ReportArchiveWriter&);
+	ReportArchiveWriter& operator=(const ReportArchiveWriter&);
+
+	struct Pending {
+		std::string symbol;
+		std::string report;
+	};
+
+	bool writeLocked(const void *pData, size_t nSize);
+	bool writeBlockLocked(const char *pszSymbol, ArchiveBlockType type, std::string_view data);
+	void trainLocked();
+	bool closeLocked();
+
+	std::mutex m_mutex;
+	HANDLE m_hFile;
+	std::string m_fileName;
+	uint64_t m_nOffset;
+	uint64_t m_nDictionaryOffset;
+	bool m_bTrained;
+	std::vector<Pending> m_pending;
+	std::vector<ArchiveIndexEntry> m_index;
+	std::vector<char> m_buffer;
+	void *m_pCCtx;
+	void *m_pCDict;
+};
+
+class ReportArchiveReader {
+public:
+	ReportArchiveReader();
+	~ReportArchiveReader();
+
+	bool open(const char *pszFileName);
+	uint32_t count() const { return m_nCount; }
+	const char *symbol(uint32_t i) const;
+	bool read(uint32_t i, std::string& report);
+	bool find(const char *pszSymbol, std::string& report);
+
+private:
+	ReportArchiveReader(const ReportArchiveReader&);
+	ReportArchiveReader& operator=(const ReportArchiveReader&);
+
+	void reset();
+
+	MappedFile m_file;
+	const ArchiveIndexEntry *m_pIndex;
+	uint32_t m_nCount;
+	void *m_pDCtx;
+	void *m_pDDict;
+};
+
+#endif
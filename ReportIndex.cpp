@@ -0,0 +1,209 @@
+﻿#include "StdAfx.h"
+
+#include "ReportIndex.h"
+#include "SymbolTable.h"
+#include "XmlScanner.h"
+
+#include <vector>
+
+namespace {
+
+void IndexFileName(FundamentalReport report, char *pszFileName, size_t nSize)
+{
+	sprintf_s(pszFileName, nSize, "C:\\bighouse\\美股财务数据\\索引\\%s.idx", FundamentalReportName(report));
+}
+
+// days since 1970-01-01 of a YYYYMMDD date
+int DayNumber(int nDate)
+{
+	int y = nDate / 10000;
+	int m = nDate / 100 % 100;
+	int d = nDate % 100;
+	y -= m <= 2;
+	int era = (y >= 0 ? y : y - 399) / 400;
+	int yoe = y - era * 400;
+	int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+uint64_t HashReport(std::string_view report)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < report.size(); i++) {
+		hash ^= (unsigned char)report[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// "2022-07-20", "2022-07-20T00:00:00" -> 20220720, else 0
+uint32_t ParseReportDate(std::string_view text)
+{
+	while (!text.empty() && (text.front() == ' ' || text.front() == '\r' || text.front() == '\n' || text.front() == '\t'))
+		text.remove_prefix(1);
+	if (text.size() < 10 || text[4] != '-' || text[7] != '-')
+		return 0;
+	uint32_t nDate = 0;
+	for (int i = 0; i < 10; i++) {
+		if (i == 4 || i == 7)
+			continue;
+		if (text[i] < '0' || text[i] > '9')
+			return 0;
+		nDate = nDate * 10 + (text[i] - '0');
+	}
+	return nDate;
+}
+
+// The newest of the period end dates (FiscalPeriod EndDate), the snapshot's
+// LatestAvailableDate and LastModified.
+class ReportDateScanner : public XmlHandler {
+public:
+	ReportDateScanner() : m_nDate(0), m_bLastModified(false) {}
+
+	void startElement(std::string_view name, const XmlAttributes& attributes)
+	{
+		take(ParseReportDate(attributes.find("EndDate")));
+		take(ParseReportDate(attributes.find("LatestAvailableDate")));
+		m_bLastModified = name == "LastModified";
+	}
+
+	void text(std::string_view text)
+	{
+		if (m_bLastModified)
+			take(ParseReportDate(text));
+		m_bLastModified = false;
+	}
+
+	void endElement(std::string_view name) { m_bLastModified = false; }
+
+	uint32_t date() const { return m_nDate; }
+
+private:
+	void take(uint32_t nDate)
+	{
+		if (nDate > m_nDate)
+			m_nDate = nDate;
+	}
+
+	uint32_t m_nDate;
+	bool m_bLastModified;
+};
+
+}
+
+ReportIndex::ReportIndex(FundamentalReport report)
+	: m_report(report)
+	, m_bAll(false)
+	, m_bLoaded(false)
+{
+}
+
+bool ReportIndex::due(uint32_t symbolId, int nToday)
+{
+	if (m_bAll)
+		return true;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_bLoaded)
+		loadLocked();
+	auto it = m_records.find(symbolId);
+	if (it == m_records.end() || it->second.fetched == 0)
+		return true;
+	const ReportIndexRecord& record = it->second;
+	int nSince = DayNumber(nToday) - DayNumber(record.fetched);
+	int nInterval = record.unchanged < 5 ? 1 << record.unchanged : MAX_INTERVAL;
+	if (nInterval > MAX_INTERVAL)
+		nInterval = MAX_INTERVAL;
+	int nOverdue = DayNumber(nToday) - (DayNumber(record.reportDate) + PERIOD_DAYS);
+	if (record.reportDate != 0 && nOverdue >= 0 && nOverdue < EXPECTED_WINDOW && nInterval > EXPECTED_INTERVAL)
+		nInterval = EXPECTED_INTERVAL;
+	return nSince >= nInterval;
+}
+
+bool ReportIndex::record(uint32_t symbolId, std::string_view report, int nToday)
+{
+	uint64_t hash = HashReport(report);
+	ReportDateScanner scanner;
+	ScanXml(report, scanner);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_bLoaded)
+		loadLocked();
+	ReportIndexRecord& record = m_records[symbolId];
+	bool bChanged = record.fetched == 0 || record.hash != hash;
+	bool bNewer = record.fetched == 0 || (scanner.date() != 0 ? scanner.date() > record.reportDate : bChanged);
+	record.unchanged = bNewer ? 0 : record.unchanged + 1;
+	if (scanner.date() > record.reportDate)
+		record.reportDate = scanner.date();
+	record.hash = hash;
+	record.fetched = (uint32_t)nToday;
+	return bChanged;
+}
+
+void ReportIndex::loadLocked()
+{
+	m_bLoaded = true;
+	char pszFileName[MAX_PATH];
+	IndexFileName(m_report, pszFileName, MAX_PATH);
+	FILE *pFile = NULL;
+	if (fopen_s(&pFile, pszFileName, "rb") != 0 || pFile == NULL)
+		return;
+	ReportIndexHeader header;
+	if (fread(&header, sizeof(header), 1, pFile) != 1 || header.magic != REPORT_INDEX_MAGIC || header.version != REPORT_INDEX_VERSION) {
+		printf("%s is not a version %u report index, ignored\n", pszFileName, REPORT_INDEX_VERSION);
+		fclose(pFile);
+		return;
+	}
+	ReportIndexRecord record;
+	for (uint32_t i = 0; i < header.count && fread(&record, sizeof(record), 1, pFile) == 1; i++) {
+		if (memchr(record.symbol, 0, sizeof(record.symbol)) == NULL)
+			continue;
+		m_records[SymbolTable::instance().intern(record.symbol)] = record;
+	}
+	fclose(pFile);
+}
+
+bool ReportIndex::save()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_bLoaded)
+		return true;
+	std::vector<ReportIndexRecord> records;
+	records.reserve(m_records.size());
+	for (auto it = m_records.begin(); it != m_records.end(); ++it) {
+		const std::string& name = SymbolTable::instance().name(it->first);
+		if (name.empty() || name.size() >= sizeof(it->second.symbol))
+			continue;
+		ReportIndexRecord record = it->second;
+		memset(record.symbol, 0, sizeof(record.symbol));
+		memcpy(record.symbol, name.c_str(), name.size());
+		record.reserved = 0;
+		records.push_back(record);
+	}
+
+	ReportIndexHeader header;
+	header.magic = REPORT_INDEX_MAGIC;
+	header.version = REPORT_INDEX_VERSION;
+	header.count = (uint32_t)records.size();
+	header.reserved = 0;
+	CreateDirectory("C:\\bighouse\\美股财务数据\\索引", NULL);
+	char pszFileName[MAX_PATH];
+	IndexFileName(m_report, pszFileName, MAX_PATH);
+	char pszTempName[MAX_PATH];
+	sprintf_s(pszTempName, MAX_PATH, "%s.tmp", pszFileName);
+	HANDLE hFile = CreateFile(pszTempName, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	DWORD dwWrite;
+	bool bOk = WriteFile(hFile, &header, sizeof(header), &dwWrite, 0) != 0
+		&& (records.empty() || WriteFile(hFile, &records[0], (DWORD)(records.size() * sizeof(ReportIndexRecord)), &dwWrite, 0) != 0)
+		&& FlushFileBuffers(hFile) != 0;
+	CloseHandle(hFile);
+	if (!bOk || MoveFileEx(pszTempName, pszFileName, MOVEFILE_REPLACE_EXISTING) == 0) {
+		printf("Can't write %s\n", pszFileName);
+		DeleteFile(pszTempName);
+		return false;
+	}
+	return true;
+}
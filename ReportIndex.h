@@ -0,0 +1,65 @@
+﻿#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_REPORTINDEX_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_REPORTINDEX_H
+
+#include "FundamentalFields.h"
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+// What the last crawls saw of each symbol's report, 美股财务数据\索引\<report>.idx:
+//   ReportIndexHeader then ReportIndexRecord[count]
+const uint32_t REPORT_INDEX_MAGIC = 0x58495052;	// "RPIX"
+const uint32_t REPORT_INDEX_VERSION = 1;
+
+struct ReportIndexHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t reserved;
+};
+
+struct ReportIndexRecord {
+	char symbol[16];
+	uint64_t hash;			// of the whole reply
+	uint32_t reportDate;	// YYYYMMDD, the latest period or revision date in it, 0 if none
+	uint32_t fetched;		// YYYYMMDD of the last reply
+	uint32_t unchanged;		// replies in a row without a newer reportDate
+	uint32_t reserved;
+};
+
+// Schedules a symbol again after 1, 2, 4 ... MAX_INTERVAL days while its report date
+// stays put, and every EXPECTED_INTERVAL days during the EXPECTED_WINDOW days after a
+// period has passed since that date, when the next report is due; a report later than
+// that goes back to the backoff. The snapshot's prices change every day, so only the
+// report date drives the schedule; the hash only tells whether the reply is worth keeping.
+class ReportIndex {
+public:
+	static const int MAX_INTERVAL = 32;
+	static const int PERIOD_DAYS = 91;
+	static const int EXPECTED_INTERVAL = 2;
+	static const int EXPECTED_WINDOW = 14;
+
+	explicit ReportIndex(FundamentalReport report);
+
+	// all=1 on the job: every symbol is due
+	void setScheduleAll(bool bAll) { m_bAll = bAll; }
+	bool due(uint32_t symbolId, int nToday);
+	// false when the reply is identical to the last one
+	bool record(uint32_t symbolId, std::string_view report, int nToday);
+	bool save();
+
+private:
+	void loadLocked();
+
+	FundamentalReport m_report;
+	bool m_bAll;
+	std::mutex m_mutex;
+	bool m_bLoaded;
+	std::unordered_map<uint32_t, ReportIndexRecord> m_records;
+};
+
+#endif
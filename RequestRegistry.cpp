@@ -0,0 +1,392 @@
+#include "StdAfx.h"
+
+#include "RequestRegistry.h"
+#include "Metrics.h"
+#include "Latency.h"
+#include "Trace.h"
+
+namespace {
+
+ApiCall RequestCall(RequestKind kind)
+{
+	switch (kind) {
+		case RK_CONTRACTDETAILS: return AC_REQCONTRACTDETAILS;
+		case RK_SNAPSHOT: return AC_REQMKTDATASNAPSHOT;
+		case RK_FUNDAMENTALS: return AC_REQFUNDAMENTALDATA;
+		default: return AC_REQMKTDATA;
+	}
+}
+
+const char *RequestName(RequestKind kind)
+{
+	switch (kind) {
+		case RK_CONTRACTDETAILS: return "reqContractDetails";
+		case RK_SNAPSHOT: return "reqMktDataSnapshot";
+		case RK_FUNDAMENTALS: return "reqFundamentalData";
+		default: return "reqMktData";
+	}
+}
+
+// Contract details have no cancel, a late answer to the first send would mix with the
+// retry's, so their deadline is only counted. Quotes normally start within a second and
+// reports within a few, and the crawlers cancel a batch 10s after sending it: a 4s try,
+// the 1s backoff and a second 4s try end at 9s, inside that.
+const RetryPolicy RetryPolicies[] = {
+	{ 30000, 1, 0, 0 },			// RK_CONTRACTDETAILS
+	{ 0, 1, 0, 0 },				// RK_SNAPSHOT, never tracked
+	{ 4000, 2, 1000, 1000 },	// RK_FUNDAMENTALS
+	{ 4000, 2, 1000, 1000 },	// RK_MKTDATA
+};
+
+// the listing exchange when there is one, SMART says nothing about where the time goes
+const std::string& LatencyExchange(const Contract& contract)
+{
+	return contract.primaryExchange.empty() ? contract.exchange : contract.primaryExchange;
+}
+
+}
+
+RequestRegistry::RequestRegistry()
+	: m_nextReqId(REGISTRY_FIRST_REQID)
+	, m_timers((int64_t)RETRY_TICK_MS * 1000, TraceNow())
+{
+}
+
+int RequestRegistry::add(RequestKind kind, const Contract& contract, const std::string& param, RequestDoneFunc onDone)
+{
+	std::unique_ptr<PendingRequest> req(new PendingRequest());
+	req->kind = kind;
+	req->contract = contract;
+	req->param = param;
+	req->quote.bid = req->quote.ask = req->quote.last = req->quote.close = -1;
+	req->errorCode = 0;
+	req->sentMicros = 0;
+	req->live = false;
+	req->onDone = std::move(onDone);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	req->reqId = m_nextReqId++;
+	int reqId = req->reqId;
+	if (kind == RK_SNAPSHOT)
+		metrics::MarketDataLines.add(1);
+	m_pending[reqId] = std::move(req);
+	return reqId;
+}
+
+bool RequestRegistry::onContractDetails(int reqId, const ContractDetails& contractDetails)
+{
+	if (!owns(reqId))
+		return false;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_pending.find(reqId);
+	if (it == m_pending.end())
+		return false;
+	it->second->details.push_back(contractDetails);
+	return true;
+}
+
+bool RequestRegistry::onTickPrice(int reqId, TickType field, double price)
+{
+	if (!owns(reqId))
+		return false;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_pending.find(reqId);
+	if (it == m_pending.end())
+		return false;
+	SnapshotQuote& quote = it->second->quote;
+	if (field == TickType::BID)
+		quote.bid = price;
+	else if (field == TickType::ASK)
+		quote.ask = price;
+	else if (field == TickType::LAST)
+		quote.last = price;
+	else if (field == TickType::CLOSE)
+		quote.close = price;
+	return true;
+}
+
+bool RequestRegistry::onFundamentalData(int reqId, const std::string& data)
+{
+	if (!owns(reqId))
+		return false;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_pending.find(reqId);
+		if (it == m_pending.end())
+			return false;
+		it->second->data = data;
+	}
+	// a fundamentals request has no end marker, the payload itself completes it
+	return finish(reqId);
+}
+
+bool RequestRegistry::onError(int reqId, int errorCode, const std::string& errorString)
+{
+	if (!owns(reqId))
+		return false;
+	if (isWarning(errorCode))
+		return true;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_pending.find(reqId);
+		if (it == m_pending.end())
+			return false;
+		it->second->errorCode = errorCode;
+		it->second->errorString = errorString;
+	}
+	return finish(reqId);
+}
+
+bool RequestRegistry::finish(int reqId)
+{
+	std::unique_ptr<PendingRequest> req = take(reqId);
+	if (!req)
+		return false;
+	// run outside the lock, the completion may resume a coroutine that issues more requests
+	if (req->onDone)
+		req->onDone(*req);
+	return true;
+}
+
+void RequestRegistry::track(int reqId, RequestKind kind, const Contract& contract, const std::string& param)
+{
+	SessionRequest req;
+	req.reqId = reqId;
+	req.kind = kind;
+	req.contract = contract;
+	req.param = param;
+	req.sentMicros = 0;
+	req.timeouts = 0;
+	req.timer = 0;
+	req.live = false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_tracked.find(reqId);
+	if (it != m_tracked.end())
+		disarmLocked(it->second);
+	if (it != m_tracked.end() && it->second.kind == RK_MKTDATA)
+		metrics::MarketDataLines.add(-1);
+	if (kind == RK_MKTDATA)
+		metrics::MarketDataLines.add(1);
+	m_tracked[reqId] = std::move(req);
+}
+
+bool RequestRegistry::untrack(int reqId)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_tracked.find(reqId);
+	if (it == m_tracked.end())
+		return false;
+	if (it->second.kind == RK_MKTDATA)
+		metrics::MarketDataLines.add(-1);
+	// cancelled before the response recordResponse waits for
+	if (it->second.sentMicros != 0)
+		TraceAsync(RequestName(it->second.kind), "unanswered", reqId, it->second.sentMicros, TraceNow());
+	disarmLocked(it->second);
+	m_tracked.erase(it);
+	return true;
+}
+
+bool RequestRegistry::lookup(int reqId, RequestKind& kind, Contract& contract)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto tracked = m_tracked.find(reqId);
+	if (tracked != m_tracked.end()) {
+		kind = tracked->second.kind;
+		contract = tracked->second.contract;
+		return true;
+	}
+	auto pending = m_pending.find(reqId);
+	if (pending == m_pending.end())
+		return false;
+	kind = pending->second->kind;
+	contract = pending->second->contract;
+	return true;
+}
+
+bool RequestRegistry::isTracked(int reqId)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_tracked.find(reqId) != m_tracked.end();
+}
+
+std::vector<SessionRequest> RequestRegistry::replayList()
+{
+	std::vector<SessionRequest> live;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	live.reserve(m_tracked.size() + m_pending.size());
+	for (auto it = m_tracked.begin(); it != m_tracked.end(); ++it) {
+		// no deadline or retry of the old connection fires before the replay's send
+		disarmLocked(it->second);
+		it->second.timeouts = 0;
+		it->second.live = false;
+		live.push_back(it->second);
+	}
+	for (auto it = m_pending.begin(); it != m_pending.end(); ++it) {
+		SessionRequest req;
+		req.reqId = it->first;
+		req.kind = it->second->kind;
+		req.contract = it->second->contract;
+		req.param = it->second->param;
+		req.sentMicros = it->second->sentMicros;
+		req.timeouts = 0;
+		req.timer = 0;
+		req.live = false;
+		live.push_back(std::move(req));
+		it->second->details.clear();
+		it->second->live = false;
+	}
+	return live;
+}
+
+bool RequestRegistry::markSent(int reqId)
+{
+	int64_t now = TraceNow();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto tracked = m_tracked.find(reqId);
+	if (tracked != m_tracked.end()) {
+		SessionRequest& req = tracked->second;
+		if (req.live)
+			return false;
+		req.live = true;
+		req.sentMicros = now;
+		disarmLocked(req);
+		const RetryPolicy& policy = retryPolicy(req.kind);
+		if (policy.timeoutMs > 0)
+			req.timer = m_timers.schedule(now + (int64_t)policy.timeoutMs * 1000, (uint32_t)reqId);
+		return true;
+	}
+	auto pending = m_pending.find(reqId);
+	if (pending == m_pending.end() || pending->second->live)
+		return false;
+	pending->second->live = true;
+	pending->second->sentMicros = now;
+	return true;
+}
+
+void RequestRegistry::recordResponse(int reqId, RequestKind kind)
+{
+	int64_t now = TraceNow();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	int64_t *pSent = NULL;
+	const Contract *pContract = NULL;
+	auto tracked = m_tracked.find(reqId);
+	if (tracked != m_tracked.end() && tracked->second.kind == kind) {
+		// also a late answer to the last send that timed out; one cancelled for a retry
+		// leaves the retry armed
+		if (tracked->second.live) {
+			disarmLocked(tracked->second);
+			tracked->second.timeouts = 0;
+		}
+		pSent = &tracked->second.sentMicros;
+		pContract = &tracked->second.contract;
+	}
+	else {
+		auto pending = m_pending.find(reqId);
+		if (pending != m_pending.end() && pending->second->kind == kind) {
+			pSent = &pending->second->sentMicros;
+			pContract = &pending->second->contract;
+		}
+	}
+	if (pSent == NULL || *pSent == 0)
+		return;
+	metrics::RequestLatency.record(RequestCall(kind), LatencyExchange(*pContract), (uint64_t)(now - *pSent));
+	TraceAsync(RequestName(kind), "request", reqId, *pSent, now);
+	*pSent = 0;
+}
+
+const RetryPolicy& RequestRegistry::retryPolicy(RequestKind kind)
+{
+	return RetryPolicies[kind];
+}
+
+void RequestRegistry::expire(int64_t now, std::vector<RetryTask>& tasks)
+{
+	std::vector<uint64_t> expired;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_timers.advance(now, expired);
+	for (size_t i = 0; i < expired.size(); i++) {
+		auto it = m_tracked.find((int)(uint32_t)expired[i]);
+		if (it == m_tracked.end())
+			continue;
+		SessionRequest& req = it->second;
+		req.timer = 0;
+		const RetryPolicy& policy = retryPolicy(req.kind);
+		if (req.sentMicros == 0) {
+			metrics::RequestsRetried.inc(RequestCall(req.kind));
+			RetryTask task = { RA_RESEND, req };
+			tasks.push_back(std::move(task));
+			continue;
+		}
+		metrics::RequestsTimedOut.inc(RequestCall(req.kind));
+		// the last send stays timed, a late answer still counts in RequestLatency
+		if (++req.timeouts >= policy.attempts)
+			continue;
+		TraceAsync(RequestName(req.kind), "timed out", req.reqId, req.sentMicros, now);
+		req.sentMicros = 0;
+		// the RA_CANCEL is on its way
+		req.live = false;
+		int64_t backoff = (int64_t)policy.backoffMs << (req.timeouts - 1);
+		if (backoff > policy.maxBackoffMs)
+			backoff = policy.maxBackoffMs;
+		req.timer = m_timers.schedule(now + backoff * 1000, (uint32_t)req.reqId);
+		RetryTask task = { RA_CANCEL, req };
+		tasks.push_back(std::move(task));
+	}
+}
+
+bool RequestRegistry::retrying(int reqId)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_tracked.find(reqId);
+	if (it == m_tracked.end() || it->second.timeouts == 0)
+		return false;
+	// given up once the last send's deadline passed, that one stays timed
+	return it->second.timer != 0 || it->second.sentMicros == 0;
+}
+
+bool RequestRegistry::claimCancel(int reqId)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_tracked.find(reqId);
+	return it != m_tracked.end() && !it->second.live && it->second.timeouts > 0;
+}
+
+void RequestRegistry::heard(int reqId)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_tracked.find(reqId);
+	// ticks still in flight from a send cancelled for a retry don't stop the retry
+	if (it == m_tracked.end() || !it->second.live)
+		return;
+	disarmLocked(it->second);
+	it->second.timeouts = 0;
+}
+
+size_t RequestRegistry::pendingCount()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pending.size();
+}
+
+void RequestRegistry::disarmLocked(SessionRequest& req)
+{
+	if (req.timer != 0)
+		m_timers.cancel(req.timer);
+	req.timer = 0;
+}
+
+std::unique_ptr<PendingRequest> RequestRegistry::take(int reqId)
+{
+	if (!owns(reqId))
+		return nullptr;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_pending.find(reqId);
+	if (it == m_pending.end())
+		return nullptr;
+	std::unique_ptr<PendingRequest> req = std::move(it->second);
+	m_pending.erase(it);
+	if (req->kind == RK_SNAPSHOT)
+		metrics::MarketDataLines.add(-1);
+	return req;
+}
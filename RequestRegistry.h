@@ -0,0 +1,173 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_REQUESTREGISTRY_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_REQUESTREGISTRY_H
+
+#include "EWrapper.h"
+#include "Contract.h"
+#include "TimerWheel.h"
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Requests issued through the registry get ids from this value upwards, so they never
+// collide with the hand-numbered crawler ranges, even offset by a job slot (JobRunner.h).
+const int REGISTRY_FIRST_REQID = 100000000;
+
+enum RequestKind {
+	RK_CONTRACTDETAILS,
+	RK_SNAPSHOT,
+	RK_FUNDAMENTALS,
+	RK_MKTDATA
+};
+
+struct SnapshotQuote {
+	double bid;
+	double ask;
+	double last;
+	double close;
+};
+
+struct PendingRequest;
+typedef std::function<void(PendingRequest&)> RequestDoneFunc;
+
+// One in-flight request. The callbacks fill in the result fields, and onDone runs exactly
+// once when the matching end callback (or a fatal error) arrives.
+struct PendingRequest {
+	int reqId;
+	RequestKind kind;
+	Contract contract;
+	std::string param; // report type for RK_FUNDAMENTALS
+
+	std::vector<ContractDetails> details;
+	SnapshotQuote quote;
+	std::string data;
+
+	int errorCode;
+	std::string errorString;
+
+	int64_t sentMicros; // steady clock at the last send, 0 once the response is timed
+	bool live; // sent on the current connection
+
+	RequestDoneFunc onDone;
+};
+
+// What it takes to send a request again after a reconnect.
+struct SessionRequest {
+	int reqId;
+	RequestKind kind;
+	Contract contract;
+	std::string param; // report type for RK_FUNDAMENTALS, generic ticks for RK_MKTDATA
+	int64_t sentMicros;
+	int timeouts; // sends that went unanswered past their deadline
+	TimerWheel::TimerId timer; // the deadline while sent, the retry after a timeout, 0 for none
+	bool live; // sent on the current connection, and not cancelled for a retry since
+};
+
+// Deadlines of tracked requests, per kind. A request still unanswered timeoutMs after it
+// was sent is cancelled and sent again backoffMs later, the backoff doubling with each
+// timeout up to maxBackoffMs, until attempts sends went unanswered.
+struct RetryPolicy {
+	int timeoutMs; // 0 for no deadline
+	int attempts;
+	int backoffMs;
+	int maxBackoffMs;
+};
+
+// RA_CANCEL when a deadline passed with attempts left, RA_RESEND once its backoff is over
+enum RetryAction {
+	RA_CANCEL,
+	RA_RESEND
+};
+
+struct RetryTask {
+	RetryAction action;
+	SessionRequest request;
+};
+
+// the registry's timers turn in steps of this, the caller of expire() polls at it
+const int RETRY_TICK_MS = 50;
+
+class RequestRegistry {
+public:
+	RequestRegistry();
+
+	// Registers a request and returns its id. The request must be sent after this returns,
+	// so a fast response can never arrive before the entry exists.
+	int add(RequestKind kind, const Contract& contract, const std::string& param, RequestDoneFunc onDone);
+
+	static bool owns(int reqId) { return reqId >= REGISTRY_FIRST_REQID; }
+	// Codes after which TWS keeps the request running, so it stays tracked and is cancelled
+	// as usual: 2100-2199 are warnings, 10090 and 10091 "part of the requested market data
+	// is not subscribed", 10167 "displaying delayed data" and 10197 "no market data during
+	// competing live session". Anything else, 200, 354, 10089, 430 among them, ends it.
+	static bool isWarning(int errorCode)
+	{
+		return (errorCode >= 2100 && errorCode < 2200) || errorCode == 10090 || errorCode == 10091
+			|| errorCode == 10167 || errorCode == 10197;
+	}
+
+	// Requests sent with caller-chosen ids (the crawler threads) are only tracked, so that
+	// they can be replayed; they are dropped again on cancel or on their end callback.
+	void track(int reqId, RequestKind kind, const Contract& contract, const std::string& param);
+	// false when reqId was not tracked: never sent, or already ended or failed
+	bool untrack(int reqId);
+	// kind and contract of a tracked or pending request
+	bool lookup(int reqId, RequestKind& kind, Contract& contract);
+	// still waiting for its end callback, an error or its owner's cancel
+	bool isTracked(int reqId);
+
+	// Everything that should be re-sent on a new connection: tracked requests plus the
+	// registry's own pending ones, which keep their ids. Partial results of the pending
+	// ones are dropped, the replayed request delivers them again. Nothing is live on the
+	// new connection, so their timers are disarmed and their timeouts forgotten.
+	std::vector<SessionRequest> replayList();
+
+	// Latency: markSent stamps a tracked or pending request as it goes out, recordResponse
+	// feeds metrics::RequestLatency with the time since, once per send, when the response
+	// belongs to a request of that kind. Each timed request is also a trace span, and one
+	// untracked before its response is traced as unanswered.
+	// markSent is also the claim on the send: false, and nothing may go out, when reqId is
+	// neither tracked nor pending or is already live, e.g. replayed while a retry waited.
+	bool markSent(int reqId);
+	void recordResponse(int reqId, RequestKind kind);
+
+	// Deadlines: markSent arms one for a tracked request, its response, any other tick of
+	// it (heard), untrack or a new track() of the id disarm it. expire() hands back what is
+	// due by now; the last timeout leaves the request tracked for its owner to cancel, as
+	// if it never had a deadline. claimCancel is the claim on an RA_CANCEL, false once the
+	// request was answered, replayed or untracked since expire().
+	static const RetryPolicy& retryPolicy(RequestKind kind);
+	void expire(int64_t now, std::vector<RetryTask>& tasks);
+	bool claimCancel(int reqId);
+	void heard(int reqId);
+	// timed out, and neither answered nor out of attempts
+	bool retrying(int reqId);
+
+	// Callback side. Each returns false when reqId does not belong to a pending request.
+	bool onContractDetails(int reqId, const ContractDetails& contractDetails);
+	bool onTickPrice(int reqId, TickType field, double price);
+	bool onFundamentalData(int reqId, const std::string& data);
+	bool onError(int reqId, int errorCode, const std::string& errorString);
+	bool finish(int reqId);
+
+	size_t pendingCount();
+
+private:
+	std::unique_ptr<PendingRequest> take(int reqId);
+	void disarmLocked(SessionRequest& req);
+
+	std::mutex m_mutex;
+	int m_nextReqId;
+	std::unordered_map<int, std::unique_ptr<PendingRequest>> m_pending;
+	std::unordered_map<int, SessionRequest> m_tracked;
+	// payloads are tracked reqIds
+	TimerWheel m_timers;
+};
+
+#endif
@@ -0,0 +1,304 @@
+﻿#include "StdAfx.h"
+
+#include "RollingStats.h"
+#include "SymbolTable.h"
+
+#include <math.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+const char *STATS_DIR = "C:\\bighouse\\波动率探索器\\历史";
+const char *STATS_FILE = "C:\\bighouse\\波动率探索器\\历史\\stats.dat";
+
+const uint32_t STATS_FILE_MAGIC = 0x41545352;	// "RSTA"
+// 2 keys by tenor as well, version 1 mixed all expiries of a symbol
+const uint32_t STATS_FILE_VERSION = 2;
+
+// sketch bounds: yield in percent a year, IV as a fraction
+const double YIELD_LO = 0.1;
+const double YIELD_HI = 1000;
+const double IV_LO = 0.01;
+const double IV_HI = 10;
+
+// upper bounds in days of the first TENORS - 1 tenors
+const int TENOR_DAYS[RollingStats::TENORS - 1] = { 7, 14, 21, 30, 45, 60, 90, 120, 180, 270 };
+
+// rescale the sketch long before a float overflows
+const float SKETCH_WEIGHT_LIMIT = 1e30f;
+
+struct StatsFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t reserved;
+};
+
+// A sketch is saved as its mass, in units of the newest sample's weight, and each
+// bin's share of it in 1/65535ths; loading restarts the weights at 1.
+struct SketchRecord {
+	float mass;
+	uint16_t shares[DecayingSketch::BINS];
+};
+
+struct StatsRecord {
+	char symbol[16];
+	uint8_t bucket;
+	uint8_t tenor;
+	uint8_t pad[2];
+	uint32_t count;
+	uint32_t ivCount;
+	float yieldMean;
+	float yieldVar;
+	float ivMean;
+	float ivVar;
+	SketchRecord yieldSketch;
+	SketchRecord ivSketch;
+};
+
+int SketchBin(double value, double lo, double hi)
+{
+	if (!(value > lo))
+		return 0;
+	int nBin = (int)(log(value / lo) / log(hi / lo) * DecayingSketch::BINS);
+	return nBin < DecayingSketch::BINS ? nBin : DecayingSketch::BINS - 1;
+}
+
+void SaveSketch(const DecayingSketch& sketch, SketchRecord& record)
+{
+	record.mass = sketch.total / sketch.weight;
+	for (int i = 0; i < DecayingSketch::BINS; i++)
+		record.shares[i] = sketch.total > 0 ? (uint16_t)(sketch.bins[i] / sketch.total * 65535 + 0.5f) : 0;
+}
+
+void LoadSketch(const SketchRecord& record, DecayingSketch& sketch)
+{
+	sketch.clear();
+	if (!(record.mass > 0) || record.mass > SKETCH_WEIGHT_LIMIT)
+		return;
+	float fShares = 0;
+	for (int i = 0; i < DecayingSketch::BINS; i++)
+		fShares += record.shares[i];
+	if (fShares <= 0)
+		return;
+	for (int i = 0; i < DecayingSketch::BINS; i++)
+		sketch.bins[i] = record.shares[i] / fShares * record.mass;
+	sketch.total = record.mass;
+}
+
+}
+
+void EwmaStat::add(double value, double alpha, bool bFirst)
+{
+	if (bFirst) {
+		mean = value;
+		var = 0;
+		return;
+	}
+	double diff = value - mean;
+	double incr = alpha * diff;
+	mean += incr;
+	var = (1 - alpha) * (var + diff * incr);
+}
+
+double EwmaStat::zscore(double value) const
+{
+	return var > 1e-12 ? (value - mean) / sqrt(var) : 0;
+}
+
+void DecayingSketch::clear()
+{
+	memset(bins, 0, sizeof(bins));
+	total = 0;
+	weight = 1;
+}
+
+void DecayingSketch::add(double value, double lo, double hi, double alpha)
+{
+	bins[SketchBin(value, lo, hi)] += weight;
+	total += weight;
+	weight /= (float)(1 - alpha);
+	if (weight > SKETCH_WEIGHT_LIMIT) {
+		for (int i = 0; i < BINS; i++)
+			bins[i] /= weight;
+		total /= weight;
+		weight = 1;
+	}
+}
+
+double DecayingSketch::rank(double value, double lo, double hi) const
+{
+	if (total <= 0)
+		return 0.5;
+	int nBin = SketchBin(value, lo, hi);
+	float fBelow = bins[nBin] / 2;
+	for (int i = 0; i < nBin; i++)
+		fBelow += bins[i];
+	return fBelow / total;
+}
+
+RollingStats& RollingStats::instance()
+{
+	static RollingStats stats;
+	return stats;
+}
+
+RollingStats::RollingStats()
+	: m_bLoaded(false)
+{
+}
+
+int RollingStats::bucket(double moneyness)
+{
+	if (!(moneyness > 0.70))
+		return 0;
+	int nBucket = (int)((moneyness - 0.70) / 0.05);
+	return nBucket < BUCKETS ? nBucket : BUCKETS - 1;
+}
+
+int RollingStats::tenor(int nDays)
+{
+	int nTenor = 0;
+	while (nTenor < TENORS - 1 && nDays > TENOR_DAYS[nTenor])
+		nTenor++;
+	return nTenor;
+}
+
+RichnessScore RollingStats::scoreLocked(const Entry *pEntry, double yield, double iv) const
+{
+	RichnessScore score = { 0, 0, 0.5, 0, 0.5 };
+	if (pEntry == NULL || pEntry->count == 0)
+		return score;
+	score.count = pEntry->count;
+	score.yieldZ = pEntry->yield.zscore(yield);
+	score.yieldRank = pEntry->yieldSketch.rank(yield, YIELD_LO, YIELD_HI);
+	if (pEntry->ivCount > 0 && iv > 0) {
+		score.ivZ = pEntry->iv.zscore(iv);
+		score.ivRank = pEntry->ivSketch.rank(iv, IV_LO, IV_HI);
+	}
+	return score;
+}
+
+RichnessScore RollingStats::score(uint32_t symbolId, int nDays, double moneyness, double yield, double iv)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_bLoaded)
+		loadLocked();
+	auto it = m_entries.find(key(symbolId, tenor(nDays), bucket(moneyness)));
+	return scoreLocked(it == m_entries.end() ? NULL : &it->second, yield, iv);
+}
+
+RichnessScore RollingStats::update(uint32_t symbolId, int nDays, double moneyness, double yield, double iv)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_bLoaded)
+		loadLocked();
+	uint64_t nKey = key(symbolId, tenor(nDays), bucket(moneyness));
+	auto it = m_entries.find(nKey);
+	if (it == m_entries.end()) {
+		Entry entry = {};
+		entry.yieldSketch.clear();
+		entry.ivSketch.clear();
+		it = m_entries.emplace(nKey, entry).first;
+	}
+	Entry& entry = it->second;
+	RichnessScore score = scoreLocked(&entry, yield, iv);
+
+	const double alpha = 2.0 / (SPAN + 1);
+	entry.yield.add(yield, alpha, entry.count == 0);
+	entry.yieldSketch.add(yield, YIELD_LO, YIELD_HI, alpha);
+	entry.count++;
+	// the IV tick doesn't always arrive before the price
+	if (iv > 0) {
+		entry.iv.add(iv, alpha, entry.ivCount == 0);
+		entry.ivSketch.add(iv, IV_LO, IV_HI, alpha);
+		entry.ivCount++;
+	}
+	return score;
+}
+
+void RollingStats::loadLocked()
+{
+	m_bLoaded = true;
+	FILE *pFile = NULL;
+	if (fopen_s(&pFile, STATS_FILE, "rb") != 0 || pFile == NULL)
+		return;
+	StatsFileHeader header;
+	if (fread(&header, sizeof(header), 1, pFile) != 1 || header.magic != STATS_FILE_MAGIC || header.version != STATS_FILE_VERSION) {
+		printf("%s is not a version %u stats file, ignored\n", STATS_FILE, STATS_FILE_VERSION);
+		fclose(pFile);
+		return;
+	}
+	StatsRecord record;
+	for (uint32_t i = 0; i < header.count && fread(&record, sizeof(record), 1, pFile) == 1; i++) {
+		if (record.count == 0 || record.bucket >= BUCKETS || record.tenor >= TENORS || memchr(record.symbol, 0, sizeof(record.symbol)) == NULL)
+			continue;
+		Entry entry;
+		entry.count = record.count;
+		entry.ivCount = record.ivCount;
+		entry.yield.mean = record.yieldMean;
+		entry.yield.var = record.yieldVar;
+		entry.iv.mean = record.ivMean;
+		entry.iv.var = record.ivVar;
+		LoadSketch(record.yieldSketch, entry.yieldSketch);
+		LoadSketch(record.ivSketch, entry.ivSketch);
+		uint32_t symbolId = SymbolTable::instance().intern(record.symbol);
+		m_entries[key(symbolId, record.tenor, record.bucket)] = entry;
+	}
+	fclose(pFile);
+}
+
+bool RollingStats::save()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_bLoaded)
+		return true;
+
+	std::vector<StatsRecord> records;
+	records.reserve(m_entries.size());
+	for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+		const std::string& name = SymbolTable::instance().name((uint32_t)(it->first >> 8));
+		if (name.empty() || name.size() >= sizeof(((StatsRecord *)0)->symbol))
+			continue;
+		const Entry& entry = it->second;
+		StatsRecord record;
+		memset(&record, 0, sizeof(record));
+		memcpy(record.symbol, name.c_str(), name.size());
+		record.bucket = (uint8_t)(it->first & 7);
+		record.tenor = (uint8_t)((it->first >> 3) & 0x1f);
+		record.count = entry.count;
+		record.ivCount = entry.ivCount;
+		record.yieldMean = (float)entry.yield.mean;
+		record.yieldVar = (float)entry.yield.var;
+		record.ivMean = (float)entry.iv.mean;
+		record.ivVar = (float)entry.iv.var;
+		SaveSketch(entry.yieldSketch, record.yieldSketch);
+		SaveSketch(entry.ivSketch, record.ivSketch);
+		records.push_back(record);
+	}
+
+	StatsFileHeader header;
+	header.magic = STATS_FILE_MAGIC;
+	header.version = STATS_FILE_VERSION;
+	header.count = (uint32_t)records.size();
+	header.reserved = 0;
+	CreateDirectory(STATS_DIR, NULL);
+	char pszTempName[MAX_PATH];
+	sprintf_s(pszTempName, MAX_PATH, "%s.tmp", STATS_FILE);
+	HANDLE hFile = CreateFile(pszTempName, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	DWORD dwWrite;
+	bool bOk = WriteFile(hFile, &header, sizeof(header), &dwWrite, 0) != 0
+		&& (records.empty() || WriteFile(hFile, &records[0], (DWORD)(records.size() * sizeof(StatsRecord)), &dwWrite, 0) != 0)
+		&& FlushFileBuffers(hFile) != 0;
+	CloseHandle(hFile);
+	if (!bOk || MoveFileEx(pszTempName, STATS_FILE, MOVEFILE_REPLACE_EXISTING) == 0) {
+		printf("RollingStats: can't write %s\n", STATS_FILE);
+		DeleteFile(pszTempName);
+		return false;
+	}
+	return true;
+}
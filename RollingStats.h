@@ -0,0 +1,86 @@
+﻿#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_ROLLINGSTATS_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_ROLLINGSTATS_H
+
+#include <stdint.h>
+
+#include <mutex>
+#include <unordered_map>
+
+// Exponentially weighted mean and variance, O(1) per sample.
+struct EwmaStat {
+	double mean;
+	double var;
+
+	void add(double value, double alpha, bool bFirst);
+	double zscore(double value) const;
+};
+
+// Histogram over log-spaced bins between two bounds. Older samples fade like the EWMA:
+// instead of decaying every bin on each sample, each new sample weighs 1/(1-alpha)
+// times the previous one, and all bins are rescaled on the rare overflow.
+struct DecayingSketch {
+	static const int BINS = 64;
+
+	float bins[BINS];
+	float total;
+	float weight;
+
+	void clear();
+	void add(double value, double lo, double hi, double alpha);
+	// share of the history below value, 0 to 1
+	double rank(double value, double lo, double hi) const;
+};
+
+struct RichnessScore {
+	uint32_t count;			// samples behind the score, 0 when there is no history
+	double yieldZ;
+	double yieldRank;
+	double ivZ;				// 0 and 0.5 when the scan had no IV
+	double ivRank;
+};
+
+// Rolling put yield and IV statistics per (symbol, tenor, moneyness bucket), updated at
+// WriteRateToFile and saved to 波动率探索器\历史\stats.dat between runs. The scanned
+// strike sits near one moneyness, so it is the tenor that keeps a scan's expiries apart:
+// each key gets about one sample a scan, the one or two expiries in its tenor band.
+class RollingStats {
+public:
+	// strike / underlying in 0.05 wide buckets from 0.70, the ends catching the rest
+	static const int BUCKETS = 8;
+	// days to expiry up to 7, 14, 21, 30, 45, 60, 90, 120, 180, 270 and beyond
+	static const int TENORS = 11;
+	// EWMA span in scans, about four weeks of one scan a trading day
+	static const int SPAN = 20;
+
+	static RollingStats& instance();
+	static int bucket(double moneyness);
+	static int tenor(int nDays);
+
+	// score of the sample against the history before it, then the sample is added
+	RichnessScore update(uint32_t symbolId, int nDays, double moneyness, double yield, double iv);
+	RichnessScore score(uint32_t symbolId, int nDays, double moneyness, double yield, double iv);
+	bool save();
+
+private:
+	struct Entry {
+		uint32_t count;
+		uint32_t ivCount;
+		EwmaStat yield;
+		EwmaStat iv;
+		DecayingSketch yieldSketch;
+		DecayingSketch ivSketch;
+	};
+
+	RollingStats();
+	static uint64_t key(uint32_t symbolId, int nTenor, int nBucket) { return ((uint64_t)symbolId << 8) | (nTenor << 3) | nBucket; }
+	void loadLocked();
+	RichnessScore scoreLocked(const Entry *pEntry, double yield, double iv) const;
+
+	std::mutex m_mutex;
+	bool m_bLoaded;
+	// key(): (symbolId << 8) | (tenor << 3) | bucket
+	std::unordered_map<uint64_t, Entry> m_entries;
+};
+
+#endif
@@ -0,0 +1,296 @@
+﻿#include "StdAfx.h"
+
+#include "ScanReport.h"
+#include "SymbolTable.h"
+#include "JobRunner.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+
+namespace {
+
+const char *const OutcomeNames[SO_COUNT] = {
+	"result_last", "result_mid", "error", "no_last", "no_chain", "no_strike", "no_quote", "cached"
+};
+
+const char *const PhaseNames[SP_COUNT] = { "setup", "request", "wait", "drain", "save" };
+
+const char *const REPORT_DIR = "C:\\bighouse\\波动率探索器\\报告";
+
+double Seconds(uint64_t from, uint64_t to)
+{
+	return to > from ? (to - from) / 1000.0 : 0;
+}
+
+}
+
+ScanReport::ScanReport()
+	: m_bActive(false)
+	, m_nIdBase(0)
+	, m_start(0)
+	, m_phaseStart(0)
+	, m_phase(SP_SETUP)
+{
+	memset(m_phaseMs, 0x00, sizeof(m_phaseMs));
+}
+
+void ScanReport::begin(int nIdBase)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_bActive = true;
+	m_nIdBase = nIdBase;
+	m_start = GetTickCount64();
+	m_phaseStart = m_start;
+	m_phase = SP_SETUP;
+	memset(m_phaseMs, 0x00, sizeof(m_phaseMs));
+	m_expiries.clear();
+	m_rows.clear();
+}
+
+void ScanReport::beginExpiry(int m, uint32_t expiry, int nSymbols)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m < 0)
+		return;
+	if (m >= (int)m_rows.size()) {
+		m_rows.resize(m + 1);
+		m_expiries.resize(m + 1, 0);
+	}
+	m_expiries[m] = expiry;
+	Row empty = { INVALID_SYMBOL, SO_COUNT, 0, 0, 0, 0, 0, 0, 0 };
+	m_rows[m].assign(nSymbols, empty);
+}
+
+void ScanReport::phase(ScanPhase next)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	phaseLocked(next, GetTickCount64());
+}
+
+void ScanReport::phaseLocked(ScanPhase next, uint64_t now)
+{
+	m_phaseMs[m_phase] += now - m_phaseStart;
+	m_phaseStart = now;
+	m_phase = next;
+}
+
+ScanReport::Row *ScanReport::row(int m, int k)
+{
+	if (!m_bActive || m < 0 || m >= (int)m_rows.size() || k < 0 || k >= (int)m_rows[m].size())
+		return NULL;
+	return &m_rows[m][k];
+}
+
+void ScanReport::underlyingSent(int m, int k, uint32_t symbolId)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Row *pRow = row(m, k);
+	if (pRow == NULL)
+		return;
+	pRow->symbolId = symbolId;
+	pRow->underlyingSent = GetTickCount64();
+}
+
+void ScanReport::underlyingSkipped(int m, int k, uint32_t symbolId)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Row *pRow = row(m, k);
+	if (pRow == NULL)
+		return;
+	pRow->symbolId = symbolId;
+	pRow->outcome = SO_CACHED;
+}
+
+void ScanReport::underlyingLast(int m, int k)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Row *pRow = row(m, k);
+	if (pRow != NULL && pRow->underlyingLast == 0)
+		pRow->underlyingLast = GetTickCount64();
+}
+
+void ScanReport::underlyingCancelled(int m, int k)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Row *pRow = row(m, k);
+	if (pRow != NULL)
+		pRow->underlyingCancelled = GetTickCount64();
+}
+
+void ScanReport::optionSent(int m, int k)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Row *pRow = row(m, k);
+	if (pRow != NULL)
+		pRow->optionSent = GetTickCount64();
+}
+
+void ScanReport::optionClosed(int m, int k)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Row *pRow = row(m, k);
+	if (pRow != NULL && pRow->optionClosed == 0)
+		pRow->optionClosed = GetTickCount64();
+}
+
+void ScanReport::outcome(int m, int k, ScanOutcome outcome)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Row *pRow = row(m, k);
+	if (pRow == NULL || pRow->result != 0)
+		return;
+	pRow->outcome = outcome;
+	if (outcome == SO_RESULT_LAST || outcome == SO_RESULT_MID)
+		pRow->result = GetTickCount64();
+}
+
+void ScanReport::error(int reqId, int errorCode)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	int nLocal = reqId - m_nIdBase;
+	if (!m_bActive || nLocal < 0 || nLocal >= JOB_ID_SPAN)
+		return;
+	// the puts are 200000 above their underlying, as in onOptionTick
+	if (nLocal >= 200000)
+		nLocal -= 200000;
+	Row *pRow = row(nLocal / 10000, nLocal % 10000);
+	if (pRow != NULL && pRow->underlyingSent != 0 && pRow->result == 0 && pRow->errorCode == 0)
+		pRow->errorCode = errorCode;
+}
+
+bool ScanReport::finish()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_bActive)
+		return false;
+	uint64_t now = GetTickCount64();
+	phaseLocked(SP_SAVE, now);
+	m_bActive = false;
+
+	int outcomes[SO_COUNT] = { 0 };
+	std::map<int, int> errors;
+	int nRows = 0;
+	int nRequests = 0;
+	int nOpenOptions = 0;
+	double fUnderlyingLines = 0;
+	double fOptionLines = 0;
+	// with their expiry
+	std::vector<std::pair<const Row*, uint32_t> > results;
+	std::string expiries;
+	std::string failed;
+	char pszItem[512];
+	for (size_t m = 0; m < m_rows.size(); m++) {
+		int nResults = 0;
+		int nExpiryRows = 0;
+		for (size_t k = 0; k < m_rows[m].size(); k++) {
+			const Row& r = m_rows[m][k];
+			if (r.underlyingSent == 0 && r.outcome != SO_CACHED)
+				continue;
+			nExpiryRows++;
+			if (r.underlyingSent != 0) {
+				nRequests++;
+				fUnderlyingLines += Seconds(r.underlyingSent, r.underlyingCancelled != 0 ? r.underlyingCancelled : now);
+			}
+			if (r.optionSent != 0) {
+				nRequests++;
+				fOptionLines += Seconds(r.optionSent, r.optionClosed != 0 ? r.optionClosed : now);
+				if (r.optionClosed == 0)
+					nOpenOptions++;
+			}
+
+			int nOutcome = r.outcome;
+			if (r.result == 0) {
+				if (r.errorCode != 0)
+					nOutcome = SO_FAILED;
+				else if (nOutcome == SO_COUNT)
+					nOutcome = r.underlyingLast == 0 ? SO_NO_LAST : SO_NO_QUOTE;
+			}
+			outcomes[nOutcome]++;
+			if (r.result != 0) {
+				nResults++;
+				results.push_back(std::make_pair(&r, m_expiries[m]));
+				continue;
+			}
+			if (nOutcome == SO_FAILED)
+				errors[r.errorCode]++;
+			snprintf(pszItem, sizeof(pszItem), "%s\n    {\"symbol\": \"%s\", \"expiry\": %u, \"outcome\": \"%s\", \"error\": %d}",
+				failed.empty() ? "" : ",", SymbolTable::instance().name(r.symbolId).c_str(), m_expiries[m], OutcomeNames[nOutcome], r.errorCode);
+			failed += pszItem;
+		}
+		nRows += nExpiryRows;
+		snprintf(pszItem, sizeof(pszItem), "%s\n    {\"expiry\": %u, \"rows\": %d, \"results\": %d}",
+			expiries.empty() ? "" : ",", m_expiries[m], nExpiryRows, nResults);
+		expiries += pszItem;
+	}
+
+	// slowest from the underlying's request to the result
+	size_t nSlowest = (std::min)(results.size(), (size_t)SLOWEST);
+	std::partial_sort(results.begin(), results.begin() + nSlowest, results.end(), [](const std::pair<const Row*, uint32_t>& a, const std::pair<const Row*, uint32_t>& b) {
+		return a.first->result - a.first->underlyingSent > b.first->result - b.first->underlyingSent;
+	});
+	std::string slowest;
+	for (size_t i = 0; i < nSlowest; i++) {
+		const Row& r = *results[i].first;
+		snprintf(pszItem, sizeof(pszItem),
+			"%s\n    {\"symbol\": \"%s\", \"expiry\": %u, \"seconds\": %.1f, \"underlyingSeconds\": %.1f, \"optionSeconds\": %.1f}",
+			i == 0 ? "" : ",", SymbolTable::instance().name(r.symbolId).c_str(), results[i].second, Seconds(r.underlyingSent, r.result),
+			Seconds(r.underlyingSent, r.underlyingLast), r.optionSent != 0 ? Seconds(r.optionSent, r.result) : 0.0);
+		slowest += pszItem;
+	}
+
+	int nResults = outcomes[SO_RESULT_LAST] + outcomes[SO_RESULT_MID];
+	double fPerResult = nResults > 0 ? (double)nRequests / nResults : 0;
+	std::string out = "{\n";
+	snprintf(pszItem, sizeof(pszItem), "  \"seconds\": %.1f,\n  \"rows\": %d,\n  \"results\": %d,\n  \"requests\": %d,\n  \"requestsPerResult\": %.2f,\n",
+		Seconds(m_start, now), nRows, nResults, nRequests, fPerResult);
+	out += pszItem;
+	out += "  \"outcomes\": {";
+	for (int i = 0; i < SO_COUNT; i++) {
+		snprintf(pszItem, sizeof(pszItem), "%s\"%s\": %d", i == 0 ? "" : ", ", OutcomeNames[i], outcomes[i]);
+		out += pszItem;
+	}
+	out += "},\n  \"errors\": {";
+	for (auto it = errors.begin(); it != errors.end(); ++it) {
+		snprintf(pszItem, sizeof(pszItem), "%s\"%d\": %d", it == errors.begin() ? "" : ", ", it->first, it->second);
+		out += pszItem;
+	}
+	out += "},\n  \"phaseSeconds\": {";
+	for (int i = 0; i < SP_COUNT; i++) {
+		snprintf(pszItem, sizeof(pszItem), "%s\"%s\": %.1f", i == 0 ? "" : ", ", PhaseNames[i], m_phaseMs[i] / 1000.0);
+		out += pszItem;
+	}
+	snprintf(pszItem, sizeof(pszItem), "},\n  \"lineSeconds\": {\"underlying\": %.1f, \"option\": %.1f},\n  \"optionLinesOpenAtEnd\": %d,\n",
+		fUnderlyingLines, fOptionLines, nOpenOptions);
+	out += pszItem;
+	out += "  \"expiries\": [" + expiries + "\n  ],\n";
+	out += "  \"slowest\": [" + slowest + "\n  ],\n";
+	out += "  \"failed\": [" + failed + "\n  ]\n}\n";
+
+	SYSTEMTIME currentTime = { 0 };
+	GetLocalTime(&currentTime);
+	char pszFileName[MAX_PATH];
+	// concurrent scan jobs finish in the same second, each job slot gets its own file
+	char pszSlot[16] = "";
+	if (m_nIdBase != 0)
+		sprintf_s(pszSlot, sizeof(pszSlot), "_%d", m_nIdBase / JOB_ID_SPAN - 1);
+	sprintf_s(pszFileName, MAX_PATH, "%s\\%04d%02d%02d_%02d%02d%02d%s.json", REPORT_DIR,
+		currentTime.wYear, currentTime.wMonth, currentTime.wDay, currentTime.wHour, currentTime.wMinute, currentTime.wSecond, pszSlot);
+	printf("Scan report: %d of %d rows with a result (%d LAST, %d mid), %.2f requests per result, %.0f underlying and %.0f put line-seconds\n",
+		nResults, nRows, outcomes[SO_RESULT_LAST], outcomes[SO_RESULT_MID], fPerResult, fUnderlyingLines, fOptionLines);
+	printf("Scan report: no LAST %d, no chain %d, no strike %d, no quote %d, errors %d, cached %d, in %s\n",
+		outcomes[SO_NO_LAST], outcomes[SO_NO_CHAIN], outcomes[SO_NO_STRIKE], outcomes[SO_NO_QUOTE], outcomes[SO_FAILED], outcomes[SO_CACHED], pszFileName);
+
+	CreateDirectory(REPORT_DIR, NULL);
+	HANDLE hFile = CreateFile(pszFileName, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		printf("Scan report: can't create %s\n", pszFileName);
+		return false;
+	}
+	DWORD dwWrite;
+	bool bOk = WriteFile(hFile, out.data(), (DWORD)out.size(), &dwWrite, 0) != 0;
+	CloseHandle(hFile);
+	if (!bOk)
+		printf("Scan report: can't write %s\n", pszFileName);
+	return bOk;
+}
@@ -0,0 +1,88 @@
+﻿#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_SCANREPORT_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_SCANREPORT_H
+
+#include <stdint.h>
+
+#include <mutex>
+#include <vector>
+
+// What became of one (expiry, symbol) row of the rate scan.
+enum ScanOutcome {
+	SO_RESULT_LAST,		// the put traded, the yield is from its LAST
+	SO_RESULT_MID,		// no trade by the end of the batch, the yield is from the bid/ask mid
+	SO_FAILED,			// error() on the underlying or the put, see the error codes
+	SO_NO_LAST,			// the underlying sent no LAST before its batch was cancelled
+	SO_NO_CHAIN,		// the expiry's chain has no strikes for the symbol
+	SO_NO_STRIKE,		// no strike at or below the target
+	SO_NO_QUOTE,		// the put was requested but neither traded nor had a bid
+	SO_CACHED,			// not requested, the negative cache knows the underlying or the put fails
+	SO_COUNT
+};
+
+// RepDataThread's wall time, one phase at a time
+enum ScanPhase {
+	SP_SETUP,			// directories, text history import, chain files
+	SP_REQUEST,			// reqMktData of the underlyings, pacer waits included
+	SP_WAIT,			// the sleep before a batch is read
+	SP_DRAIN,			// mid results and cancels at the end of a batch
+	SP_SAVE,			// results flush and stats save
+	SP_COUNT
+};
+
+// Coverage and cost of one rate scan: the outcome of every row, the error codes behind
+// the failures, time per phase, the line-seconds the underlying and put subscriptions
+// held, requests per result and the slowest symbols. finish() writes it as JSON to
+// 波动率探索器\报告\<YYYYMMDD>_<HHMMSS>.json and prints a summary.
+class ScanReport {
+public:
+	static const int SLOWEST = 10;
+
+	ScanReport();
+
+	// nIdBase is the scan thread's JobRunner::idBase(), the ids error() sees are above it
+	void begin(int nIdBase);
+	void beginExpiry(int m, uint32_t expiry, int nSymbols);
+	void phase(ScanPhase next);
+
+	void underlyingSent(int m, int k, uint32_t symbolId);
+	void underlyingSkipped(int m, int k, uint32_t symbolId);
+	void underlyingLast(int m, int k);
+	void underlyingCancelled(int m, int k);
+	void optionSent(int m, int k);
+	void optionClosed(int m, int k);
+	// a result, or why there is no put to request
+	void outcome(int m, int k, ScanOutcome outcome);
+	// error() of any request, ids that aren't the scan's are ignored
+	void error(int reqId, int errorCode);
+	bool finish();
+
+private:
+	// GetTickCount64() milliseconds, 0 for never
+	struct Row {
+		uint32_t symbolId;
+		int outcome;			// SO_COUNT until known
+		int errorCode;
+		uint64_t underlyingSent;
+		uint64_t underlyingLast;
+		uint64_t underlyingCancelled;
+		uint64_t optionSent;
+		uint64_t optionClosed;
+		uint64_t result;
+	};
+
+	Row *row(int m, int k);
+	void phaseLocked(ScanPhase next, uint64_t now);
+
+	std::mutex m_mutex;
+	bool m_bActive;
+	int m_nIdBase;
+	uint64_t m_start;
+	uint64_t m_phaseStart;
+	ScanPhase m_phase;
+	uint64_t m_phaseMs[SP_COUNT];
+	std::vector<uint32_t> m_expiries;
+	std::vector<std::vector<Row> > m_rows;
+};
+
+#endif
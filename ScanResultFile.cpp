@@ -0,0 +1,384 @@
+﻿#include "StdAfx.h"
+
+#include "ScanResultFile.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "SymbolTable.h"
+
+#include <math.h>
+
+#include <unordered_map>
+
+namespace {
+
+enum ScanEncoding { SE_PLAIN, SE_DICT, SE_RLE, SE_DELTA, SE_SCALED };
+
+const double PRICE_SCALE = 10000;
+
+void PutU32(std::string& out, uint32_t value)
+{
+	out.append((const char *)&value, sizeof(value));
+}
+
+void PutVarint(std::string& out, uint64_t value)
+{
+	while (value >= 0x80) {
+		out.push_back((char)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((char)value);
+}
+
+uint64_t Zigzag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+int64_t Unzigzag(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+// bounds checked cursor, every read past the end sets m_bFailed
+class ByteReader {
+public:
+	ByteReader(const char *pBegin, const char *pEnd) : m_p(pBegin), m_pEnd(pEnd), m_bFailed(false) {}
+
+	bool failed() const { return m_bFailed; }
+	const char *pos() const { return m_p; }
+	size_t remaining() const { return m_pEnd - m_p; }
+
+	bool bytes(void *pOut, size_t nSize)
+	{
+		if ((size_t)(m_pEnd - m_p) < nSize) {
+			m_bFailed = true;
+			return false;
+		}
+		memcpy(pOut, m_p, nSize);
+		m_p += nSize;
+		return true;
+	}
+	uint32_t u32() { uint32_t value = 0; bytes(&value, sizeof(value)); return value; }
+	uint64_t varint()
+	{
+		uint64_t value = 0;
+		for (int nShift = 0; nShift < 64; nShift += 7) {
+			if (m_p >= m_pEnd)
+				break;
+			unsigned char c = (unsigned char)*m_p++;
+			value |= (uint64_t)(c & 0x7f) << nShift;
+			if ((c & 0x80) == 0)
+				return value;
+		}
+		m_bFailed = true;
+		return 0;
+	}
+	bool skip(size_t nSize)
+	{
+		if ((size_t)(m_pEnd - m_p) < nSize) {
+			m_bFailed = true;
+			return false;
+		}
+		m_p += nSize;
+		return true;
+	}
+
+private:
+	const char *m_p;
+	const char *m_pEnd;
+	bool m_bFailed;
+};
+
+// the double member behind each price column, SC_STRIKE to SC_IV
+double ScanResult::* const s_priceFields[SC_COUNT] = {
+	0, 0, &ScanResult::strike, &ScanResult::bid, &ScanResult::ask, &ScanResult::last,
+	&ScanResult::mid, &ScanResult::yield, &ScanResult::iv, 0
+};
+
+bool Scalable(double value)
+{
+	if (!isfinite(value) || fabs(value) > 1e14)
+		return false;
+	return (double)llround(value * PRICE_SCALE) / PRICE_SCALE == value;
+}
+
+void EncodePrices(const std::vector<ScanResult>& rows, int column, std::string& out, unsigned char& encoding)
+{
+	bool bScaled = true;
+	for (size_t i = 0; i < rows.size() && bScaled; i++)
+		bScaled = Scalable(rows[i].*s_priceFields[column]);
+	if (bScaled) {
+		encoding = SE_SCALED;
+		int64_t nPrev = 0;
+		for (size_t i = 0; i < rows.size(); i++) {
+			int64_t nValue = llround(rows[i].*s_priceFields[column] * PRICE_SCALE);
+			PutVarint(out, Zigzag(nValue - nPrev));
+			nPrev = nValue;
+		}
+	}
+	else {
+		encoding = SE_PLAIN;
+		for (size_t i = 0; i < rows.size(); i++) {
+			double value = rows[i].*s_priceFields[column];
+			out.append((const char *)&value, sizeof(value));
+		}
+	}
+}
+
+void EncodeColumn(const std::vector<ScanResult>& rows, int column, std::string& out, unsigned char& encoding)
+{
+	switch (column) {
+	case SC_SYMBOL: {
+		encoding = SE_DICT;
+		std::unordered_map<uint32_t, uint32_t> slots;
+		std::vector<uint32_t> dictionary;
+		std::string indexes;
+		for (size_t i = 0; i < rows.size(); i++) {
+			std::unordered_map<uint32_t, uint32_t>::iterator it = slots.find(rows[i].symbolId);
+			if (it == slots.end()) {
+				it = slots.insert(std::make_pair(rows[i].symbolId, (uint32_t)dictionary.size())).first;
+				dictionary.push_back(rows[i].symbolId);
+			}
+			PutVarint(indexes, it->second);
+		}
+		PutVarint(out, dictionary.size());
+		for (size_t i = 0; i < dictionary.size(); i++) {
+			const std::string& name = SymbolTable::instance().name(dictionary[i]);
+			PutVarint(out, name.size());
+			out += name;
+		}
+		out += indexes;
+		break;
+	}
+	case SC_EXPIRY: {
+		encoding = SE_RLE;
+		for (size_t i = 0; i < rows.size();) {
+			size_t nRun = 1;
+			while (i + nRun < rows.size() && rows[i + nRun].expiry == rows[i].expiry)
+				nRun++;
+			PutVarint(out, rows[i].expiry);
+			PutVarint(out, nRun);
+			i += nRun;
+		}
+		break;
+	}
+	case SC_TIMESTAMP: {
+		encoding = SE_DELTA;
+		int64_t nPrev = 0;
+		for (size_t i = 0; i < rows.size(); i++) {
+			PutVarint(out, Zigzag(rows[i].timestamp - nPrev));
+			nPrev = rows[i].timestamp;
+		}
+		break;
+	}
+	default:
+		EncodePrices(rows, column, out, encoding);
+		break;
+	}
+}
+
+bool DecodeColumn(ByteReader& in, int column, unsigned char encoding, ScanResult *pRows, uint32_t nRows)
+{
+	if (column == SC_SYMBOL && encoding == SE_DICT) {
+		// counts are checked against the bytes left before anything is allocated
+		uint64_t nCount = in.varint();
+		if (nCount > in.remaining())
+			return false;
+		std::vector<uint32_t> dictionary((size_t)nCount);
+		for (size_t i = 0; i < dictionary.size() && !in.failed(); i++) {
+			uint64_t nLength = in.varint();
+			if (nLength > in.remaining())
+				return false;
+			std::string name((size_t)nLength, 0x00);
+			if (in.bytes(&name[0], name.size()))
+				dictionary[i] = SymbolTable::instance().intern(name);
+		}
+		for (uint32_t i = 0; i < nRows && !in.failed(); i++) {
+			uint64_t nSlot = in.varint();
+			if (nSlot >= dictionary.size())
+				return false;
+			pRows[i].symbolId = dictionary[nSlot];
+		}
+	}
+	else if (column == SC_EXPIRY && encoding == SE_RLE) {
+		for (uint32_t i = 0; i < nRows && !in.failed();) {
+			uint32_t nExpiry = (uint32_t)in.varint();
+			uint64_t nRun = in.varint();
+			if (nRun == 0 || nRun > nRows - i)
+				return false;
+			for (; nRun > 0; nRun--)
+				pRows[i++].expiry = nExpiry;
+		}
+	}
+	else if (column == SC_TIMESTAMP && encoding == SE_DELTA) {
+		int64_t nValue = 0;
+		for (uint32_t i = 0; i < nRows && !in.failed(); i++) {
+			nValue += Unzigzag(in.varint());
+			pRows[i].timestamp = nValue;
+		}
+	}
+	else if (column >= SC_STRIKE && column <= SC_IV && encoding == SE_SCALED) {
+		int64_t nValue = 0;
+		for (uint32_t i = 0; i < nRows && !in.failed(); i++) {
+			nValue += Unzigzag(in.varint());
+			pRows[i].*s_priceFields[column] = nValue / PRICE_SCALE;
+		}
+	}
+	else if (column >= SC_STRIKE && column <= SC_IV && encoding == SE_PLAIN) {
+		for (uint32_t i = 0; i < nRows && !in.failed(); i++)
+			in.bytes(&(pRows[i].*s_priceFields[column]), sizeof(double));
+	}
+	else {
+		return false;
+	}
+	return !in.failed();
+}
+
+bool AppendFile(const char *pszFileName, const std::string& data)
+{
+	HANDLE hFile = CreateFile(pszFileName, GENERIC_WRITE, FILE_SHARE_READ, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	DWORD dwWrite;
+	bool bOk = true;
+	if (GetFileSize(hFile, 0) == 0) {
+		std::string header;
+		PutU32(header, SCAN_FILE_MAGIC);
+		PutU32(header, SCAN_FILE_VERSION);
+		bOk = WriteFile(hFile, header.data(), (DWORD)header.size(), &dwWrite, 0) != 0;
+	}
+	else {
+		SetFilePointer(hFile, 0, 0, FILE_END);
+	}
+	bOk = bOk && WriteFile(hFile, data.data(), (DWORD)data.size(), &dwWrite, 0) != 0;
+	CloseHandle(hFile);
+	if (bOk)
+		metrics::BytesWritten.inc(MW_SCAN, data.size());
+	return bOk;
+}
+
+} // namespace
+
+void ScanResultFileName(int nDate, char *pszFileName, size_t nSize)
+{
+	sprintf_s(pszFileName, nSize, "C:\\bighouse\\波动率探索器\\结果\\%08d.scan", nDate);
+}
+
+ScanResultWriter::ScanResultWriter()
+	: m_nDate(0)
+{
+}
+
+ScanResultWriter::~ScanResultWriter()
+{
+	flush();
+}
+
+void ScanResultWriter::add(int nDate, const ScanResult& row)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (nDate != m_nDate) {
+		flushLocked();
+		m_nDate = nDate;
+	}
+	m_rows.push_back(row);
+	if (m_rows.size() >= ROWS_PER_GROUP)
+		flushLocked();
+}
+
+void ScanResultWriter::flush()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	flushLocked();
+}
+
+void ScanResultWriter::flushLocked()
+{
+	if (m_rows.empty())
+		return;
+	TraceSpan span("scan flush", "disk", "rows", (int64_t)m_rows.size());
+	std::string group;
+	PutU32(group, SCAN_ROWGROUP_MAGIC);
+	PutU32(group, (uint32_t)m_rows.size());
+	PutU32(group, SC_COUNT);
+	std::string column;
+	for (int i = 0; i < SC_COUNT; i++) {
+		unsigned char encoding = SE_PLAIN;
+		column.clear();
+		EncodeColumn(m_rows, i, column, encoding);
+		group.push_back((char)i);
+		group.push_back((char)encoding);
+		group.append(2, 0x00);
+		PutU32(group, (uint32_t)column.size());
+		group += column;
+	}
+
+	CreateDirectory("C:\\bighouse\\波动率探索器\\结果", NULL);
+	char pszFileName[MAX_PATH];
+	ScanResultFileName(m_nDate, pszFileName, MAX_PATH);
+	if (!AppendFile(pszFileName, group))
+		printf("Scan results: can't append %lu rows to %s\n", (unsigned long)m_rows.size(), pszFileName);
+	m_rows.clear();
+}
+
+bool ScanResultReader::open(const char *pszFileName)
+{
+	if (!m_file.open(pszFileName))
+		return false;
+	ByteReader in(m_file.data(), m_file.data() + m_file.size());
+	if (in.u32() != SCAN_FILE_MAGIC || in.u32() != SCAN_FILE_VERSION) {
+		printf("%s is not a version %u scan results file\n", pszFileName, SCAN_FILE_VERSION);
+		m_file.close();
+		return false;
+	}
+	return true;
+}
+
+bool ScanResultReader::read(std::vector<ScanResult>& rows, unsigned columnMask) const
+{
+	if (m_file.size() == 0)
+		return false;
+	ByteReader in(m_file.data() + 2 * sizeof(uint32_t), m_file.data() + m_file.size());
+	while (in.pos() < m_file.data() + m_file.size()) {
+		if (in.u32() != SCAN_ROWGROUP_MAGIC)
+			return false;
+		uint32_t nRows = in.u32();
+		uint32_t nColumns = in.u32();
+		if (in.failed())
+			return false;
+		ScanResult empty;
+		empty.symbolId = INVALID_SYMBOL;
+		empty.expiry = 0;
+		empty.strike = empty.bid = empty.ask = empty.last = empty.mid = empty.yield = empty.iv = NAN;
+		empty.timestamp = 0;
+		size_t nFirst = rows.size();
+		rows.resize(nFirst + nRows, empty);
+		for (uint32_t c = 0; c < nColumns; c++) {
+			unsigned char header[4];
+			in.bytes(header, sizeof(header));
+			uint32_t nLength = in.u32();
+			if (in.failed())
+				return false;
+			ByteReader column(in.pos(), in.pos() + nLength);
+			if (!in.skip(nLength))
+				return false;
+			// unknown columns from a later writer are stepped over like unwanted ones
+			if (header[0] >= SC_COUNT || (columnMask & SCAN_COLUMN_BIT(header[0])) == 0)
+				continue;
+			if (!DecodeColumn(column, header[0], header[1], &rows[nFirst], nRows))
+				return false;
+		}
+	}
+	return true;
+}
+
+bool ExportScanResultsText(const char *pszScanFile, const char *pszTextFile)
+{
+	ScanResultReader reader;
+	std::vector<ScanResult> rows;
+	if (!reader.open(pszScanFile) || !reader.read(rows))
+		return false;
+	FILE *fp;
+	if (fopen_s(&fp, pszTextFile, "w") != 0)
+		return false;
+	for (size_t i = 0; i < rows.size(); i++) {
+		const ScanResult& row = rows[i];
+		fprintf(fp, "%s,%u,%g,%g,%g,%g,%g,%0.2f,%g,%lld\n", SymbolTable::instance().name(row.symbolId).c_str(), row.expiry,
+			row.strike, row.bid, row.ask, row.last, row.mid, row.yield, row.iv, (long long)row.timestamp);
+	}
+	fclose(fp);
+	return true;
+}
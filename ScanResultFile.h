@@ -0,0 +1,86 @@
+﻿#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_SCANRESULTFILE_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_SCANRESULTFILE_H
+
+#include "MappedFile.h"
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One rate scan result. Prices the scan did not see are NaN.
+struct ScanResult {
+	uint32_t symbolId;		// SymbolTable id, stored in the file by name
+	uint32_t expiry;		// YYYYMMDD
+	double strike;
+	double bid;
+	double ask;
+	double last;
+	double mid;
+	double yield;			// annualised put yield in percent, as in the text files
+	double iv;
+	int64_t timestamp;		// milliseconds since 1970-01-01 UTC
+};
+
+enum ScanColumn {
+	SC_SYMBOL, SC_EXPIRY, SC_STRIKE, SC_BID, SC_ASK, SC_LAST, SC_MID, SC_YIELD, SC_IV, SC_TIMESTAMP,
+	SC_COUNT
+};
+
+#define SCAN_COLUMN_BIT(column) (1u << (column))
+const unsigned SCAN_ALL_COLUMNS = (1u << SC_COUNT) - 1;
+
+// Daily results file, 波动率探索器\结果\<YYYYMMDD>.scan:
+//   "SRES" magic, u32 version
+//   row groups appended one after another, each
+//     "RGRP" magic, u32 rowCount, u32 columnCount
+//     per column: u8 column, u8 encoding, u16 0, u32 byteLength, data
+// so a reader can step over the columns it does not want. Encodings per column:
+//   symbol     dictionary of names, then a varint index per row
+//   expiry     run lengths of (varint value, varint count)
+//   timestamp  zigzag varint deltas
+//   prices     zigzag varint deltas of value * 10000 when every value in the group
+//              survives that exactly, else raw doubles
+const uint32_t SCAN_FILE_MAGIC = 0x53455253;		// "SRES"
+const uint32_t SCAN_ROWGROUP_MAGIC = 0x50524752;	// "RGRP"
+const uint32_t SCAN_FILE_VERSION = 1;
+
+void ScanResultFileName(int nDate, char *pszFileName, size_t nSize);
+
+// Buffers rows and appends them as a row group every ROWS_PER_GROUP rows, on a new
+// day and on flush(). Safe to call from the crawler and the reader thread.
+class ScanResultWriter {
+public:
+	static const size_t ROWS_PER_GROUP = 1024;
+
+	ScanResultWriter();
+	~ScanResultWriter();
+
+	void add(int nDate, const ScanResult& row);
+	void flush();
+
+private:
+	void flushLocked();
+
+	std::mutex m_mutex;
+	int m_nDate;
+	std::vector<ScanResult> m_rows;
+};
+
+class ScanResultReader {
+public:
+	bool open(const char *pszFileName);
+	// appends every row; columns outside columnMask are skipped without decoding and
+	// come back as NaN, 0 or INVALID_SYMBOL
+	bool read(std::vector<ScanResult>& rows, unsigned columnMask = SCAN_ALL_COLUMNS) const;
+
+private:
+	MappedFile m_file;
+};
+
+// The optional text view: one "symbol,expiry,strike,bid,ask,last,mid,yield,iv,timestamp" line per row.
+bool ExportScanResultsText(const char *pszScanFile, const char *pszTextFile);
+
+#endif
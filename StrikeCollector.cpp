@@ -0,0 +1,44 @@
+﻿#include "StdAfx.h"
+
+#include "StrikeCollector.h"
+#include "Contract.h"
+
+#include <algorithm>
+
+void StrikeCollector::add(int reqId, const Contract& contract)
+{
+	if (contract.right.empty() || contract.right.at(0) != 'P')
+		return;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Chain& chain = m_chains[reqId];
+	if (chain.strikes.empty()) {
+		chain.symbol = contract.symbol;
+		chain.expiry = contract.lastTradeDateOrContractMonth;
+	}
+	chain.strikes.push_back(contract.strike);
+}
+
+bool StrikeCollector::flush(int reqId)
+{
+	Chain chain;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::unordered_map<int, Chain>::iterator it = m_chains.find(reqId);
+		if (it == m_chains.end())
+			return false;
+		chain = std::move(it->second);
+		m_chains.erase(it);
+	}
+	std::sort(chain.strikes.begin(), chain.strikes.end());
+	chain.strikes.erase(std::unique(chain.strikes.begin(), chain.strikes.end()), chain.strikes.end());
+
+	// the strike crawler resumes after this row, see GetStockCount
+	m_store.put(chain.expiry, chain.symbol, chain.strikes, reqId % 10000 + 1);
+	return true;
+}
+
+void StrikeCollector::discard(int reqId)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_chains.erase(reqId);
+}
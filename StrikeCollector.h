@@ -0,0 +1,37 @@
+﻿#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_STRIKECOLLECTOR_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_STRIKECOLLECTOR_H
+
+#include "ChainStore.h"
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct Contract;
+
+// Put strikes of each reqContractDetails response, kept in memory until
+// contractDetailsEnd and then handed to the expiry's chain file (ChainStore.h).
+class StrikeCollector {
+public:
+	void add(int reqId, const Contract& contract);
+	// sorts and dedupes the chain and stores it; false when reqId had no puts
+	bool flush(int reqId);
+	void discard(int reqId);
+	// writes chains still waiting for their expiry's next periodic save
+	void save() { m_store.save(); }
+
+private:
+	struct Chain {
+		std::string symbol;
+		std::string expiry;
+		std::vector<double> strikes;
+	};
+
+	std::mutex m_mutex;
+	std::unordered_map<int, Chain> m_chains;
+	ChainStore m_store;
+};
+
+#endif
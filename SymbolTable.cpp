@@ -0,0 +1,49 @@
+#include "StdAfx.h"
+
+#include "SymbolTable.h"
+
+#include <mutex>
+
+SymbolTable& SymbolTable::instance()
+{
+	static SymbolTable table;
+	return table;
+}
+
+uint32_t SymbolTable::intern(std::string_view symbol)
+{
+	{
+		std::shared_lock<std::shared_mutex> lock(m_mutex);
+		auto it = m_ids.find(symbol);
+		if (it != m_ids.end())
+			return it->second;
+	}
+	std::unique_lock<std::shared_mutex> lock(m_mutex);
+	// another thread may have added it between the two locks
+	auto it = m_ids.find(symbol);
+	if (it != m_ids.end())
+		return it->second;
+	uint32_t id = (uint32_t)m_names.size();
+	m_names.push_back(std::string(symbol));
+	m_ids[std::string_view(m_names.back())] = id;
+	return id;
+}
+
+uint32_t SymbolTable::find(std::string_view symbol) const
+{
+	std::shared_lock<std::shared_mutex> lock(m_mutex);
+	auto it = m_ids.find(symbol);
+	return it == m_ids.end() ? INVALID_SYMBOL : it->second;
+}
+
+const std::string& SymbolTable::name(uint32_t id) const
+{
+	std::shared_lock<std::shared_mutex> lock(m_mutex);
+	return m_names[id];
+}
+
+size_t SymbolTable::size() const
+{
+	std::shared_lock<std::shared_mutex> lock(m_mutex);
+	return m_names.size();
+}
@@ -0,0 +1,34 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_SYMBOLTABLE_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_SYMBOLTABLE_H
+
+#include <stdint.h>
+
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+const uint32_t INVALID_SYMBOL = 0xffffffff;
+
+// Process wide symbol interner. Ids are dense, start at 0 and never change, and the
+// strings behind them never move, so a name() reference stays valid for the whole run.
+class SymbolTable {
+public:
+	static SymbolTable& instance();
+
+	uint32_t intern(std::string_view symbol);
+	// INVALID_SYMBOL when the symbol was never interned
+	uint32_t find(std::string_view symbol) const;
+	const std::string& name(uint32_t id) const;
+	size_t size() const;
+
+private:
+	mutable std::shared_mutex m_mutex;
+	std::deque<std::string> m_names;
+	// keys view the strings in m_names
+	std::unordered_map<std::string_view, uint32_t> m_ids;
+};
+
+#endif
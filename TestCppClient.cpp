@@ -27,6 +27,28 @@
 #include "CommonDefs.h"
 #include "AccountSummaryTags.h"
 #include "Utils.h"
+#include "JobRunner.h"
+#include "WorkerPool.h"
+#include "Universe.h"
+#include "SymbolTable.h"
+#include "ContractTemplates.h"
+#include "ContractMsg.h"
+#include "ChainStore.h"
+#include "ScanResultFile.h"
+#include "HistoryStore.h"
+#include "RollingStats.h"
+#include "FundamentalFields.h"
+#include "ReportArchive.h"
+#include "ReportIndex.h"
+#include "AsyncWriter.h"
+#include "Base64.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "Latency.h"
+#include "Trace.h"
+#include "ScanReport.h"
+#include "NegativeCache.h"
+#include "RateMath.h"
 
 #include <stdio.h>
 #include <chrono>
@@ -35,11 +57,32 @@
 #include <ctime>
 #include <fstream>
 #include <cstdint>
+#include <math.h>
 #include "biglog.h"
 
 const int PING_DEADLINE = 2; // seconds
 const int SLEEP_BETWEEN_PINGS = 30; // seconds
 
+namespace {
+
+// Hands one kind of scan request's ticks to a TestCppClient method.
+class ClientTickHandler : public TickHandler {
+public:
+	typedef void (TestCppClient::*Method)(int reqId, TickType field, double price);
+
+	ClientTickHandler(TestCppClient *pClient, Method method, TickMask mask) : m_pClient(pClient), m_method(method), m_mask(mask) {}
+
+	TickMask fields() const { return m_mask; }
+	void onTickPrice(int reqId, TickType field, double price) { (m_pClient->*m_method)(reqId, field, price); }
+
+private:
+	TestCppClient *m_pClient;
+	Method m_method;
+	TickMask m_mask;
+};
+
+}
+
 ///////////////////////////////////////////////////////////
 // member funcs
 //! [socket_init]
@@ -50,15 +93,35 @@ TestCppClient::TestCppClient() :
 	, m_sleepDeadline(0)
 	, m_orderId(0)
     , m_extraAuth(false)
+	, m_sessionStarted(false)
+	, m_pacer(40, 40) // the API allows 50 messages per second
+	, m_pJobRunner(NULL)
+	, m_bStopSender(false)
 {
+	m_pUnderlyingTicks.reset(new ClientTickHandler(this, &TestCppClient::onUnderlyingTick, TickFields({ TickType::LAST })));
+	m_pOptionTicks.reset(new ClientTickHandler(this, &TestCppClient::onOptionTick, TickFields({ TickType::BID, TickType::ASK, TickType::LAST, TickType::CLOSE })));
+	m_senderThread = std::thread(&TestCppClient::senderLoop, this);
 }
 //! [socket_init]
 TestCppClient::~TestCppClient()
 {
+	{
+		std::lock_guard<std::mutex> lock(m_outboxMutex);
+		m_bStopSender = true;
+	}
+	m_outboxWake.notify_one();
+	m_senderThread.join();
+
 	// destroy the reader before the client
 	if( m_pReader )
 		m_pReader.reset();
 
+	m_strikes.save();
+	NegativeCache::instance().save();
+	FlushAsyncWrites();
+	metrics::RequestLatency.logSummary();
+	ExportTrace("exit");
+	LogFlush();
 	delete m_pClient;
 }
 
@@ -66,6 +129,10 @@ bool TestCppClient::connect(const char *host, int port, int clientId)
 {
 	// trying to connect
 	printf( "Connecting to %s:%d clientId:%d\n", !( host && *host) ? "127.0.0.1" : host, port, clientId);
+
+	// a reconnect reuses this client, stop the reader of the previous connection first
+	if( m_pReader )
+		m_pReader.reset();
 	
 	//! [connect]
 	bool bRes = m_pClient->eConnect( host, port, clientId, m_extraAuth);
@@ -96,11 +163,259 @@ bool TestCppClient::isConnected() const
 	return m_pClient->isConnected();
 }
 
+int TestCppClient::issueRequest(RequestKind kind, const Contract& contract, const std::string& param, RequestDoneFunc onDone)
+{
+	int reqId = m_requests.add(kind, contract, param, std::move(onDone));
+	OutboxEntry entry = { false, reqId, kind, contract, param };
+	post(entry);
+	return reqId;
+}
+
+bool TestCppClient::reqMktData(TickerId tickerId, const Contract& contract, TickHandler *pHandler)
+{
+	if (NegativeCache::instance().skip(RK_MKTDATA, contract)) {
+		metrics::RequestsSkipped.inc(AC_REQMKTDATA);
+		return false;
+	}
+	int reqId = JobRunner::idBase() + (int)tickerId;
+	if (pHandler != NULL)
+		m_tickHandlers.add(reqId, pHandler);
+	m_requests.track(reqId, RK_MKTDATA, contract, "");
+	if (isConnected()) {
+		m_pacer.acquire();
+		std::lock_guard<std::mutex> lock(m_outboxMutex);
+		sendRequest(reqId, RK_MKTDATA, contract, "");
+	}
+	return true;
+}
+
+void TestCppClient::cancelMktData(TickerId tickerId)
+{
+	int reqId = JobRunner::idBase() + (int)tickerId;
+	m_tickHandlers.remove(reqId);
+	// skipped or failed requests have nothing to cancel
+	if (untrack(reqId) && isConnected()) {
+		m_pacer.acquire();
+		metrics::RequestsSent.inc(AC_CANCELMKTDATA);
+		m_pClient->cancelMktData(reqId);
+	}
+}
+
+bool TestCppClient::postMktData(int reqId, const Contract& contract, TickHandler *pHandler)
+{
+	if (NegativeCache::instance().skip(RK_MKTDATA, contract)) {
+		metrics::RequestsSkipped.inc(AC_REQMKTDATA);
+		return false;
+	}
+	if (pHandler != NULL)
+		m_tickHandlers.add(reqId, pHandler);
+	m_requests.track(reqId, RK_MKTDATA, contract, "");
+	OutboxEntry entry = { false, reqId, RK_MKTDATA, contract, "" };
+	post(entry);
+	return true;
+}
+
+void TestCppClient::postCancelMktData(int reqId)
+{
+	m_tickHandlers.remove(reqId);
+	std::lock_guard<std::mutex> lock(m_outboxMutex);
+	if (!m_requests.untrack(reqId))
+		return;
+	// a send still queued never went out, dropping it is the cancel
+	for (std::deque<OutboxEntry>::iterator it = m_outbox.begin(); it != m_outbox.end(); ++it) {
+		if (it->reqId == reqId && !it->bCancel) {
+			m_outbox.erase(it);
+			return;
+		}
+	}
+	OutboxEntry entry = { true, reqId, RK_MKTDATA, Contract(), "" };
+	m_outbox.push_back(entry);
+	m_outboxWake.notify_one();
+}
+
+bool TestCppClient::reqContractDetails(int reqId, const Contract& contract)
+{
+	if (NegativeCache::instance().skip(RK_CONTRACTDETAILS, contract)) {
+		metrics::RequestsSkipped.inc(AC_REQCONTRACTDETAILS);
+		return false;
+	}
+	reqId += JobRunner::idBase();
+	m_requests.track(reqId, RK_CONTRACTDETAILS, contract, "");
+	if (isConnected()) {
+		m_pacer.acquire();
+		std::lock_guard<std::mutex> lock(m_outboxMutex);
+		sendRequest(reqId, RK_CONTRACTDETAILS, contract, "");
+	}
+	return true;
+}
+
+bool TestCppClient::reqFundamentalData(TickerId reqId, const Contract& contract, const std::string& reportType)
+{
+	if (NegativeCache::instance().skip(RK_FUNDAMENTALS, contract)) {
+		metrics::RequestsSkipped.inc(AC_REQFUNDAMENTALDATA);
+		return false;
+	}
+	int nReqId = JobRunner::idBase() + (int)reqId;
+	m_requests.track(nReqId, RK_FUNDAMENTALS, contract, reportType);
+	if (isConnected()) {
+		m_pacer.acquire();
+		std::lock_guard<std::mutex> lock(m_outboxMutex);
+		sendRequest(nReqId, RK_FUNDAMENTALS, contract, reportType);
+	}
+	return true;
+}
+
+void TestCppClient::cancelFundamentalData(TickerId reqId)
+{
+	int nReqId = JobRunner::idBase() + (int)reqId;
+	// a reply or an error already ended it
+	if (untrack(nReqId) && isConnected()) {
+		m_pacer.acquire();
+		metrics::RequestsSent.inc(AC_CANCELFUNDAMENTALDATA);
+		m_pClient->cancelFundamentalData(nReqId);
+	}
+}
+
+// After this no retry or replay claims reqId, and the ones claimed before it went out:
+// the owner's cancel that follows can't be overtaken by a send of the same id.
+bool TestCppClient::untrack(int reqId)
+{
+	std::lock_guard<std::mutex> lock(m_outboxMutex);
+	return m_requests.untrack(reqId);
+}
+
+// under m_outboxMutex, the pacer already waited for
+void TestCppClient::sendRequest(int reqId, RequestKind kind, const Contract& contract, const std::string& param)
+{
+	// already out on this connection, or ended meanwhile
+	if (!m_requests.markSent(reqId))
+		return;
+	switch (kind) {
+		case RK_CONTRACTDETAILS:
+			metrics::RequestsSent.inc(AC_REQCONTRACTDETAILS);
+			m_pClient->reqContractDetails(reqId, contract);
+			break;
+		case RK_SNAPSHOT:
+			m_tickHandlers.rearm(reqId);
+			metrics::RequestsSent.inc(AC_REQMKTDATASNAPSHOT);
+			m_pClient->reqMktData(reqId, contract, "", true, false, TagValueListSPtr());
+			break;
+		case RK_FUNDAMENTALS:
+			metrics::RequestsSent.inc(AC_REQFUNDAMENTALDATA);
+			m_pClient->reqFundamentalData(reqId, contract, param, TagValueListSPtr());
+			break;
+		case RK_MKTDATA:
+			m_tickHandlers.rearm(reqId);
+			metrics::RequestsSent.inc(AC_REQMKTDATA);
+			m_pClient->reqMktData(reqId, contract, param, false, false, TagValueListSPtr());
+			break;
+	}
+}
+
+// Re-sends every live subscription and in-flight request under its old id, so the
+// crawler threads and awaiting coroutines carry on as if the connection never dropped.
+// Called on the EReader thread, so the requests are queued for the sender, which paces
+// them like any other send; markSent drops a second entry of the same id.
+void TestCppClient::replaySession()
+{
+	std::lock_guard<std::mutex> lock(m_outboxMutex);
+	std::vector<SessionRequest> live = m_requests.replayList();
+	printf( "Session restored, replaying %lu requests\n", (unsigned long)live.size());
+	for (size_t i = 0; i < live.size(); i++) {
+		OutboxEntry entry = { false, live[i].reqId, live[i].kind, live[i].contract, live[i].param };
+		m_outbox.push_back(entry);
+	}
+	m_outboxWake.notify_one();
+}
+
+void TestCppClient::post(const OutboxEntry& entry)
+{
+	std::lock_guard<std::mutex> lock(m_outboxMutex);
+	m_outbox.push_back(entry);
+	m_outboxWake.notify_one();
+}
+
+void TestCppClient::senderLoop()
+{
+	TraceThreadName("sender");
+	std::vector<RetryTask> tasks;
+	int64_t nextTick = TraceNow();
+	std::unique_lock<std::mutex> lock(m_outboxMutex);
+	while (!m_bStopSender) {
+		m_outboxWake.wait_for(lock, std::chrono::milliseconds(RETRY_TICK_MS), [this]() { return m_bStopSender || !m_outbox.empty(); });
+		if (!m_outbox.empty()) {
+			lock.unlock();
+			m_pacer.acquire();
+			lock.lock();
+			// a cancel posted during the wait may have taken the entry back
+			if (!m_outbox.empty()) {
+				OutboxEntry entry = std::move(m_outbox.front());
+				m_outbox.pop_front();
+				runPosted(entry);
+			}
+		}
+		if (TraceNow() < nextTick)
+			continue;
+		lock.unlock();
+		tasks.clear();
+		m_requests.expire(TraceNow(), tasks);
+		for (size_t i = 0; i < tasks.size(); i++)
+			runRetry(tasks[i]);
+		nextTick = TraceNow() + RETRY_TICK_MS * 1000;
+		lock.lock();
+	}
+}
+
+// under m_outboxMutex, so postCancelMktData() sees the send either queued or gone out
+void TestCppClient::runPosted(const OutboxEntry& entry)
+{
+	// while disconnected replaySession() sends what is still tracked
+	if (!isConnected())
+		return;
+	if (!entry.bCancel) {
+		sendRequest(entry.reqId, entry.kind, entry.contract, entry.param);
+		return;
+	}
+	metrics::RequestsSent.inc(AC_CANCELMKTDATA);
+	m_pClient->cancelMktData(entry.reqId);
+}
+
+void TestCppClient::runRetry(const RetryTask& task)
+{
+	const SessionRequest& req = task.request;
+	// while disconnected there is nothing to cancel, and replaySession() does the resend
+	if (!isConnected())
+		return;
+	m_pacer.acquire();
+	// claimed and sent under the lock, see untrack(); markSent refuses the resend and
+	// claimCancel the cancel when it was answered, replayed or cancelled since expire()
+	std::lock_guard<std::mutex> lock(m_outboxMutex);
+	if (task.action == RA_RESEND) {
+		sendRequest(req.reqId, req.kind, req.contract, req.param);
+		return;
+	}
+	if (!m_requests.claimCancel(req.reqId))
+		return;
+	if (req.kind == RK_MKTDATA) {
+		metrics::RequestsSent.inc(AC_CANCELMKTDATA);
+		m_pClient->cancelMktData(req.reqId);
+	}
+	else if (req.kind == RK_FUNDAMENTALS) {
+		metrics::RequestsSent.inc(AC_CANCELFUNDAMENTALDATA);
+		m_pClient->cancelFundamentalData(req.reqId);
+	}
+}
+
 void TestCppClient::setConnectOptions(const std::string& connectOptions)
 {
 	m_pClient->setConnectOptions(connectOptions);
 }
 
+void TestCppClient::setJobRunner(JobRunner* pJobRunner)
+{
+	m_pJobRunner = pJobRunner;
+}
+
 void TestCppClient::processMessages()
 {
 	time_t now = time(NULL);
@@ -304,6 +619,15 @@ void TestCppClient::processMessages()
 			break;
 		case ST_WHATIFSAMPLES_ACK:
 			break;
+		case ST_RUNJOBS:
+			runJobs();
+			break;
+		case ST_RUNJOBS_ACK:
+			if( m_pJobRunner->finished()) {
+				disconnect();
+				return;
+			}
+			break;
 		case ST_PING:
 			reqCurrentTime();
 			break;
@@ -332,6 +656,8 @@ void TestCppClient::processMessages()
 void TestCppClient::connectAck() {
 	if (!m_extraAuth && m_pClient->asyncEConnect())
         m_pClient->startApi();
+	if (m_sessionStarted)
+		replaySession();
 }
 //! [connectack]
 
@@ -621,20 +947,10 @@ char HKStockNameList[][64]=
 
 
 
-char StockNameList[5000][64];
 //char StockNameList[][64] =
 //{
 //	"BLUE"
 //};
-double StrikeList[20][6000];
-double NowPrice[20][6000];
-bool   bFalg[20][6000];
-
-double bidPriceList[20][6000];
-double askPriceList[20][6000];
-long long llReqTick[20][6000];
-
-bool   bReqSuc[20][6000];
 
 //char OptionDataList[][32] =
 //{
@@ -646,7 +962,7 @@ bool   bReqSuc[20][6000];
 //	"20230616",
 //	"20240119"
 //};
-char OptionDataList[][32] =
+char OptionDataList[20][32] =
 {
 	//"20220819",
 	//"20220916",
@@ -656,29 +972,18 @@ char OptionDataList[][32] =
 	//"20230616",
 	"20240119"
 };
-time_t convert(int year, int month, int day)
-{
-	tm info = { 0 };
-	info.tm_year = year - 1900;
-	info.tm_mon = month - 1;
-	info.tm_mday = day;
-	return mktime(&info);
-
-}
-int  get_days(const char* from, const char* to)
+int nOptionDataCount = 1;
+
+// the crawlers' expiries when no job's expiries= replaces them
+std::vector<std::string> DefaultExpiries()
 {
-	int year, month, day;
-	sscanf(from, "%4d%2d%2d", &year, &month, &day);
-	int fromSecond = (int)convert(year, month, day);
-	sscanf(to, "%4d%2d%2d", &year, &month, &day);
-	int toSecond = (int)convert(year, month, day);
-	return (toSecond - fromSecond) / 24 / 3600;
+	return std::vector<std::string>(OptionDataList, OptionDataList + nOptionDataCount);
 }
-int GetStockCount(int m)
+int GetStockCount(const char *pszExpiry)
 {
 	int nIndex;
 	char pszFileName[256];
-	sprintf_s(pszFileName, 256, "C:\\bighouse\\波动率探索器\\%s\\索引.txt", OptionDataList[m]);
+	sprintf_s(pszFileName, 256, "C:\\bighouse\\波动率探索器\\%s\\索引.txt", pszExpiry);
 	HANDLE hLog = gamelog::OpenLogFile(pszFileName, 2);
 	DWORD dwSize = GetFileSize(hLog, 0);
 	char *pBuf = (char *)malloc(dwSize);
@@ -695,69 +1000,131 @@ int GetStockCount(int m)
 #include <algorithm> 
 
 
-void WriteRateToFile(int mIndex,int nStockIndex,double price)
+ScanResultWriter ScanResults;
+// The rate scan running under each job id base: its expiries, their chain files and the
+// tables the callbacks fill per row, so that concurrent scan jobs keep apart; callbacks
+// find theirs from the id base of the reqId.
+struct RateScan {
+	std::vector<std::string> expiries;	// the rows of the tables, at most 20
+	// the two text files per result line, kept as an optional view of ScanResults
+	bool bTextFiles = true;
+	char StockNameList[5000][64];
+	// SymbolTable id of each StockNameList row, for ContractTemplates
+	uint32_t StockSymbolIdList[5000];
+	// strike ladders of each expiry, StockNameList row k is symbol k of the file
+	ChainFile OptionChainList[20];
+	double StrikeList[20][6000];
+	double NowPrice[20][6000];
+	bool   bFalg[20][6000];
+
+	double bidPriceList[20][6000];
+	double askPriceList[20][6000];
+	long long llReqTick[20][6000];
+	// option LAST and implied volatility of the put requested for each row, NaN until seen
+	double lastPriceList[20][6000];
+	double ivList[20][6000];
+
+	bool   bReqSuc[20][6000];
+	ScanReport report;
+};
+std::mutex RateScansMutex;
+std::map<int, std::unique_ptr<RateScan> > RateScans;
+
+RateScan& RateScanFor(int nIdBase)
+{
+	std::lock_guard<std::mutex> lock(RateScansMutex);
+	std::unique_ptr<RateScan>& pScan = RateScans[nIdBase];
+	if (!pScan)
+		pScan.reset(new RateScan());
+	return *pScan;
+}
+
+RateScan *FindRateScan(int nIdBase)
+{
+	std::lock_guard<std::mutex> lock(RateScansMutex);
+	auto it = RateScans.find(nIdBase);
+	return it != RateScans.end() ? it->second.get() : NULL;
+}
+// false when the price is too small to give a result
+bool WriteRateToFile(RateScan& scan, int mIndex,int nStockIndex,double price)
 {
 	SYSTEMTIME currentTime = { 0 };
 	GetLocalTime(&currentTime);
 	char pszInitDate[32] = "";
 	sprintf_s(pszInitDate, 32, "%04d%02d%02d", currentTime.wYear, currentTime.wMonth, currentTime.wDay);
-	int days = get_days(pszInitDate, OptionDataList[mIndex]) + 1;
+	int days = get_days(pszInitDate, scan.expiries[mIndex].c_str()) + 1;
 
 	if (price <= 0.0001)
-		return;
-	double fddd = StrikeList[mIndex][nStockIndex] - price;
-	double fRa = price / fddd;
-	double fRate = fRa * 365 / days * 100;
+		return false;
+	double fRate = PutYield(scan.StrikeList[mIndex][nStockIndex], price, days);
+
+	ScanResult row;
+	row.symbolId = scan.StockSymbolIdList[nStockIndex];
+	row.expiry = (uint32_t)atoi(scan.expiries[mIndex].c_str());
+	row.strike = scan.StrikeList[mIndex][nStockIndex];
+	row.bid = scan.bidPriceList[mIndex][nStockIndex] > 0 ? scan.bidPriceList[mIndex][nStockIndex] : NAN;
+	row.ask = scan.askPriceList[mIndex][nStockIndex] > 0 ? scan.askPriceList[mIndex][nStockIndex] : NAN;
+	row.last = scan.lastPriceList[mIndex][nStockIndex];
+	row.mid = row.bid > 0 && row.ask > 0 ? (row.bid + row.ask) / 2 : NAN;
+	row.yield = fRate;
+	row.iv = scan.ivList[mIndex][nStockIndex];
+	row.timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	ScanResults.add(atoi(pszInitDate), row);
+	metrics::ScanResults.inc(row.expiry);
+	HistoryPoint point = { row.symbolId, row.expiry, (uint32_t)atoi(pszInitDate), row.strike, price, fRate, row.iv };
+	HistoryStore::instance().append(point);
+	if (scan.NowPrice[mIndex][nStockIndex] > 0) {
+		RichnessScore score = RollingStats::instance().update(row.symbolId, days, row.strike / scan.NowPrice[mIndex][nStockIndex], fRate, row.iv);
+		if (score.count >= 5 && score.yieldRank >= 0.95)
+			printf("%s %s %g yield %0.2f is rich: z %0.1f, above %0.0f%% of its history\n",
+				scan.StockNameList[nStockIndex], scan.expiries[mIndex].c_str(), row.strike, fRate, score.yieldZ, score.yieldRank * 100);
+	}
+	if (!scan.bTextFiles)
+		return true;
+
 	char pszWrite[1024];
 	char pszFileName[256];
-	sprintf_s(pszFileName, 256, "C:\\bighouse\\波动率探索器\\%s_%s.txt", "期权利率", OptionDataList[mIndex]);
+	sprintf_s(pszFileName, 256, "C:\\bighouse\\波动率探索器\\%s_%s.txt", "期权利率", scan.expiries[mIndex].c_str());
 
-	sprintf_s(pszWrite, 1024, "%s,%g,%0.2f\n", StockNameList[nStockIndex], StrikeList[mIndex][nStockIndex], fRate);
+	FormatRateLine(pszWrite, 1024, scan.StockNameList[nStockIndex], scan.StrikeList[mIndex][nStockIndex], fRate);
 	gamelog::WriteLog(pszFileName, pszWrite);
-	sprintf_s(pszFileName, 256, "C:\\bighouse\\波动率探索器\\利率\\%s\\%s_%s.txt", OptionDataList[mIndex], OptionDataList[mIndex], pszInitDate);
+	sprintf_s(pszFileName, 256, "C:\\bighouse\\波动率探索器\\利率\\%s\\%s_%s.txt", scan.expiries[mIndex].c_str(), scan.expiries[mIndex].c_str(), pszInitDate);
 	gamelog::WriteLog(pszFileName, pszWrite);
+	return true;
+}
+// the crawlers' wait for a batch's replies, traced apart from the pacer's waits
+void BatchSleep(int nSeconds)
+{
+	TraceSpan span("sleep", "crawler", "seconds", nSeconds);
+	std::this_thread::sleep_for(std::chrono::seconds(nSeconds));
 }
-std::vector<std::string> symList;
 HANDLE hPriceFile;
 DWORD WINAPI GetMktDataThread(LPVOID lpParam)
 {
 	TestCppClient *pp = (TestCppClient *)lpParam;
-	FILE *fp;
 
 	hPriceFile = CreateFile("C:\\bighouse\\symPrice.txt", GENERIC_READ | GENERIC_WRITE,
 		FILE_SHARE_READ, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
 	if (hPriceFile == INVALID_HANDLE_VALUE)
 		return 0;
 
-	int nRet = fopen_s(&fp, "C:\\bighouse\\SharesA.txt", "r");
-	if (nRet != NULL)
+	std::shared_ptr<const Universe> pUniverse = Universe::current();
+	const std::vector<UniverseEntry>& symList = pUniverse->list(UL_SHARESA);
+	if (symList.empty())
 		return 0;
-	char pszTemp[1024] = "";
-	char pszTick[1024] = "";
-	for (;;)
-	{
-		memset(pszTick, 0x00, sizeof(pszTick));
-		if (fgets(pszTemp, 1024, fp) == NULL)
-			break;
-		char *pp=strchr(pszTemp, '|');
-		memcpy(pszTick, pszTemp, pp - pszTemp);
-		//pszTemp[strlen(pszTemp) - 1] = 0x00;
-		symList.push_back(pszTick);
-		//printf("%s\n", pszTemp);
-	}
 	int nMktId;
 	int nEachSelect = 36;
 	int nStockCount = symList.size();
 	for (int k = 0; k < nStockCount; k++)
 	{
 		nMktId = k;
-		pp->m_pClient->reqMktData(nMktId, ContractSamples::StockForQuery((char *)symList[k].data()), "", false, false, TagValueListSPtr());
+		pp->reqMktData(nMktId, ContractTemplates::stock(symList[k].symbolId));
 		if ((k + 1) % nEachSelect == 0)
 		{
 			std::this_thread::sleep_for(std::chrono::seconds(10));
 			for (int j = nMktId; j > nMktId - nEachSelect; j--)
 			{
-				pp->m_pClient->cancelMktData(j);
+				pp->cancelMktData(j);
 			}
 		}
 	}
@@ -766,183 +1133,183 @@ DWORD WINAPI GetMktDataThread(LPVOID lpParam)
 		std::this_thread::sleep_for(std::chrono::seconds(10));
 		for (int k = nMktId; k > nMktId - (nStockCount%nEachSelect); k--)
 		{
-			pp->m_pClient->cancelMktData(k);
+			pp->cancelMktData(k);
 		}
 
 	}
 	return 0;
 }
 
-int GetDataOptionList(char *pszData)
+int GetDataOptionList(RateScan& scan, int m)
 {
-	WIN32_FIND_DATA ffd;
-	HANDLE hFind;
 	int nStockCount = 0;
-	char pszFind[MAX_PATH];
+	memset(scan.StockNameList, 0x00, sizeof(scan.StockNameList));
+	ChainFile& chain = scan.OptionChainList[m];
+	// the first run after the text ladders converts them once
+	if (!chain.open(scan.expiries[m].c_str()) && !(ImportTextChains(scan.expiries[m].c_str()) && chain.open(scan.expiries[m].c_str())))
+		return nStockCount;
 
-	memset(StockNameList, 0x00, sizeof(StockNameList));
-	sprintf_s(pszFind, MAX_PATH, "C:\\bighouse\\波动率探索器\\%s\\*", pszData);
-	hFind = FindFirstFile(pszFind, &ffd);
-
-	if (INVALID_HANDLE_VALUE == hFind)
+	int nMaxCount = sizeof(scan.StockNameList) / 64;
+	if (chain.count() > nMaxCount)
+		printf("%s has %d chains, only the first %d are scanned\n", scan.expiries[m].c_str(), chain.count(), nMaxCount);
+	for (; nStockCount < chain.count() && nStockCount < nMaxCount; nStockCount++)
 	{
-		return nStockCount;
+		memcpy(scan.StockNameList[nStockCount], chain.symbol(nStockCount), strlen(chain.symbol(nStockCount)));
+		scan.StockSymbolIdList[nStockCount] = SymbolTable::instance().intern(chain.symbol(nStockCount));
 	}
-
-	// List all the files in the directory with some info about them.
-
-	do
-	{
-		if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
-		{
-			//printf(TEXT("  %s   <DIR>\n"), ffd.cFileName);
-		}
-		else
-		{
-			char pszTemp[256] = "";
-			if (strstr(ffd.cFileName, ".txt") != NULL && strstr(ffd.cFileName, "索引") == NULL)
-			{
-				memcpy(pszTemp, ffd.cFileName, strlen(ffd.cFileName) - 4);
-				memcpy(StockNameList[nStockCount], pszTemp, strlen(pszTemp));
-				//printf("%s\n", pszTemp);
-				nStockCount++;
-			}
-		}
-	} while (FindNextFile(hFind, &ffd) != 0);
-	FindClose(hFind);
 	return nStockCount;
 }
-std::vector<std::string> syNasdaq100List;
+// the universe snapshot each crawler numbered its requests from, fundamentalData
+// looks the symbol up in the same one even if the universe was reloaded meanwhile;
+// set on the crawler threads and read on the EReader thread, so only through
+// std::atomic_store and std::atomic_load
+std::shared_ptr<const Universe> pNasdaq100Universe;
+std::shared_ptr<const Universe> pSnapshotUniverse;
+std::shared_ptr<const Universe> pFinStatementsUniverse;
+// What a fundamentals crawl keeps of its replies: the configured fields, the raw XML
+// when run with raw=1, and what changed since the last crawl.
+struct FundamentalSink {
+	FundamentalReport report;
+	FundamentalTable table;
+	ReportArchiveWriter archive;
+	ReportIndex index;
+
+	explicit FundamentalSink(FundamentalReport kind) : report(kind), table(kind), index(kind) {}
+};
+FundamentalSink SnapshotSink(FR_SNAPSHOT);
+FundamentalSink FinStatementsSink(FR_FINSTATEMENTS);
 
-struct syminfo
+int Today()
 {
-	std::string name;
-	std::string exchange;
-};
+	SYSTEMTIME currentTime = { 0 };
+	GetLocalTime(&currentTime);
+	return currentTime.wYear * 10000 + currentTime.wMonth * 100 + currentTime.wDay;
+}
+
+// called on the EReader thread; the reply is parsed and stored on a worker, and kept in
+// the archive only if it differs from the last one. The EWrapper callback only lends its
+// string, so the copy the worker owns is made here, on the EReader thread; that copy is
+// all the callback pays, parsing and storing are the worker's.
+void PostFundamentalReport(FundamentalSink& sink, uint32_t symbolId, std::string_view data)
+{
+	WorkerPool::shared().post([&sink, symbolId, report = std::string(data)]() {
+		bool bChanged = sink.index.record(symbolId, report, Today());
+		sink.table.extract(symbolId, report);
+		if (bChanged && sink.archive.isOpen())
+			sink.archive.add(SymbolTable::instance().name(symbolId).c_str(), report);
+	});
+}
+// The end of a fundamentals crawl, also when it runs outside a job: the last batch, which
+// the crawl loop doesn't cancel, gets as long as a full one to answer, then what the
+// crawl kept is saved once the workers have stored every reply.
+static void SaveFundamentals(TestCppClient *pp, FundamentalSink& sink, const std::vector<int>& lastBatch)
+{
+	int nIdBase = JobRunner::idBase();
+	for (int nWait = 0; nWait < 10; nWait++)
+	{
+		size_t j = 0;
+		while (j < lastBatch.size() && !pp->m_requests.isTracked(nIdBase + lastBatch[j]))
+			j++;
+		if (j == lastBatch.size())
+			break;
+		BatchSleep(1);
+	}
+	for (size_t j = 0; j < lastBatch.size(); j++)
+		pp->cancelFundamentalData(lastBatch[j]);
+	WorkerPool::shared().wait();
+	sink.table.save(Today());
+	sink.archive.close();
+	sink.index.save();
+	NegativeCache::instance().save();
+	ExportTrace(FundamentalReportName(sink.report));
+}
 
-std::vector<syminfo> allsymList;
 DWORD WINAPI GetAllStockReportsFinStatements(LPVOID lpParam)
 {
 	TestCppClient *pp = (TestCppClient *)lpParam;
+	TraceThreadName("fin statements");
 
-	//std::vector<std::string> syNameList;
-	char pszFileName[3][256] =
-	{
-		"C:\\bighouse\\US-Stock-Symbols\\nasdaq\\nasdaq_tickers.txt",
-		"C:\\bighouse\\US-Stock-Symbols\\nyse\\nyse_tickers.txt",
-		"C:\\bighouse\\US-Stock-Symbols\\amex\\amex_tickers.txt"
-	};
-	char pszExchange[3][64] =
-	{
-		"NASDAQ",
-		"NYSE",
-		"AMEX"
-	};
-	FILE *fp;
-	for (int k = 0; k < 3; k++)
-	{
-		int nRet = fopen_s(&fp, pszFileName[k], "r");
-		if (nRet != NULL)
-			return 0;
-		char pszTick[1024] = "";
-		syminfo info;
-		for (;;)
-		{
-			memset(pszTick, 0x00, sizeof(pszTick));
-			if (fgets(pszTick, 1024, fp) == NULL)
-				break;
-			pszTick[strlen(pszTick) - 1] = 0x00;
-			info.name = pszTick;
-			info.exchange = pszExchange[k];
-			allsymList.push_back(info);
-			//printf("%s\n", pszTemp);
-		}
-		fclose(fp);
-	}
+	std::shared_ptr<const Universe> pUniverse = Universe::current();
+	std::atomic_store(&pFinStatementsUniverse, pUniverse);
+	const std::vector<UniverseEntry>& allsymList = pUniverse->list(UL_US);
 	int nStockCount = allsymList.size();
 	int nMktId;
 	int nEachSelect = 15;
 	
 	
+	// symbols whose report hasn't changed in a while are skipped, see ReportIndex.h
+	int nToday = Today();
+	int nSent = 0;
+	std::vector<int> batch;
+	int64_t batchBegin = TraceNow();
 	for (int k = 0; k < nStockCount; k++)
 	{
+		if (!FinStatementsSink.index.due(allsymList[k].symbolId, nToday))
+			continue;
 		nMktId = k + 20000;
-		pp->m_pClient->reqFundamentalData(nMktId, ContractSamples::StockForQueryExchange((char *)allsymList[k].name.data(), (char *)allsymList[k].exchange.data()),
-			"ReportsFinStatements", TagValueListSPtr());
-
-		if ((k + 1) % nEachSelect == 0)
+		if (!pp->reqFundamentalData(nMktId, ContractTemplates::stock(allsymList[k].symbolId, allsymList[k].exchange), "ReportsFinStatements"))
+			continue;
+		nSent++;
+		batch.push_back(nMktId);
+		if ((int)batch.size() == nEachSelect)
 		{
-			std::this_thread::sleep_for(std::chrono::seconds(10));
-			for (int j = nMktId; j > nMktId - nEachSelect; j--)
+			BatchSleep(10);
+			for (size_t j = 0; j < batch.size(); j++)
 			{
-				pp->m_pClient->cancelFundamentalData(j);
+				pp->cancelFundamentalData(batch[j]);
 			}
+			TraceComplete("batch", "crawler", batchBegin, TraceNow(), "symbols", nEachSelect);
+			batch.clear();
+			batchBegin = TraceNow();
 		}
 	}
-
-	
+	printf("ReportsFinStatements: requested %d of %d symbols\n", nSent, nStockCount);
+	SaveFundamentals(pp, FinStatementsSink, batch);
 	return true;
 }
 
 DWORD WINAPI GetAllStockReportsSnapshot(LPVOID lpParam)
 {
 	TestCppClient *pp = (TestCppClient *)lpParam;
+	TraceThreadName("report snapshot");
 
-	//std::vector<std::string> syNameList;
-	char pszFileName[3][256] =
-	{
-		"C:\\bighouse\\US-Stock-Symbols\\nasdaq\\nasdaq_tickers.txt",
-		"C:\\bighouse\\US-Stock-Symbols\\nyse\\nyse_tickers.txt",
-		"C:\\bighouse\\US-Stock-Symbols\\amex\\amex_tickers.txt"
-	};
-	char pszExchange[3][64] =
-	{
-		"NASDAQ",
-		"NYSE",
-		"AMEX"
-	};
-	FILE *fp;
-	for (int k = 0; k < 3; k++)
-	{
-		int nRet = fopen_s(&fp, pszFileName[k], "r");
-		if (nRet != NULL)
-			return 0;
-		char pszTick[1024] = "";
-		syminfo info;
-		for (;;)
-		{
-			memset(pszTick, 0x00, sizeof(pszTick));
-			if (fgets(pszTick, 1024, fp) == NULL)
-				break;
-			pszTick[strlen(pszTick) - 1] = 0x00;
-			info.name = pszTick;
-			info.exchange = pszExchange[k];
-			allsymList.push_back(info);
-			//printf("%s\n", pszTemp);
-		}
-		fclose(fp);
-	}
+	std::shared_ptr<const Universe> pUniverse = Universe::current();
+	std::atomic_store(&pSnapshotUniverse, pUniverse);
+	const std::vector<UniverseEntry>& allsymList = pUniverse->list(UL_US);
 	int nStockCount = allsymList.size();
 	int nMktId;
 	int nEachSelect = 15;
 
 
 	
+	// symbols whose report hasn't changed in a while are skipped, see ReportIndex.h
+	int nToday = Today();
+	int nSent = 0;
+	std::vector<int> batch;
+	int64_t batchBegin = TraceNow();
 	for (int k = 0; k < nStockCount; k++)
 	{
-		nMktId = k ;
-		pp->m_pClient->reqFundamentalData(nMktId, ContractSamples::StockForQueryExchange((char *)allsymList[k].name.data(), (char *)allsymList[k].exchange.data()),
-			"ReportSnapshot", TagValueListSPtr());
-
-		if ((k + 1) % nEachSelect == 0)
+		if (!SnapshotSink.index.due(allsymList[k].symbolId, nToday))
+			continue;
+		nMktId = k;
+		if (!pp->reqFundamentalData(nMktId, ContractTemplates::stock(allsymList[k].symbolId, allsymList[k].exchange), "ReportSnapshot"))
+			continue;
+		nSent++;
+		batch.push_back(nMktId);
+		if ((int)batch.size() == nEachSelect)
 		{
-			std::this_thread::sleep_for(std::chrono::seconds(10));
-			for (int j = nMktId; j > nMktId - nEachSelect; j--)
+			BatchSleep(10);
+			for (size_t j = 0; j < batch.size(); j++)
 			{
-				pp->m_pClient->cancelFundamentalData(j);
+				pp->cancelFundamentalData(batch[j]);
 			}
+			TraceComplete("batch", "crawler", batchBegin, TraceNow(), "symbols", nEachSelect);
+			batch.clear();
+			batchBegin = TraceNow();
 		}
 	}
+	printf("ReportSnapshot: requested %d of %d symbols\n", nSent, nStockCount);
+	SaveFundamentals(pp, SnapshotSink, batch);
 	return true;
 }
 
@@ -950,22 +1317,11 @@ DWORD WINAPI GetNasdaq100ReportSnapshot(LPVOID lpParam)
 {
 	TestCppClient *pp = (TestCppClient *)lpParam;
 
-	//std::vector<std::string> syNameList;
-	FILE *fp;
-	int nRet = fopen_s(&fp, "C:\\bighouse\\NASDAQ-100.txt", "r");
-	if (nRet != NULL)
+	std::shared_ptr<const Universe> pUniverse = Universe::current();
+	std::atomic_store(&pNasdaq100Universe, pUniverse);
+	const std::vector<UniverseEntry>& syNasdaq100List = pUniverse->list(UL_NASDAQ100);
+	if (syNasdaq100List.empty())
 		return 0;
-	char pszTick[1024] = "";
-	for (;;)
-	{
-		memset(pszTick, 0x00, sizeof(pszTick));
-		if (fgets(pszTick, 1024, fp) == NULL)
-			break;
-		pszTick[strlen(pszTick) - 1] = 0x00;
-		syNasdaq100List.push_back(pszTick);
-		//printf("%s\n", pszTemp);
-	}
-	fclose(fp);
 	int nStockCount = syNasdaq100List.size();
 	int nMktId;
 	int nEachSelect = 15;
@@ -980,14 +1336,14 @@ DWORD WINAPI GetNasdaq100ReportSnapshot(LPVOID lpParam)
 	for (int k = 0; k < nStockCount; k++)
 	{
 		nMktId = k;
-		pp->m_pClient->reqFundamentalData(nMktId, ContractSamples::StockForQueryNASDAQ((char *)syNasdaq100List[k].data()), "ReportSnapshot", TagValueListSPtr());
+		pp->reqFundamentalData(nMktId, ContractTemplates::stock(syNasdaq100List[k].symbolId, UX_NASDAQ), "ReportSnapshot");
 		
 		if ((k + 1) % nEachSelect == 0)
 		{
 			std::this_thread::sleep_for(std::chrono::seconds(10));
 			for (int j = nMktId; j > nMktId - nEachSelect; j--)
 			{
-				pp->m_pClient->cancelFundamentalData(j);
+				pp->cancelFundamentalData(j);
 			}
 		}
 	}
@@ -1025,73 +1381,151 @@ DWORD WINAPI GetNasdaq100ReportSnapshot(LPVOID lpParam)
 		}
 	}*/
 	//m_pClient->reqFundamentalData(8001, ContractSamples::USStock(), "ReportSnapshot", TagValueListSPtr());
+	return true;
+}
+// the bid/ask mid of a put that never traded, when it has a bid
+static void WriteMidRate(RateScan& scan, int m, int nStockId)
+{
+	if (scan.bReqSuc[m][nStockId] == false && scan.bFalg[m][nStockId] == true && scan.bidPriceList[m][nStockId] >= 0.001)
+	{
+		double price = (scan.bidPriceList[m][nStockId] + scan.askPriceList[m][nStockId]) / 2;
+		if (WriteRateToFile(scan, m, nStockId, price))
+			scan.report.outcome(m, nStockId, SO_RESULT_MID);
+	}
 }
+
+// A put whose quote request timed out and is being retried (RequestRegistry::expire) is
+// left out of its batch's drain and waited for here, before falling back to the mid.
+static void DrainRetriedPuts(TestCppClient *pp, RateScan& scan, int m, const std::vector<int>& deferred)
+{
+	if (deferred.empty())
+		return;
+	ScanReport& report = scan.report;
+	report.phase(SP_WAIT);
+	int nIdBase = JobRunner::idBase();
+	// every retry ends in an answer or its last deadline well before this, unless disconnected
+	for (int nWait = 0; nWait < 30; nWait++)
+	{
+		size_t i = 0;
+		while (i < deferred.size() && !pp->m_requests.retrying(nIdBase + 200000 + deferred[i]))
+			i++;
+		if (i == deferred.size())
+			break;
+		BatchSleep(1);
+	}
+	report.phase(SP_DRAIN);
+	for (size_t i = 0; i < deferred.size(); i++)
+		WriteMidRate(scan, m, deferred[i] % 10000);
+}
+
 DWORD WINAPI RepDataThread(LPVOID lpParam)
 {
 	TestCppClient *pp = (TestCppClient *)lpParam;
+	TraceThreadName("rate scan");
+	RateScan& scan = RateScanFor(JobRunner::idBase());
+	if (scan.expiries.empty())
+		scan.expiries = DefaultExpiries();
+	ScanReport& report = scan.report;
+	report.begin(JobRunner::idBase());
 	char pszFileName[256];
 	/*pp->m_pClient->reqMktData(200, ContractSamples::StockForQuery((char *)"Canaan Inc"), "", false, false, TagValueListSPtr());
 	return 1;*/
 	char pszDir[MAX_PATH];
 	sprintf_s(pszDir, 256, "C:\\bighouse\\波动率探索器\\利率");
 	CreateDirectory(pszDir, NULL);
+	// the first scan with the history store picks up the daily text files before it
+	HistoryStore::instance().importTextHistory();
 	int nMktId;
 	int nEachSelect = 36;
-	int nDataCount = sizeof(OptionDataList) / 32;
-	memset(bReqSuc, 0x00, sizeof(bReqSuc));
-	memset(askPriceList, 0x00, sizeof(askPriceList));
-	memset(bidPriceList, 0x00, sizeof(bidPriceList));
+	int nDataCount = (std::min)((int)scan.expiries.size(), 20);
+	memset(scan.bReqSuc, 0x00, sizeof(scan.bReqSuc));
+	memset(scan.askPriceList, 0x00, sizeof(scan.askPriceList));
+	memset(scan.bidPriceList, 0x00, sizeof(scan.bidPriceList));
 	//int nStockCount = sizeof(StockNameList) / 64;
 	for (int m = 0; m < nDataCount; m++)
 	{
-		sprintf_s(pszFileName, 256, "C:\\bighouse\\波动率探索器\\%s_%s.txt", "期权利率", OptionDataList[m]);
+		report.phase(SP_SETUP);
+		sprintf_s(pszFileName, 256, "C:\\bighouse\\波动率探索器\\%s_%s.txt", "期权利率", scan.expiries[m].c_str());
 		HANDLE hLog = gamelog::OpenLogFile(pszFileName, 0);
 		CloseHandle(hLog);
 
-		sprintf_s(pszDir, 256, "C:\\bighouse\\波动率探索器\\利率\\%s", OptionDataList[m]);
+		sprintf_s(pszDir, 256, "C:\\bighouse\\波动率探索器\\利率\\%s", scan.expiries[m].c_str());
 		CreateDirectory(pszDir, NULL);
 		//int nStockCount = GetStockCount(m);
 		//int nStockCount = (std::min)((int)(sizeof(StockNameList) / 64), GetStockCount(m));
-		int nStockCount = GetDataOptionList(OptionDataList[m]);
+		int nStockCount = GetDataOptionList(scan, m);
+		int nExpiry = atoi(scan.expiries[m].c_str());
+		metrics::ScanSymbols.set(nExpiry, nStockCount);
+		report.beginExpiry(m, nExpiry, nStockCount);
+		report.phase(SP_REQUEST);
+		TraceSpan expirySpan("expiry", "crawler", "expiry", nExpiry);
+		int64_t batchBegin = TraceNow();
+		// a batch of symbols all in the negative cache has nothing to wait for
+		int nBatchSent = 0;
+		std::vector<int> deferred;
 		for (int k = 0; k < nStockCount; k++)
 		{
-			bFalg[m][k] = false;
+			scan.bFalg[m][k] = false;
 			nMktId = 10000 * m + k;
-			pp->m_pClient->reqMktData(nMktId, ContractSamples::StockForQuery(StockNameList[k]), "", false, false, TagValueListSPtr());
+			if (pp->reqMktData(nMktId, ContractTemplates::stock(scan.StockSymbolIdList[k]), pp->m_pUnderlyingTicks.get())) {
+				report.underlyingSent(m, k, scan.StockSymbolIdList[k]);
+				nBatchSent++;
+			}
+			else
+				report.underlyingSkipped(m, k, scan.StockSymbolIdList[k]);
+			metrics::ScanRequested.set(nExpiry, k + 1);
 			if ((k + 1) % nEachSelect == 0)
 			{
-				std::this_thread::sleep_for(std::chrono::seconds(10));
+				report.phase(SP_WAIT);
+				if (nBatchSent > 0)
+					BatchSleep(10);
+				nBatchSent = 0;
+				report.phase(SP_DRAIN);
 				for (int j = nMktId; j > nMktId - nEachSelect; j--)
 				{
 					
-					if (bReqSuc[m][j%10000] == false && bFalg[m][j % 10000] == true && bidPriceList[m][j % 10000]>=0.001)
-					{
-						double price = (bidPriceList[m][j % 10000] + askPriceList[m][j % 10000]) / 2;
-						WriteRateToFile(m, j % 10000, price);
-					}
-					pp->m_pClient->cancelMktData(j);
+					if (pp->m_requests.retrying(JobRunner::idBase() + 200000 + j))
+						deferred.push_back(j);
+					else
+						WriteMidRate(scan, m, j % 10000);
+					pp->cancelMktData(j);
+					report.underlyingCancelled(m, j % 10000);
 				}
+				TraceComplete("batch", "crawler", batchBegin, TraceNow(), "symbols", nEachSelect);
+				batchBegin = TraceNow();
+				report.phase(SP_REQUEST);
 			}
 			/*nMktId++;*/
 		}
 		if (nStockCount%nEachSelect != 0)
 		{
-			std::this_thread::sleep_for(std::chrono::seconds(10));
+			report.phase(SP_WAIT);
+			if (nBatchSent > 0)
+				BatchSleep(10);
+			report.phase(SP_DRAIN);
 			for (int k = nMktId ; k > nMktId  - (nStockCount%nEachSelect); k--)
 			{
 			
 
-				if (bReqSuc[m][k % 10000] == false && bFalg[m][k % 10000] == true && bidPriceList[m][k % 10000] >= 0.001)
-				{
-					double price = (bidPriceList[m][k % 10000] + askPriceList[m][k % 10000]) / 2;
-					WriteRateToFile(m, k % 10000, price);
-					
-				}
-				pp->m_pClient->cancelMktData(k);
+				if (pp->m_requests.retrying(JobRunner::idBase() + 200000 + k))
+					deferred.push_back(k);
+				else
+					WriteMidRate(scan, m, k % 10000);
+				pp->cancelMktData(k);
+				report.underlyingCancelled(m, k % 10000);
 			}
+			TraceComplete("batch", "crawler", batchBegin, TraceNow(), "symbols", nStockCount % nEachSelect);
 
 		}
+		DrainRetriedPuts(pp, scan, m, deferred);
 	}
+	report.phase(SP_SAVE);
+	ScanResults.flush();
+	RollingStats::instance().save();
+	HistoryStore::instance().compactIfDue();
+	report.finish();
+	NegativeCache::instance().save();
+	ExportTrace("scan");
 	return true;
 }
 //DWORD WINAPI GetOptionStrikeListThread(LPVOID lpParam)
@@ -1142,49 +1576,40 @@ struct StListInfo
 {
 	TestCppClient *pp;
 	int mIndex;
+	const char *pszExpiry;
 };
 DWORD WINAPI GetOptionStrikeListThread(LPVOID lpParam)
 {
 	StListInfo *pInfo = (StListInfo *)lpParam;
 	TestCppClient *pp = pInfo->pp;
-	int nDataCount = sizeof(OptionDataList) / 32;
 
-	std::vector<std::string> syNameList;
-	FILE *fp;
-	int nRet = fopen_s(&fp, "C:\\bighouse\\US-Stock-Symbols\\all\\all_tickers.txt", "r");
-	if (nRet != NULL)
+	std::shared_ptr<const Universe> pUniverse = Universe::current();
+	const std::vector<UniverseEntry>& syNameList = pUniverse->list(UL_ALL);
+	if (syNameList.empty())
 		return 0;
-	char pszTick[1024] = "";
-	for (;;)
-	{
-		memset(pszTick, 0x00, sizeof(pszTick));
-		if (fgets(pszTick, 1024, fp) == NULL)
-			break;
-		pszTick[strlen(pszTick) - 1] = 0x00;
-		syNameList.push_back(pszTick);
-		//printf("%s\n", pszTemp);
-	}
-	fclose(fp);
 	int nStockCount = syNameList.size();
 	//先创建目录
 	int m = pInfo->mIndex;
 	int mIndexList[20];
 	memset(mIndexList, 0x00, sizeof(mIndexList));
 	char pszDir[MAX_PATH];
-	sprintf_s(pszDir, 256, "C:\\bighouse\\波动率探索器\\%s", OptionDataList[m]);
+	sprintf_s(pszDir, 256, "C:\\bighouse\\波动率探索器\\%s", pInfo->pszExpiry);
 	CreateDirectory(pszDir, NULL);
 		/*sprintf_s(pszDir, 256, "C:\\bighouse\\波动率探索器\\%s\\strike", OptionDataList[m]);
 		CreateDirectory(pszDir, NULL);*/
-	mIndexList[m] = GetStockCount(m);
+	mIndexList[m] = GetStockCount(pInfo->pszExpiry);
 
 
 	
+	// the pause is per 36 requests sent, symbols the negative cache skips don't count
+	int nSent = 0;
 	for (int k = mIndexList[m]; k < nStockCount; k++)
 	{
-			//如果没有找到这股票，返回200错误代码,
+			//如果没有找到这股票，返回200错误代码,记入NegativeCache,下次跳过
 			
-			pp->m_pClient->reqContractDetails(  k+m*10000, ContractSamples::OptionForQuery((char *)syNameList[k].data(), OptionDataList[m],/*"HKD"*/"USD"));
-			if((k+1)%36==0)
+			if (!pp->reqContractDetails(  k+m*10000, ContractTemplates::optionQuery(syNameList[k].symbolId, pInfo->pszExpiry)))
+				continue;
+			if((++nSent)%36==0)
 			  std::this_thread::sleep_for(std::chrono::seconds(5));
 	}
 	return true;
@@ -1194,12 +1619,13 @@ DWORD WINAPI GetOptionStrikeListThread(LPVOID lpParam)
 void TestCppClient::GetOptionStrikeList()
 {
 	DWORD ThreadID;
-	int nDataCount = sizeof(OptionDataList) / 32;
+	int nDataCount = nOptionDataCount;
 	for (int m = 0; m < nDataCount; m++)
 	{
 		StListInfo *pInfo = (StListInfo *)malloc(sizeof(StListInfo));
 		pInfo->mIndex = m;
 		pInfo->pp = this;
+		pInfo->pszExpiry = OptionDataList[m];
 		CreateThread(NULL, 0, &GetOptionStrikeListThread, (LPVOID)pInfo, 0, &ThreadID);
 		//GetOptionStrikeListThread((LPVOID)pInfo);
 	}
@@ -1208,6 +1634,210 @@ void TestCppClient::GetOptionStrikeList()
 	
 }
 
+// Jobs for the headless runner, picked with --job or --config (see JobRunner.h).
+// Each one wraps a crawler thread function above.
+// The job's own expiries=, or the built-in ones; the crawlers' tables have room for 20.
+static std::vector<std::string> JobExpiries(const JobParams& params)
+{
+	JobParams::const_iterator it = params.find("expiries");
+	std::vector<std::string> expiries = it != params.end() ? SplitJobList(it->second) : DefaultExpiries();
+	if (expiries.size() > 20)
+		expiries.resize(20);
+	return expiries;
+}
+
+class RateScanJob : public Job {
+public:
+	RateScanJob() : m_bTextFiles(true) {}
+	void configure(const JobParams& params)
+	{
+		m_expiries = JobExpiries(params);
+		// text=0 leaves only the columnar results file
+		JobParams::const_iterator it = params.find("text");
+		m_bTextFiles = it == params.end() || atoi(it->second.c_str()) != 0;
+	}
+	void run(TestCppClient* pClient)
+	{
+		RateScan& scan = RateScanFor(JobRunner::idBase());
+		scan.expiries = m_expiries;
+		scan.bTextFiles = m_bTextFiles;
+		RepDataThread(pClient);
+	}
+
+private:
+	std::vector<std::string> m_expiries;
+	bool m_bTextFiles;
+};
+
+class StrikeDiscoveryJob : public Job {
+public:
+	void configure(const JobParams& params) { m_expiries = JobExpiries(params); }
+	void run(TestCppClient* pClient)
+	{
+		// one crawler per expiry as in GetOptionStrikeList(), joined so the job ends with them
+		int nIdBase = JobRunner::idBase();
+		std::vector<StListInfo> infos(m_expiries.size());
+		std::vector<std::thread> threads;
+		for (int m = 0; m < (int)m_expiries.size(); m++)
+		{
+			infos[m].pp = pClient;
+			infos[m].mIndex = m;
+			infos[m].pszExpiry = m_expiries[m].c_str();
+			StListInfo *pInfo = &infos[m];
+			threads.push_back(std::thread([pInfo, nIdBase]() {
+				JobRunner::setIdBase(nIdBase);
+				GetOptionStrikeListThread(pInfo);
+			}));
+		}
+		for (size_t i = 0; i < threads.size(); i++)
+			threads[i].join();
+	}
+
+private:
+	std::vector<std::string> m_expiries;
+};
+
+// raw=1 keeps the XML in the crawl's archive (see ReportArchive.h), fields=<file> replaces
+// the extracted fields (see FundamentalFields.h), all=1 requests every symbol instead of
+// only those ReportIndex finds due
+static void ConfigureFundamentals(const JobParams& params, FundamentalSink& sink)
+{
+	JobParams::const_iterator it = params.find("raw");
+	if (it != params.end() && atoi(it->second.c_str()) != 0)
+	{
+		char pszFileName[MAX_PATH];
+		ReportArchiveFileName(FundamentalReportName(sink.report), Today(), pszFileName, MAX_PATH);
+		sink.archive.open(pszFileName);
+	}
+	it = params.find("fields");
+	if (it != params.end())
+		sink.table.loadFields(it->second.c_str());
+	it = params.find("all");
+	if (it != params.end())
+		sink.index.setScheduleAll(atoi(it->second.c_str()) != 0);
+}
+
+class FundamentalsSnapshotJob : public Job {
+public:
+	void configure(const JobParams& params) { ConfigureFundamentals(params, SnapshotSink); }
+	void run(TestCppClient* pClient)
+	{
+		GetAllStockReportsSnapshot(pClient);
+	}
+};
+
+class FinStatementsJob : public Job {
+public:
+	void configure(const JobParams& params) { ConfigureFundamentals(params, FinStatementsSink); }
+	void run(TestCppClient* pClient)
+	{
+		GetAllStockReportsFinStatements(pClient);
+	}
+};
+
+class Nasdaq100SnapshotJob : public Job {
+public:
+	void run(TestCppClient* pClient) { GetNasdaq100ReportSnapshot(pClient); }
+	// into the dated directory GetNasdaq100ReportSnapshot creates, not the exchange layout
+	bool onFundamentalData(int localId, std::string_view data)
+	{
+		std::shared_ptr<const Universe> pUniverse = std::atomic_load(&pNasdaq100Universe);
+		if (!pUniverse || localId < 0 || localId >= (int)pUniverse->list(UL_NASDAQ100).size())
+			return false;
+		char pszFileName[MAX_PATH];
+		SYSTEMTIME currentTime = { 0 };
+		GetLocalTime(&currentTime);
+		sprintf_s(pszFileName, MAX_PATH, "C:\\bighouse\\财务数据\\快照\\%04d%02d%02d\\%s.txt", currentTime.wYear, currentTime.wMonth, currentTime.wDay, pUniverse->list(UL_NASDAQ100)[localId].name());
+		WriteFileAsync(pszFileName, std::string(data), 0);
+		return true;
+	}
+};
+
+// Rereads the symbol files after "delay" seconds. Crawlers already running keep the
+// snapshot they started with, the ones started afterwards see the new lists.
+class UniverseReloadJob : public Job {
+public:
+	UniverseReloadJob() : m_nDelay(0) {}
+	void configure(const JobParams& params)
+	{
+		JobParams::const_iterator it = params.find("delay");
+		if (it != params.end())
+			m_nDelay = atoi(it->second.c_str());
+	}
+	void run(TestCppClient* pClient)
+	{
+		std::this_thread::sleep_for(std::chrono::seconds(m_nDelay));
+		if (!Universe::reload())
+			printf("Universe reload failed, keeping the previous symbol lists\n");
+	}
+private:
+	int m_nDelay;
+};
+
+// Times Utils::base64_decode against every Base64Decode version this CPU runs on "size"
+// MB of random bytes, best of "rounds", and checks they all decode the same. Sends nothing.
+class Base64BenchJob : public Job {
+public:
+	Base64BenchJob() : m_nSize(8), m_nRounds(5) {}
+	void configure(const JobParams& params)
+	{
+		JobParams::const_iterator it = params.find("size");
+		if (it != params.end())
+			m_nSize = (std::max)(1, atoi(it->second.c_str()));
+		it = params.find("rounds");
+		if (it != params.end())
+			m_nRounds = (std::max)(1, atoi(it->second.c_str()));
+	}
+	void run(TestCppClient* pClient)
+	{
+		std::vector<std::uint8_t> data((size_t)m_nSize << 20);
+		uint32_t seed = 2463534242u;
+		for (size_t i = 0; i < data.size(); i++)
+		{
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			data[i] = (std::uint8_t)seed;
+		}
+		std::string encoded = Base64Encode(data.data(), data.size());
+
+		report("Utils::base64_decode", encoded, data, [](const std::string& text) { return Utils::base64_decode(text); });
+		for (int impl = 0; impl < B64_COUNT; impl++)
+		{
+			if (Base64ImplSupported((Base64Impl)impl))
+				report(Base64ImplName((Base64Impl)impl), encoded, data, [impl](const std::string& text) { return Base64Decode(text, (Base64Impl)impl); });
+		}
+		printf("base64: Base64Decode uses %s\n", Base64ImplName(Base64BestImpl()));
+	}
+private:
+	template<typename Decoder>
+	void report(const char* pszName, const std::string& encoded, const std::vector<std::uint8_t>& expected, Decoder decode)
+	{
+		double fBest = 1e30;
+		bool bSame = true;
+		for (int i = 0; i < m_nRounds; i++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			std::vector<std::uint8_t> bytes = decode(encoded);
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			fBest = (std::min)(fBest, elapsed.count());
+			bSame = bSame && bytes == expected;
+		}
+		printf("base64: %-22s %8.1f MB/s%s\n", pszName, encoded.size() / fBest / 1e6, bSame ? "" : "  WRONG OUTPUT");
+	}
+
+	int m_nSize;
+	int m_nRounds;
+};
+
+static JobRegistrar<RateScanJob> s_rateScanJob("rate-scan");
+static JobRegistrar<StrikeDiscoveryJob> s_strikeDiscoveryJob("strike-discovery");
+static JobRegistrar<FundamentalsSnapshotJob> s_fundamentalsSnapshotJob("fundamentals-snapshot");
+static JobRegistrar<FinStatementsJob> s_finStatementsJob("fin-statements");
+static JobRegistrar<Nasdaq100SnapshotJob> s_nasdaq100SnapshotJob("nasdaq100-snapshot");
+static JobRegistrar<UniverseReloadJob> s_universeReloadJob("universe-reload");
+static JobRegistrar<Base64BenchJob> s_base64BenchJob("base64-bench");
+
 void TestCppClient::contractOperations()
 {
 	//if(currentTime.wHour>=21)
@@ -1254,7 +1884,7 @@ void TestCppClient::contractOperations()
 	CloseHandle(hLog);*/
 	int nMktId = 1000;
 	int nEachSelect=15;
-	int nStockCount = sizeof(StockNameList) / 64;
+	int nStockCount = 5000;
 	//m_pClient->reqMktData(nMktId, ContractSamples::StockForQuery(StockNameList[0]), "", false, false, TagValueListSPtr());
 	/*for (int k = 0; k < nStockCount; k++)
 	{
@@ -2144,6 +2774,12 @@ void TestCppClient::whatIfSamples()
     m_state = ST_WHATIFSAMPLES_ACK;
 }
 
+void TestCppClient::runJobs()
+{
+	m_pJobRunner->start(this);
+	m_state = ST_RUNJOBS_ACK;
+}
+
 
 
 //! [nextvalidid]
@@ -2151,6 +2787,14 @@ void TestCppClient::nextValidId( OrderId orderId)
 {
 	printf("Next Valid Id: %ld\n", orderId);
 	m_orderId = orderId;
+	// after a reconnect the jobs are still running and replaySession() resubscribed them
+	if (m_sessionStarted)
+		return;
+	m_sessionStarted = true;
+	if (m_pJobRunner) {
+		m_state = ST_RUNJOBS;
+		return;
+	}
 	//m_state = ST_FUNDAMENTALS;
 	m_state = ST_CONTRACTOPERATION;
 
@@ -2221,7 +2865,24 @@ void TestCppClient::currentTime( long time)
 //! [error]
 void TestCppClient::error(int id, int errorCode, const std::string& errorString)
 {
+	metrics::Responses.inc(CB_ERROR);
+	metrics::Errors.inc(errorCode);
 	printf( "Error. Id: %d, Code: %d, Msg: %s\n", id, errorCode, errorString.c_str());
+	RequestKind kind;
+	Contract contract;
+	if (id >= 0 && m_requests.lookup(id, kind, contract))
+		NegativeCache::instance().recordError(kind, contract, errorCode);
+	if (m_requests.onError(id, errorCode, errorString))
+		return;
+	if (id >= 0 && !RequestRegistry::isWarning(errorCode)) {
+		// an id no longer tracked was cancelled or failed before, e.g. 300 after a cancel
+		bool bTracked = m_requests.untrack(id);
+		m_tickHandlers.remove(id);
+		m_strikes.discard(id);
+		RateScan *pScan = bTracked ? FindRateScan(id - id % JOB_ID_SPAN) : NULL;
+		if (pScan != NULL)
+			pScan->report.error(id, errorCode);
+	}
 	/*if (id >= 1000 && id < 9000 && (errorCode==200 || errorCode ==354))
 	{
 		m_pClient->cancelMktData(id);
@@ -2238,170 +2899,108 @@ int TestCppClient::GetStrikeIndex(int nTickId)
 
 //! [tickprice]
 void TestCppClient::tickPrice( TickerId tickerId, TickType field, double price, const TickAttrib& attribs) {
-	printf( "Tick Price. Ticker Id: %ld, Field: %d, Price: %g, CanAutoExecute: %d, PastLimit: %d, PreOpen: %d\n", tickerId, (int)field, price, attribs.canAutoExecute, attribs.pastLimit, attribs.preOpen);
-	if (/*field == TickType::CLOSE || field== TickType::LAST ||*/ 1)
-	{
-		if (tickerId >= 0 && tickerId < 200000 && field == TickType::CLOSE)
-		{
-			/*int nStockId = tickerId % 10000;
-			char pszWirte[512]="";
-			sprintf_s(pszWirte, 512, "%s,%g\n", symList[nStockId].data(),price);
-			DWORD dwWrite;
-			WriteFile(hPriceFile, pszWirte, strlen(pszWirte), &dwWrite, 0);*/
-		}
-		if (tickerId>=0  && tickerId < 200000 && field == TickType::LAST)
-		{
-			
-			int nStockId = tickerId%10000;
-			int nIndex = GetStrikeIndex(tickerId);
-			NowPrice[nIndex][nStockId] = price;
-			if (bFalg[nIndex][nStockId] == true)
-				return;
-			char pszFileName[256];
-			printf("%s price\n", StockNameList[nStockId]);
-			sprintf_s(pszFileName, 256, "C:\\bighouse\\波动率探索器\\%s\\%s.txt", OptionDataList[nIndex], StockNameList[nStockId]);
-			HANDLE hLog = gamelog::OpenLogFile(pszFileName, 2);
-			DWORD dwSize = GetFileSize(hLog, 0);
-			
-			char *pBuf = (char *)malloc(dwSize);
-			DWORD dwRead;
-			ReadFile(hLog, pBuf, dwSize, &dwRead, 0);
-			int k = 0;
-			std::vector<double> priceList;
-			char pszTemp[512] = "";
-			int j = 0;
-			for (;;)
-			{
-				if (pBuf[k] == 0x00)
-					break;
-				if (pBuf[k] == 0x0a)
-				{
-					pszTemp[j] = 0x00;
-					double price = atof(pszTemp);
-					priceList.push_back(price);
-					j = 0;
-				}
-				else if (pBuf[k] != 0x0a && pBuf[k] != 0x0d)
-				{
-					pszTemp[j] = pBuf[k];
-					j++;
-				}
-				k++;
-
-
-			}
-			free(pBuf);
-			CloseHandle(hLog);
-			if (priceList.size() == 0)
-				return;
-
-			std::sort(priceList.begin(), priceList.end());
-
-			double ppp = price *0.9;
-			double target = price;
-			//股价大于1000，起跳价50 
-			//股价大于500,起跳价20
-			//股价大于200到500,起跳价10
-			//股价大于80小于200，起跳价5
-			//股价大于50小于80，起跳价2.5
-			//股价大于20小于50，起跳价1
-			//股价大于0小于20，起跳价0.5
-			double fpa[7] = { 1000,500,200,80,50,20,0 };
-			double fbb[7] = { 50,20,10,5,2.5,1,0.5 };
-			for (int k = 0; k < 7; k++)
-			{
-				if (ppp >= fpa[k])
-				{
-					double fVlaue = fmod(ppp, fbb[k]);
-					double ftemp = ppp - fVlaue;
-					if (ppp > ftemp + fbb[k] / 2)
-					{
-						ftemp += fbb[k];
-					}
-					target = ftemp;
-					break;
-
-				}
-			}
-			/*if (target>=price*0.9)
-			{
-				return;
-			}*/
-			double fStrike = 0;
-			//从列表中得出估算出最优的行权价
-			for (int k = 0; k < priceList.size(); k++)
-			{
-				if (target <= priceList[k])
-				{
-					fStrike = priceList[k];
-					break;
-				}
-			}
-			StrikeList[nIndex][nStockId] = fStrike;
-			if (fStrike > price)
-				return;
-			m_pClient->reqMktData(200000 +nIndex*10000+ nStockId, ContractSamples::USOptionContractEx(StockNameList[nStockId], OptionDataList[nIndex], fStrike), "", false, false, TagValueListSPtr());
-			bFalg[nIndex][nStockId] = true;
-			llReqTick[nIndex][nStockId] = GetTickCount64();
-			bReqSuc[nIndex][nStockId] = false;
-			//std::this_thread::sleep_for(std::chrono::seconds(10));
-
-			//m_pClient->cancelMktData(9000 + nStockId);
-		}
-		else if (tickerId >= 200000 && (field == TickType::BID || field == TickType::ASK))
-		{
-
-			int nStockId = (tickerId - 200000) % 10000;
-			int nIndex = GetStrikeIndex(tickerId - 200000);
-			if (field == TickType::BID)
-			{
-				if(price>=0)
-				  bidPriceList[nIndex][nStockId] = price;
-			}
-			else if (field == TickType::ASK)
-			{
-				if (price >= 0)
-				  askPriceList[nIndex][nStockId] = price;
-			}
-		}
-		else if (tickerId >= 200000 && field == TickType::LAST)
-		{
-
-		  
-			int nStockId = (tickerId - 200000)%10000;
-			int nIndex = GetStrikeIndex(tickerId-200000);
+	metrics::Responses.inc(CB_TICKPRICE);
+	// the first tick answers the request's deadline, its first LAST times it, before a
+	// handler cancels it; later ticks don't touch the registry
+	if (m_tickHandlers.firstTick((int)tickerId, field)) {
+		m_requests.heard((int)tickerId);
+		if (field == TickType::LAST)
+			m_requests.recordResponse((int)tickerId, RK_MKTDATA);
+	}
+	if (m_tickHandlers.dispatch((int)tickerId, field, price))
+		return;
+	if (m_requests.onTickPrice((int)tickerId, field, price))
+		return;
+	LogDebug("Tick Price. Ticker Id: %ld, Field: %d, Price: %g, CanAutoExecute: %d, PastLimit: %d, PreOpen: %d\n", tickerId, (int)field, price, attribs.canAutoExecute, attribs.pastLimit, attribs.preOpen);
+}
 
-			bReqSuc[nIndex][nStockId] = true;
-			WriteRateToFile(nIndex, nStockId, price);
-			
-			//sprintf_s(pszDir, 256, "C:\\bighouse\\波动率探索器\\利率\\%s", OptionDataList[m]);
-			//CreateDirectory(pszDir, NULL);
+// LAST of an underlying in the rate scan: picks the put strike below it and subscribes to it.
+// A job offsets its ids, the ranges are decoded from the job-local id.
+void TestCppClient::onUnderlyingTick(int reqId, TickType field, double price)
+{
+	int nIdBase = reqId - reqId % JOB_ID_SPAN;
+	int tickerId = reqId % JOB_ID_SPAN;
+	int nStockId = tickerId%10000;
+	int nIndex = GetStrikeIndex(tickerId);
+	RateScan *pScan = FindRateScan(nIdBase);
+	if (pScan == NULL)
+		return;
+	RateScan& scan = *pScan;
+	ScanReport& report = scan.report;
+	scan.NowPrice[nIndex][nStockId] = price;
+	if (scan.bFalg[nIndex][nStockId] == true)
+		return;
+	report.underlyingLast(nIndex, nStockId);
+	LogDebug("%s price\n", scan.StockNameList[nStockId]);
+	// already sorted, read straight from the mapped chain file
+	int nStrikeCount = 0;
+	const double *priceList = scan.OptionChainList[nIndex].strikes(nStockId, nStrikeCount);
+	if (nStrikeCount == 0) {
+		report.outcome(nIndex, nStockId, SO_NO_CHAIN);
+		return;
+	}
 
-			m_pClient->cancelMktData(tickerId);
-		
-			
-		}
-		else if (tickerId >= 200000 && field == TickType::CLOSE)
-		{
-		   m_pClient->cancelMktData(tickerId);
-		}
-		/*int nStockId = tickerId - 1000;
-		char pszFileName[256];
-		sprintf_s(pszFileName, 256, "C:\\bighouse\\波动率探索器\\%s.txt", nStockId);
-		HANDLE hLog = gamelog::OpenLogFile(pszFileName, 2);
-		DWORD dwSize=GetFileSize(hLog, 0);
-		char *pBuf = (char *)malloc(dwSize);*/
+	double fStrike = PickStrike(priceList, nStrikeCount, StrikeTarget(price));
+	scan.StrikeList[nIndex][nStockId] = fStrike;
+	// 0 when every strike is below the target, a strike 0 put is never listed
+	if (fStrike <= 0 || fStrike > price) {
+		report.outcome(nIndex, nStockId, SO_NO_STRIKE);
+		return;
+	}
+	if (!postMktData(nIdBase + 200000 +nIndex*10000+ nStockId, ContractTemplates::option(scan.StockSymbolIdList[nStockId], scan.expiries[nIndex].c_str(), fStrike), m_pOptionTicks.get())) {
+		report.outcome(nIndex, nStockId, SO_CACHED);
+		return;
+	}
+	report.optionSent(nIndex, nStockId);
+	scan.bFalg[nIndex][nStockId] = true;
+	scan.llReqTick[nIndex][nStockId] = GetTickCount64();
+	scan.bReqSuc[nIndex][nStockId] = false;
+	scan.lastPriceList[nIndex][nStockId] = NAN;
+	scan.ivList[nIndex][nStockId] = NAN;
+}
 
+// quotes of the option onUnderlyingTick subscribed to, 200000 above the underlying's id
+void TestCppClient::onOptionTick(int reqId, TickType field, double price)
+{
+	int nIdBase = reqId - reqId % JOB_ID_SPAN;
+	int tickerId = reqId % JOB_ID_SPAN;
+	int nStockId = (tickerId - 200000) % 10000;
+	int nIndex = GetStrikeIndex(tickerId - 200000);
+	RateScan *pScan = FindRateScan(nIdBase);
+	if (pScan == NULL)
+		return;
+	RateScan& scan = *pScan;
+	ScanReport& report = scan.report;
+	if (field == TickType::BID)
+	{
+		if (price >= 0)
+			scan.bidPriceList[nIndex][nStockId] = price;
 	}
-	/*if (tickerId >= 200000 && field != TickType::LAST)
+	else if (field == TickType::ASK)
 	{
-		m_pClient->cancelMktData(tickerId);
-	}*/
+		if (price >= 0)
+			scan.askPriceList[nIndex][nStockId] = price;
+	}
+	else if (field == TickType::LAST)
+	{
+		scan.bReqSuc[nIndex][nStockId] = true;
+		scan.lastPriceList[nIndex][nStockId] = price;
+		if (WriteRateToFile(scan, nIndex, nStockId, price))
+			report.outcome(nIndex, nStockId, SO_RESULT_LAST);
+		postCancelMktData(nIdBase + tickerId);
+		report.optionClosed(nIndex, nStockId);
+	}
+	else if (field == TickType::CLOSE)
+	{
+		postCancelMktData(nIdBase + tickerId);
+		report.optionClosed(nIndex, nStockId);
+	}
 }
 //! [tickprice]
 
 //! [ticksize]
 void TestCppClient::tickSize( TickerId tickerId, TickType field, int size) {
+	metrics::Responses.inc(CB_TICKSIZE);
 //	printf( "Tick Size. Ticker Id: %ld, Field: %d, Size: %d\n", tickerId, (int)field, size);
 }
 //! [ticksize]
@@ -2410,25 +3009,38 @@ void TestCppClient::tickSize( TickerId tickerId, TickType field, int size) {
 void TestCppClient::tickOptionComputation( TickerId tickerId, TickType tickType, int tickAttrib, double impliedVol, double delta,
                                           double optPrice, double pvDividend,
                                           double gamma, double vega, double theta, double undPrice) {
-	printf( "TickOptionComputation. Ticker Id: %ld, Type: %d, TickAttrib: %d, ImpliedVolatility: %g, Delta: %g, OptionPrice: %g, pvDividend: %g, Gamma: %g, Vega: %g, Theta: %g, Underlying Price: %g\n", tickerId, (int)tickType, tickAttrib, impliedVol, delta, optPrice, pvDividend, gamma, vega, theta, undPrice);
+	metrics::Responses.inc(CB_TICKOPTIONCOMPUTATION);
+	LogDebug("TickOptionComputation. Ticker Id: %ld, Type: %d, TickAttrib: %d, ImpliedVolatility: %g, Delta: %g, OptionPrice: %g, pvDividend: %g, Gamma: %g, Vega: %g, Theta: %g, Underlying Price: %g\n", tickerId, (int)tickType, tickAttrib, impliedVol, delta, optPrice, pvDividend, gamma, vega, theta, undPrice);
+	// the rate scan's put requests, see tickPrice; TWS sends -1 or DBL_MAX when it has no vol
+	RateScan *pScan = FindRateScan((int)(tickerId - tickerId % JOB_ID_SPAN));
+	tickerId %= JOB_ID_SPAN;
+	if (pScan != NULL && tickerId >= 200000 && impliedVol > 0 && impliedVol < 100)
+	{
+		int nStockId = (tickerId - 200000) % 10000;
+		int nIndex = GetStrikeIndex(tickerId - 200000);
+		if (nIndex < 20 && nStockId < 6000)
+			pScan->ivList[nIndex][nStockId] = impliedVol;
+	}
 }
 //! [tickoptioncomputation]
 
 //! [tickgeneric]
 void TestCppClient::tickGeneric(TickerId tickerId, TickType tickType, double value) {
-	printf( "Tick Generic. Ticker Id: %ld, Type: %d, Value: %g\n", tickerId, (int)tickType, value);
+	metrics::Responses.inc(CB_TICKGENERIC);
+	LogDebug("Tick Generic. Ticker Id: %ld, Type: %d, Value: %g\n", tickerId, (int)tickType, value);
 }
 //! [tickgeneric]
 
 //! [tickstring]
 void TestCppClient::tickString(TickerId tickerId, TickType tickType, const std::string& value) {
-	printf( "Tick String. Ticker Id: %ld, Type: %d, Value: %s\n", tickerId, (int)tickType, value.c_str());
+	metrics::Responses.inc(CB_TICKSTRING);
+	LogDebug("Tick String. Ticker Id: %ld, Type: %d, Value: %s\n", tickerId, (int)tickType, value);
 }
 //! [tickstring]
 
 void TestCppClient::tickEFP(TickerId tickerId, TickType tickType, double basisPoints, const std::string& formattedBasisPoints,
                             double totalDividends, int holdDays, const std::string& futureLastTradeDate, double dividendImpact, double dividendsToLastTradeDate) {
-	printf( "TickEFP. %ld, Type: %d, BasisPoints: %g, FormattedBasisPoints: %s, Total Dividends: %g, HoldDays: %d, Future Last Trade Date: %s, Dividend Impact: %g, Dividends To Last Trade Date: %g\n", tickerId, (int)tickType, basisPoints, formattedBasisPoints.c_str(), totalDividends, holdDays, futureLastTradeDate.c_str(), dividendImpact, dividendsToLastTradeDate);
+	LogDebug("TickEFP. %ld, Type: %d, BasisPoints: %g, FormattedBasisPoints: %s, Total Dividends: %g, HoldDays: %d, Future Last Trade Date: %s, Dividend Impact: %g, Dividends To Last Trade Date: %g\n", tickerId, (int)tickType, basisPoints, formattedBasisPoints, totalDividends, holdDays, futureLastTradeDate, dividendImpact, dividendsToLastTradeDate);
 }
 
 //! [orderstatus]
@@ -2488,145 +3100,125 @@ void TestCppClient::accountDownloadEnd(const std::string& accountName) {
 
 //! [contractdetails]
 void TestCppClient::contractDetails( int reqId, const ContractDetails& contractDetails) {
-	printf( "ContractDetails begin. ReqId: %d\n", reqId);
+	metrics::Responses.inc(CB_CONTRACTDETAILS);
+	if (m_requests.onContractDetails(reqId, contractDetails))
+		return;
+	LogDebug("ContractDetails begin. ReqId: %d\n", reqId);
 	printContractMsg(reqId,contractDetails.contract);
 	printContractDetailsMsg(contractDetails);
 
 	
-	printf( "ContractDetails end. ReqId: %d\n", reqId);
+	LogDebug("ContractDetails end. ReqId: %d\n", reqId);
 }
 //! [contractdetails]
 
 //! [bondcontractdetails]
 void TestCppClient::bondContractDetails( int reqId, const ContractDetails& contractDetails) {
-	printf( "BondContractDetails begin. ReqId: %d\n", reqId);
+	LogDebug("BondContractDetails begin. ReqId: %d\n", reqId);
 	printBondContractDetailsMsg(contractDetails);
-	printf( "BondContractDetails end. ReqId: %d\n", reqId);
+	LogDebug("BondContractDetails end. ReqId: %d\n", reqId);
 }
 //! [bondcontractdetails]
 using namespace std;
-bool FileExists(const string& filename) {
-	ifstream file(filename.c_str());
-	return file.good();
-}
-
 void TestCppClient::printContractMsg(int reqId,const Contract& contract) {
-	char pszWrite[1024];
-	char pszFileName[256];
-	sprintf_s(pszFileName,256, "C:\\bighouse\\波动率探索器\\%s\\%s.txt", contract.lastTradeDateOrContractMonth.c_str(),contract.symbol.c_str());
-	if (contract.right.at(0) == 'P')
-	{
-
-		if (!FileExists(pszFileName))
-		{
-			HANDLE hLog = gamelog::OpenLogFile(pszFileName, 0);
-			CloseHandle(hLog);
-		}
-
-		sprintf_s(pszWrite, 1024, "%g\n",contract.strike);
-		gamelog::WriteLog(pszFileName, pszWrite);
-	
-
-		sprintf_s(pszFileName, 256, "C:\\bighouse\\波动率探索器\\%s\\索引.txt", contract.lastTradeDateOrContractMonth.c_str());
-		sprintf_s(pszWrite, 1024, "%d", reqId%10000+1);
-		gamelog::WriteLog(pszFileName, pszWrite,2);
-	}
+	// puts are written as one chain file at contractDetailsEnd
+	m_strikes.add(reqId, contract);
 	//gamelog::WriteLog()
 	//gamelog::OpenLogFile(pszFileName, 0);
-	printf("\tConId: %ld\n", contract.conId);
-	printf("\tSymbol: %s\n", contract.symbol.c_str());
-	printf("\tSecType: %s\n", contract.secType.c_str());
-	printf("\tLastTradeDateOrContractMonth: %s\n", contract.lastTradeDateOrContractMonth.c_str());
-	printf("\tStrike: %g\n", contract.strike);
-	printf("\tRight: %s\n", contract.right.c_str());
-	printf("\tMultiplier: %s\n", contract.multiplier.c_str());
-	printf("\tExchange: %s\n", contract.exchange.c_str());
-	printf("\tPrimaryExchange: %s\n", contract.primaryExchange.c_str());
-	printf("\tCurrency: %s\n", contract.currency.c_str());
-	printf("\tLocalSymbol: %s\n", contract.localSymbol.c_str());
-	printf("\tTradingClass: %s\n", contract.tradingClass.c_str());
+	FormatContractMsg(contract, [](const char *pszFormat, auto value) { LogDebug(pszFormat, value); });
 }
 
 void TestCppClient::printContractDetailsMsg(const ContractDetails& contractDetails) {
-	printf("\tMarketName: %s\n", contractDetails.marketName.c_str());
-	printf("\tMinTick: %g\n", contractDetails.minTick);
-	printf("\tPriceMagnifier: %ld\n", contractDetails.priceMagnifier);
-	printf("\tOrderTypes: %s\n", contractDetails.orderTypes.c_str());
-	printf("\tValidExchanges: %s\n", contractDetails.validExchanges.c_str());
-	printf("\tUnderConId: %d\n", contractDetails.underConId);
-	printf("\tLongName: %s\n", contractDetails.longName.c_str());
-	printf("\tContractMonth: %s\n", contractDetails.contractMonth.c_str());
-	printf("\tIndystry: %s\n", contractDetails.industry.c_str());
-	printf("\tCategory: %s\n", contractDetails.category.c_str());
-	printf("\tSubCategory: %s\n", contractDetails.subcategory.c_str());
-	printf("\tTimeZoneId: %s\n", contractDetails.timeZoneId.c_str());
-	printf("\tTradingHours: %s\n", contractDetails.tradingHours.c_str());
-	printf("\tLiquidHours: %s\n", contractDetails.liquidHours.c_str());
-	printf("\tEvRule: %s\n", contractDetails.evRule.c_str());
-	printf("\tEvMultiplier: %g\n", contractDetails.evMultiplier);
-	printf("\tMdSizeMultiplier: %d\n", contractDetails.mdSizeMultiplier);
-	printf("\tAggGroup: %d\n", contractDetails.aggGroup);
-	printf("\tUnderSymbol: %s\n", contractDetails.underSymbol.c_str());
-	printf("\tUnderSecType: %s\n", contractDetails.underSecType.c_str());
-	printf("\tMarketRuleIds: %s\n", contractDetails.marketRuleIds.c_str());
-	printf("\tRealExpirationDate: %s\n", contractDetails.realExpirationDate.c_str());
-	printf("\tLastTradeTime: %s\n", contractDetails.lastTradeTime.c_str());
-	printf("\tStockType: %s\n", contractDetails.stockType.c_str());
+	LogDebug("\tMarketName: %s\n", contractDetails.marketName);
+	LogDebug("\tMinTick: %g\n", contractDetails.minTick);
+	LogDebug("\tPriceMagnifier: %ld\n", contractDetails.priceMagnifier);
+	LogDebug("\tOrderTypes: %s\n", contractDetails.orderTypes);
+	LogDebug("\tValidExchanges: %s\n", contractDetails.validExchanges);
+	LogDebug("\tUnderConId: %d\n", contractDetails.underConId);
+	LogDebug("\tLongName: %s\n", contractDetails.longName);
+	LogDebug("\tContractMonth: %s\n", contractDetails.contractMonth);
+	LogDebug("\tIndystry: %s\n", contractDetails.industry);
+	LogDebug("\tCategory: %s\n", contractDetails.category);
+	LogDebug("\tSubCategory: %s\n", contractDetails.subcategory);
+	LogDebug("\tTimeZoneId: %s\n", contractDetails.timeZoneId);
+	LogDebug("\tTradingHours: %s\n", contractDetails.tradingHours);
+	LogDebug("\tLiquidHours: %s\n", contractDetails.liquidHours);
+	LogDebug("\tEvRule: %s\n", contractDetails.evRule);
+	LogDebug("\tEvMultiplier: %g\n", contractDetails.evMultiplier);
+	LogDebug("\tMdSizeMultiplier: %d\n", contractDetails.mdSizeMultiplier);
+	LogDebug("\tAggGroup: %d\n", contractDetails.aggGroup);
+	LogDebug("\tUnderSymbol: %s\n", contractDetails.underSymbol);
+	LogDebug("\tUnderSecType: %s\n", contractDetails.underSecType);
+	LogDebug("\tMarketRuleIds: %s\n", contractDetails.marketRuleIds);
+	LogDebug("\tRealExpirationDate: %s\n", contractDetails.realExpirationDate);
+	LogDebug("\tLastTradeTime: %s\n", contractDetails.lastTradeTime);
+	LogDebug("\tStockType: %s\n", contractDetails.stockType);
 	printContractDetailsSecIdList(contractDetails.secIdList);
 }
 
 void TestCppClient::printContractDetailsSecIdList(const TagValueListSPtr &secIdList) {
 	const int secIdListCount = secIdList.get() ? secIdList->size() : 0;
 	if (secIdListCount > 0) {
-		printf("\tSecIdList: {");
+		LogDebug("\tSecIdList: {");
 		for (int i = 0; i < secIdListCount; ++i) {
 			const TagValue* tagValue = ((*secIdList)[i]).get();
-			printf("%s=%s;",tagValue->tag.c_str(), tagValue->value.c_str());
+			LogDebug("%s=%s;",tagValue->tag, tagValue->value);
 		}
-		printf("}\n");
+		LogDebug("}\n");
 	}
 }
 
 void TestCppClient::printBondContractDetailsMsg(const ContractDetails& contractDetails) {
-	printf("\tSymbol: %s\n", contractDetails.contract.symbol.c_str());
-	printf("\tSecType: %s\n", contractDetails.contract.secType.c_str());
-	printf("\tCusip: %s\n", contractDetails.cusip.c_str());
-	printf("\tCoupon: %g\n", contractDetails.coupon);
-	printf("\tMaturity: %s\n", contractDetails.maturity.c_str());
-	printf("\tIssueDate: %s\n", contractDetails.issueDate.c_str());
-	printf("\tRatings: %s\n", contractDetails.ratings.c_str());
-	printf("\tBondType: %s\n", contractDetails.bondType.c_str());
-	printf("\tCouponType: %s\n", contractDetails.couponType.c_str());
-	printf("\tConvertible: %s\n", contractDetails.convertible ? "yes" : "no");
-	printf("\tCallable: %s\n", contractDetails.callable ? "yes" : "no");
-	printf("\tPutable: %s\n", contractDetails.putable ? "yes" : "no");
-	printf("\tDescAppend: %s\n", contractDetails.descAppend.c_str());
-	printf("\tExchange: %s\n", contractDetails.contract.exchange.c_str());
-	printf("\tCurrency: %s\n", contractDetails.contract.currency.c_str());
-	printf("\tMarketName: %s\n", contractDetails.marketName.c_str());
-	printf("\tTradingClass: %s\n", contractDetails.contract.tradingClass.c_str());
-	printf("\tConId: %ld\n", contractDetails.contract.conId);
-	printf("\tMinTick: %g\n", contractDetails.minTick);
-	printf("\tMdSizeMultiplier: %d\n", contractDetails.mdSizeMultiplier);
-	printf("\tOrderTypes: %s\n", contractDetails.orderTypes.c_str());
-	printf("\tValidExchanges: %s\n", contractDetails.validExchanges.c_str());
-	printf("\tNextOptionDate: %s\n", contractDetails.nextOptionDate.c_str());
-	printf("\tNextOptionType: %s\n", contractDetails.nextOptionType.c_str());
-	printf("\tNextOptionPartial: %s\n", contractDetails.nextOptionPartial ? "yes" : "no");
-	printf("\tNotes: %s\n", contractDetails.notes.c_str());
-	printf("\tLong Name: %s\n", contractDetails.longName.c_str());
-	printf("\tEvRule: %s\n", contractDetails.evRule.c_str());
-	printf("\tEvMultiplier: %g\n", contractDetails.evMultiplier);
-	printf("\tAggGroup: %d\n", contractDetails.aggGroup);
-	printf("\tMarketRuleIds: %s\n", contractDetails.marketRuleIds.c_str());
-	printf("\tTimeZoneId: %s\n", contractDetails.timeZoneId.c_str());
-	printf("\tLastTradeTime: %s\n", contractDetails.lastTradeTime.c_str());
+	LogDebug("\tSymbol: %s\n", contractDetails.contract.symbol);
+	LogDebug("\tSecType: %s\n", contractDetails.contract.secType);
+	LogDebug("\tCusip: %s\n", contractDetails.cusip);
+	LogDebug("\tCoupon: %g\n", contractDetails.coupon);
+	LogDebug("\tMaturity: %s\n", contractDetails.maturity);
+	LogDebug("\tIssueDate: %s\n", contractDetails.issueDate);
+	LogDebug("\tRatings: %s\n", contractDetails.ratings);
+	LogDebug("\tBondType: %s\n", contractDetails.bondType);
+	LogDebug("\tCouponType: %s\n", contractDetails.couponType);
+	LogDebug("\tConvertible: %s\n", contractDetails.convertible ? "yes" : "no");
+	LogDebug("\tCallable: %s\n", contractDetails.callable ? "yes" : "no");
+	LogDebug("\tPutable: %s\n", contractDetails.putable ? "yes" : "no");
+	LogDebug("\tDescAppend: %s\n", contractDetails.descAppend);
+	LogDebug("\tExchange: %s\n", contractDetails.contract.exchange);
+	LogDebug("\tCurrency: %s\n", contractDetails.contract.currency);
+	LogDebug("\tMarketName: %s\n", contractDetails.marketName);
+	LogDebug("\tTradingClass: %s\n", contractDetails.contract.tradingClass);
+	LogDebug("\tConId: %ld\n", contractDetails.contract.conId);
+	LogDebug("\tMinTick: %g\n", contractDetails.minTick);
+	LogDebug("\tMdSizeMultiplier: %d\n", contractDetails.mdSizeMultiplier);
+	LogDebug("\tOrderTypes: %s\n", contractDetails.orderTypes);
+	LogDebug("\tValidExchanges: %s\n", contractDetails.validExchanges);
+	LogDebug("\tNextOptionDate: %s\n", contractDetails.nextOptionDate);
+	LogDebug("\tNextOptionType: %s\n", contractDetails.nextOptionType);
+	LogDebug("\tNextOptionPartial: %s\n", contractDetails.nextOptionPartial ? "yes" : "no");
+	LogDebug("\tNotes: %s\n", contractDetails.notes);
+	LogDebug("\tLong Name: %s\n", contractDetails.longName);
+	LogDebug("\tEvRule: %s\n", contractDetails.evRule);
+	LogDebug("\tEvMultiplier: %g\n", contractDetails.evMultiplier);
+	LogDebug("\tAggGroup: %d\n", contractDetails.aggGroup);
+	LogDebug("\tMarketRuleIds: %s\n", contractDetails.marketRuleIds);
+	LogDebug("\tTimeZoneId: %s\n", contractDetails.timeZoneId);
+	LogDebug("\tLastTradeTime: %s\n", contractDetails.lastTradeTime);
 	printContractDetailsSecIdList(contractDetails.secIdList);
 }
 
 //! [contractdetailsend]
 void TestCppClient::contractDetailsEnd( int reqId) {
-	printf( "ContractDetailsEnd. %d\n", reqId);
+	metrics::Responses.inc(CB_CONTRACTDETAILSEND);
+	m_requests.recordResponse(reqId, RK_CONTRACTDETAILS);
+	if (m_requests.finish(reqId))
+		return;
+	RequestKind kind;
+	Contract contract;
+	bool bTracked = m_requests.lookup(reqId, kind, contract);
+	m_requests.untrack(reqId);
+	// an option chain query that found no puts for the expiry
+	if (!m_strikes.flush(reqId) && bTracked && contract.secType == "OPT")
+		NegativeCache::instance().record(contract, NR_NO_OPTIONS, RK_CONTRACTDETAILS);
+	LogDebug("ContractDetailsEnd. %d\n", reqId);
 }
 //! [contractdetailsend]
 
@@ -2645,14 +3237,14 @@ void TestCppClient::execDetailsEnd( int reqId) {
 //! [updatemktdepth]
 void TestCppClient::updateMktDepth(TickerId id, int position, int operation, int side,
                                    double price, int size) {
-	printf( "UpdateMarketDepth. %ld - Position: %d, Operation: %d, Side: %d, Price: %g, Size: %d\n", id, position, operation, side, price, size);
+	LogDebug("UpdateMarketDepth. %ld - Position: %d, Operation: %d, Side: %d, Price: %g, Size: %d\n", id, position, operation, side, price, size);
 }
 //! [updatemktdepth]
 
 //! [updatemktdepthl2]
 void TestCppClient::updateMktDepthL2(TickerId id, int position, const std::string& marketMaker, int operation,
                                      int side, double price, int size, bool isSmartDepth) {
-	printf( "UpdateMarketDepthL2. %ld - Position: %d, Operation: %d, Side: %d, Price: %g, Size: %d, isSmartDepth: %d\n", id, position, operation, side, price, size, isSmartDepth);
+	LogDebug("UpdateMarketDepthL2. %ld - Position: %d, Operation: %d, Side: %d, Price: %g, Size: %d, isSmartDepth: %d\n", id, position, operation, side, price, size, isSmartDepth);
 }
 //! [updatemktdepthl2]
 
@@ -2676,7 +3268,8 @@ void TestCppClient::receiveFA(faDataType pFaDataType, const std::string& cxml) {
 
 //! [historicaldata]
 void TestCppClient::historicalData(TickerId reqId, const Bar& bar) {
-	printf( "HistoricalData. ReqId: %ld - Date: %s, Open: %g, High: %g, Low: %g, Close: %g, Volume: %lld, Count: %d, WAP: %g\n", reqId, bar.time.c_str(), bar.open, bar.high, bar.low, bar.close, bar.volume, bar.count, bar.wap);
+	metrics::Responses.inc(CB_HISTORICALDATA);
+	LogDebug("HistoricalData. ReqId: %ld - Date: %s, Open: %g, High: %g, Low: %g, Close: %g, Volume: %lld, Count: %d, WAP: %g\n", reqId, bar.time, bar.open, bar.high, bar.low, bar.close, bar.volume, bar.count, bar.wap);
 }
 //! [historicaldata]
 
@@ -2709,12 +3302,21 @@ void TestCppClient::scannerDataEnd(int reqId) {
 //! [realtimebar]
 void TestCppClient::realtimeBar(TickerId reqId, long time, double open, double high, double low, double close,
                                 long volume, double wap, int count) {
-	printf( "RealTimeBars. %ld - Time: %ld, Open: %g, High: %g, Low: %g, Close: %g, Volume: %ld, Count: %d, WAP: %g\n", reqId, time, open, high, low, close, volume, count, wap);
+	LogDebug("RealTimeBars. %ld - Time: %ld, Open: %g, High: %g, Low: %g, Close: %g, Volume: %ld, Count: %d, WAP: %g\n", reqId, time, open, high, low, close, volume, count, wap);
 }
 //! [realtimebar]
 
 //! [fundamentaldata]
 void TestCppClient::fundamentalData(TickerId reqId, const std::string& data) {
+	metrics::Responses.inc(CB_FUNDAMENTALDATA);
+	metrics::ReportBytes.observe(data.size());
+	m_requests.recordResponse((int)reqId, RK_FUNDAMENTALS);
+	if (m_requests.onFundamentalData((int)reqId, data))
+		return;
+	m_requests.untrack((int)reqId);
+	if (m_pJobRunner && m_pJobRunner->dispatchFundamentalData((int)reqId, data))
+		return;
+	reqId %= JOB_ID_SPAN;
 	//printf( "FundamentalData. ReqId: %ld, %s\n", reqId, data.c_str());
 	char pszDir[MAX_PATH];
 	SYSTEMTIME currentTime = { 0 };
@@ -2723,21 +3325,31 @@ void TestCppClient::fundamentalData(TickerId reqId, const std::string& data) {
 	sprintf_s(pszInitDate, 32, "%04d%02d%02d", currentTime.wYear, currentTime.wMonth, currentTime.wDay);
 	if (reqId < 10000)
 	{
-		sprintf_s(pszDir, 256, "C:\\bighouse\\美股财务数据\\快照\\%s\\%s.txt", (char *)allsymList[reqId].exchange.data(), (char *)allsymList[reqId].name.data());
-		gamelog::WriteLog(pszDir, (char *)data.c_str(),0);
+		std::shared_ptr<const Universe> pUniverse = std::atomic_load(&pSnapshotUniverse);
+		if (!pUniverse || reqId >= (TickerId)pUniverse->list(UL_US).size())
+			return;
+		const UniverseEntry& sym = pUniverse->list(UL_US)[reqId];
+		PostFundamentalReport(SnapshotSink, sym.symbolId, data);
 		printf("快照. ReqId: %ld\n", reqId);
 	}
 	else if (reqId < 20000)
 	{
-		sprintf_s(pszDir, 256, "C:\\bighouse\\财务数据\\ReportsFinSummary\\%s\\%s.txt", pszInitDate, (char *)syNasdaq100List[reqId-10000].data());
-		gamelog::WriteLog(pszDir, (char *)data.c_str(),0);
+		std::shared_ptr<const Universe> pUniverse = std::atomic_load(&pNasdaq100Universe);
+		if (!pUniverse || reqId - 10000 >= (TickerId)pUniverse->list(UL_NASDAQ100).size())
+			return;
+		sprintf_s(pszDir, 256, "C:\\bighouse\\财务数据\\ReportsFinSummary\\%s\\%s.txt", pszInitDate, pUniverse->list(UL_NASDAQ100)[reqId-10000].name());
+		// copied once here, the callback's string is only lent; the write is the writer thread's
+		WriteFileAsync(pszDir, data, 0);
 	}
 	else
 	{
 
 		int nIndex = reqId - 20000;
-		sprintf_s(pszDir, 256, "C:\\bighouse\\美股财务数据\\ReportsFinStatements\\%s\\%s.txt", (char *)allsymList[nIndex].exchange.data(),(char *)allsymList[nIndex].name.data());
-	    gamelog::WriteLog(pszDir, (char *)data.c_str(),0);
+		std::shared_ptr<const Universe> pUniverse = std::atomic_load(&pFinStatementsUniverse);
+		if (!pUniverse || nIndex >= (int)pUniverse->list(UL_US).size())
+			return;
+		const UniverseEntry& sym = pUniverse->list(UL_US)[nIndex];
+		PostFundamentalReport(FinStatementsSink, sym.symbolId, data);
 		printf("FundamentalData. ReqId: %ld\n", reqId);
     }
 
@@ -2751,6 +3363,10 @@ void TestCppClient::deltaNeutralValidation(int reqId, const DeltaNeutralContract
 
 //! [ticksnapshotend]
 void TestCppClient::tickSnapshotEnd(int reqId) {
+	metrics::Responses.inc(CB_TICKSNAPSHOTEND);
+	m_requests.recordResponse(reqId, RK_SNAPSHOT);
+	if (m_requests.finish(reqId))
+		return;
 	printf( "TickSnapshotEnd: %d\n", reqId);
 }
 //! [ticksnapshotend]
@@ -2946,6 +3562,7 @@ void TestCppClient::newsProviders(const std::vector<NewsProvider> &newsProviders
 
 //! [newsArticle]
 void TestCppClient::newsArticle(int requestId, int articleType, const std::string& articleText) {
+	metrics::Responses.inc(CB_NEWSARTICLE);
 	printf("News Article. Request Id: %d, Article Type: %d\n", requestId, articleType);
 	if (articleType == 0) {
 		printf("News Article Text (text or html): %s\n", articleText.c_str());
@@ -2963,10 +3580,12 @@ void TestCppClient::newsArticle(int requestId, int articleType, const std::strin
 			}
 			path = s + std::string("/MST$06f53098.pdf");
 		#endif
-		std::vector<std::uint8_t> bytes = Utils::base64_decode(articleText);
-		std::ofstream outfile(path, std::ios::out | std::ios::binary); 
-		outfile.write((const char*)bytes.data(), bytes.size());
-		printf("Binary/pdf article was saved to: %s\n", path.c_str());
+		// a multi-MB article decodes on a worker instead of holding up the ticks behind it
+		WorkerPool::shared().post([path, articleText]() {
+			std::vector<std::uint8_t> bytes = Base64Decode(articleText);
+			printf("Binary/pdf article of %u bytes is being saved to: %s\n", (unsigned)bytes.size(), path.c_str());
+			WriteFileAsync(path, std::move(bytes), 0);
+		});
 	}
 }
 //! [newsArticle]
@@ -8,11 +8,20 @@
 #include "EWrapper.h"
 #include "EReaderOSSignal.h"
 #include "EReader.h"
+#include "RequestRegistry.h"
+#include "Pacer.h"
+#include "StrikeCollector.h"
+#include "TickHandlers.h"
 
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 class EClientSocket;
+class JobRunner;
 
 enum State {
 	ST_CONNECT,
@@ -102,10 +111,21 @@ enum State {
     ST_REQTICKBYTICKDATA_ACK,
 	ST_WHATIFSAMPLES,
 	ST_WHATIFSAMPLES_ACK,
+	ST_RUNJOBS,
+	ST_RUNJOBS_ACK,
 	ST_IDLE
 };
 
 //! [ewrapperimpl]
+// a send or a cancel a callback left for the sender thread
+struct OutboxEntry {
+	bool bCancel;
+	int reqId;
+	RequestKind kind;
+	Contract contract;
+	std::string param;
+};
+
 class TestCppClient : public EWrapper
 {
 //! [ewrapperimpl]
@@ -115,6 +135,8 @@ public:
 	~TestCppClient();
 
 	void setConnectOptions(const std::string&);
+	// headless mode: run these jobs right after nextValidId instead of the samples
+	void setJobRunner(JobRunner* pJobRunner);
 	void processMessages();
 
 public:
@@ -123,6 +145,26 @@ public:
 	void disconnect() const;
 	bool isConnected() const;
 
+	// registers the request, then posts its send to the sender thread, so a coroutine
+	// resumed on the message processing thread never waits for the pacer there; onDone
+	// runs on the message processing thread
+	int issueRequest(RequestKind kind, const Contract& contract, const std::string& param, RequestDoneFunc onDone);
+
+	// Request calls for the crawler threads. They are paced by m_pacer, offset by the
+	// calling job's id base, tracked in m_requests and re-sent after a reconnect or a
+	// timeout (RequestRegistry::retryPolicy); while disconnected they are only tracked.
+	// pHandler, if any, gets the request's tickPrice.
+	// They return false, sending nothing, when NegativeCache knows the request fails.
+	bool reqMktData(TickerId tickerId, const Contract& contract, TickHandler *pHandler = NULL);
+	void cancelMktData(TickerId tickerId);
+	bool reqContractDetails(int reqId, const Contract& contract);
+	bool reqFundamentalData(TickerId reqId, const Contract& contract, const std::string& reportType);
+	void cancelFundamentalData(TickerId reqId);
+	// The same for the callbacks on the message processing thread, reqId already offset:
+	// the request is tracked at once and its paced send left to the sender thread.
+	bool postMktData(int reqId, const Contract& contract, TickHandler *pHandler);
+	void postCancelMktData(int reqId);
+
 private:
     void pnlOperation();
     void pnlSingleOperation();
@@ -165,12 +207,26 @@ private:
     void reqHistoricalTicks();
     void reqTickByTickData();
 	void whatIfSamples();
+	void runJobs();
 
 	void reqCurrentTime();
 
 	void GetOptionStrikeList();
 	int GetStrikeIndex(int nTickId);
 
+	bool untrack(int reqId);
+	void sendRequest(int reqId, RequestKind kind, const Contract& contract, const std::string& param);
+	// tickPrice of the rate scan's underlying and option requests
+	void onUnderlyingTick(int reqId, TickType field, double price);
+	void onOptionTick(int reqId, TickType field, double price);
+	void replaySession();
+	// sends what the callbacks posted and runs the deadlines and retries of m_requests
+	// every RETRY_TICK_MS, until destruction
+	void senderLoop();
+	void post(const OutboxEntry& entry);
+	void runPosted(const OutboxEntry& entry);
+	void runRetry(const RetryTask& task);
+
 public:
 	// events
 	#include "EWrapper_prototypes.h"
@@ -194,6 +250,25 @@ public:
 	std::unique_ptr<EReader> m_pReader;
     bool m_extraAuth;
 	std::string m_bboExchange;
+
+	RequestRegistry m_requests;
+	bool m_sessionStarted;
+	Pacer m_pacer;
+	StrikeCollector m_strikes;
+	TickHandlerTable m_tickHandlers;
+	std::unique_ptr<TickHandler> m_pUnderlyingTicks;
+	std::unique_ptr<TickHandler> m_pOptionTicks;
+	JobRunner* m_pJobRunner;
+
+private:
+	// held around each claim of an id and its socket call (sendRequest, runRetry), around
+	// replaySession's replayList and around the owner's untrack, so those go out in a
+	// consistent order; also orders a posted cancel against the queued send it cancels
+	std::mutex m_outboxMutex;
+	std::condition_variable m_outboxWake;
+	std::deque<OutboxEntry> m_outbox;
+	bool m_bStopSender;
+	std::thread m_senderThread;
 };
 
 #endif
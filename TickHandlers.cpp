@@ -0,0 +1,108 @@
+#include "StdAfx.h"
+
+#include "TickHandlers.h"
+#include "RequestRegistry.h"
+
+TickMask TickFields(std::initializer_list<TickType> fields)
+{
+	TickMask mask = { { 0, 0 } };
+	for (TickType field : fields) {
+		int nField = (int)field;
+		if (nField >= 0 && nField < 128)
+			mask.bits[nField >> 6] |= 1ull << (nField & 63);
+	}
+	return mask;
+}
+
+TickHandlerTable::TickHandlerTable()
+	: m_nPageCount((REGISTRY_FIRST_REQID + PAGE_SIZE - 1) / PAGE_SIZE)
+	, m_pages(new std::atomic<Slot *>[m_nPageCount])
+{
+	for (int i = 0; i < m_nPageCount; i++)
+		m_pages[i].store(NULL, std::memory_order_relaxed);
+}
+
+TickHandlerTable::~TickHandlerTable()
+{
+	for (int i = 0; i < m_nPageCount; i++)
+		delete[] m_pages[i].load(std::memory_order_relaxed);
+	delete[] m_pages;
+}
+
+TickHandlerTable::Slot *TickHandlerTable::slot(int reqId) const
+{
+	if (reqId < 0 || reqId >= REGISTRY_FIRST_REQID)
+		return NULL;
+	Slot *pPage = m_pages[reqId >> PAGE_BITS].load(std::memory_order_acquire);
+	if (pPage == NULL)
+		return NULL;
+	return &pPage[reqId & (PAGE_SIZE - 1)];
+}
+
+bool TickHandlerTable::add(int reqId, TickHandler *pHandler)
+{
+	if (reqId < 0 || reqId >= REGISTRY_FIRST_REQID)
+		return false;
+	Slot *pSlot = slot(reqId);
+	if (pSlot == NULL) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::atomic<Slot *>& page = m_pages[reqId >> PAGE_BITS];
+		if (page.load(std::memory_order_relaxed) == NULL) {
+			Slot *pPage = new Slot[PAGE_SIZE];
+			for (int i = 0; i < PAGE_SIZE; i++) {
+				pPage[i].pHandler.store(NULL, std::memory_order_relaxed);
+				pPage[i].mask[0].store(0, std::memory_order_relaxed);
+				pPage[i].mask[1].store(0, std::memory_order_relaxed);
+				pPage[i].seen.store(0, std::memory_order_relaxed);
+			}
+			page.store(pPage, std::memory_order_release);
+		}
+		pSlot = slot(reqId);
+	}
+	TickMask mask = pHandler->fields();
+	pSlot->mask[0].store(mask.bits[0], std::memory_order_relaxed);
+	pSlot->mask[1].store(mask.bits[1], std::memory_order_relaxed);
+	pSlot->seen.store(0, std::memory_order_relaxed);
+	pSlot->pHandler.store(pHandler, std::memory_order_release);
+	return true;
+}
+
+void TickHandlerTable::remove(int reqId)
+{
+	Slot *pSlot = slot(reqId);
+	if (pSlot != NULL)
+		pSlot->pHandler.store(NULL, std::memory_order_release);
+}
+
+bool TickHandlerTable::dispatch(int reqId, TickType field, double price)
+{
+	Slot *pSlot = slot(reqId);
+	if (pSlot == NULL)
+		return false;
+	TickHandler *pHandler = pSlot->pHandler.load(std::memory_order_acquire);
+	if (pHandler == NULL)
+		return false;
+	TickMask mask = { { pSlot->mask[0].load(std::memory_order_relaxed), pSlot->mask[1].load(std::memory_order_relaxed) } };
+	if (mask.has((int)field))
+		pHandler->onTickPrice(reqId, field, price);
+	return true;
+}
+
+bool TickHandlerTable::firstTick(int reqId, TickType field)
+{
+	Slot *pSlot = slot(reqId);
+	if (pSlot == NULL)
+		return true;
+	uint8_t want = field == TickType::LAST ? SEEN_ANY | SEEN_LAST : SEEN_ANY;
+	// after the first ticks only this load, no write to the shared line
+	if ((pSlot->seen.load(std::memory_order_relaxed) & want) == want)
+		return false;
+	return (pSlot->seen.fetch_or(want, std::memory_order_relaxed) & want) != want;
+}
+
+void TickHandlerTable::rearm(int reqId)
+{
+	Slot *pSlot = slot(reqId);
+	if (pSlot != NULL)
+		pSlot->seen.store(0, std::memory_order_relaxed);
+}
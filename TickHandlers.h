@@ -0,0 +1,71 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_TICKHANDLERS_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_TICKHANDLERS_H
+
+#include "EWrapper.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <initializer_list>
+#include <mutex>
+
+// A set of TickType values. The enum runs past 64, hence two words.
+struct TickMask {
+	uint64_t bits[2];
+
+	bool has(int field) const { return field >= 0 && field < 128 && ((bits[field >> 6] >> (field & 63)) & 1) != 0; }
+};
+
+TickMask TickFields(std::initializer_list<TickType> fields);
+
+// Handles tickPrice for the market data requests it was registered with.
+class TickHandler {
+public:
+	virtual ~TickHandler() {}
+
+	// ticks of other types never reach onTickPrice
+	virtual TickMask fields() const = 0;
+	virtual void onTickPrice(int reqId, TickType field, double price) = 0;
+};
+
+// reqId -> handler for the market data requests below REGISTRY_FIRST_REQID, in pages of
+// PAGE_SIZE slots allocated as ids get used. Registering happens on the requesting
+// thread, dispatch on the message thread without a lock.
+class TickHandlerTable {
+public:
+	static const int PAGE_BITS = 12;
+	static const int PAGE_SIZE = 1 << PAGE_BITS;
+
+	TickHandlerTable();
+	~TickHandlerTable();
+
+	// before the request is sent; the handler must outlive the request
+	bool add(int reqId, TickHandler *pHandler);
+	void remove(int reqId);
+	// true when reqId has a handler, whether or not it wanted this field
+	bool dispatch(int reqId, TickType field, double price);
+	// True for the first tick of a send and for its first LAST, so the registry is only
+	// locked for those; also for any tick of an id that has no slot. rearm() as the
+	// request goes out.
+	bool firstTick(int reqId, TickType field);
+	void rearm(int reqId);
+
+private:
+	struct Slot {
+		std::atomic<TickHandler *> pHandler;
+		std::atomic<uint64_t> mask[2];
+		std::atomic<uint8_t> seen;		// SEEN_ bits since the last rearm()
+	};
+
+	static const uint8_t SEEN_ANY = 1;
+	static const uint8_t SEEN_LAST = 2;
+
+	Slot *slot(int reqId) const;
+
+	std::mutex m_mutex;
+	int m_nPageCount;
+	std::atomic<Slot *> *m_pages;
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "StdAfx.h"
+
+#include "TimerWheel.h"
+
+namespace {
+
+const int64_t ROOT_SIZE = 1 << 8;
+const int64_t LEVEL_SIZE = 1 << 6;
+// ticks the top level reaches, further deadlines are parked at its far end
+const int64_t HORIZON = (int64_t)1 << 26;
+
+int LevelShift(int nLevel)
+{
+	return 8 + 6 * (nLevel - 1);
+}
+
+int LevelBase(int nLevel)
+{
+	return (int)(ROOT_SIZE + (nLevel - 1) * LEVEL_SIZE);
+}
+
+}
+
+TimerWheel::TimerWheel(int64_t tickLength, int64_t now)
+	: m_tickLength(tickLength)
+	, m_current(now / tickLength)
+	, m_free(-1)
+	, m_nCount(0)
+{
+	for (int i = 0; i < SLOTS; i++)
+		m_slots[i] = -1;
+}
+
+TimerWheel::TimerId TimerWheel::schedule(int64_t deadline, uint64_t payload)
+{
+	int32_t node = m_free;
+	if (node >= 0)
+		m_free = m_nodes[node].next;
+	else {
+		node = (int32_t)m_nodes.size();
+		Node empty = { 0, 0, -1, -1, -1, 1 };
+		m_nodes.push_back(empty);
+	}
+	Node& n = m_nodes[node];
+	// rounded up, a timer never fires before its deadline
+	n.expires = (deadline + m_tickLength - 1) / m_tickLength;
+	if (n.expires <= m_current)
+		n.expires = m_current + 1;
+	n.payload = payload;
+	insert(node);
+	m_nCount++;
+	return ((uint64_t)n.generation << 32) | (uint32_t)node;
+}
+
+bool TimerWheel::cancel(TimerId id)
+{
+	uint32_t node = (uint32_t)id;
+	if (node >= m_nodes.size())
+		return false;
+	Node& n = m_nodes[node];
+	if (n.slot < 0 || n.generation != (uint32_t)(id >> 32))
+		return false;
+	unlink((int32_t)node);
+	release((int32_t)node);
+	return true;
+}
+
+void TimerWheel::advance(int64_t now, std::vector<uint64_t>& expired)
+{
+	int64_t target = now / m_tickLength;
+	while (m_current < target) {
+		// nothing left to cascade or fire, skip the idle ticks
+		if (m_nCount == 0) {
+			m_current = target;
+			break;
+		}
+		m_current++;
+		if ((m_current & (ROOT_SIZE - 1)) == 0) {
+			// the highest level whose slot turns over on this tick, then down from it
+			int nTop = 1;
+			while (nTop < LEVELS - 1 && (m_current & (((int64_t)1 << LevelShift(nTop + 1)) - 1)) == 0)
+				nTop++;
+			for (int nLevel = nTop; nLevel >= 1; nLevel--)
+				cascade(nLevel);
+		}
+		int32_t slot = (int32_t)(m_current & (ROOT_SIZE - 1));
+		int32_t node = m_slots[slot];
+		m_slots[slot] = -1;
+		while (node >= 0) {
+			int32_t next = m_nodes[node].next;
+			expired.push_back(m_nodes[node].payload);
+			release(node);
+			node = next;
+		}
+	}
+}
+
+void TimerWheel::insert(int32_t node)
+{
+	Node& n = m_nodes[node];
+	// only a cascade inserts a deadline that is due now, into the slot about to fire
+	int64_t expires = n.expires < m_current ? m_current : n.expires;
+	int64_t delta = expires - m_current;
+	int32_t slot;
+	if (delta < ROOT_SIZE)
+		slot = (int32_t)(expires & (ROOT_SIZE - 1));
+	else {
+		if (delta >= HORIZON)
+			expires = m_current + HORIZON - 1;
+		int nLevel = 1;
+		while (nLevel < LEVELS - 1 && (expires - m_current) >= ((int64_t)1 << LevelShift(nLevel + 1)))
+			nLevel++;
+		slot = LevelBase(nLevel) + (int32_t)((expires >> LevelShift(nLevel)) & (LEVEL_SIZE - 1));
+	}
+	n.slot = slot;
+	n.prev = -1;
+	n.next = m_slots[slot];
+	if (n.next >= 0)
+		m_nodes[n.next].prev = node;
+	m_slots[slot] = node;
+}
+
+void TimerWheel::unlink(int32_t node)
+{
+	Node& n = m_nodes[node];
+	if (n.prev >= 0)
+		m_nodes[n.prev].next = n.next;
+	else
+		m_slots[n.slot] = n.next;
+	if (n.next >= 0)
+		m_nodes[n.next].prev = n.prev;
+}
+
+void TimerWheel::release(int32_t node)
+{
+	Node& n = m_nodes[node];
+	n.slot = -1;
+	if (++n.generation == 0)
+		n.generation = 1;
+	n.next = m_free;
+	m_free = node;
+	m_nCount--;
+}
+
+void TimerWheel::cascade(int nLevel)
+{
+	int32_t slot = LevelBase(nLevel) + (int32_t)((m_current >> LevelShift(nLevel)) & (LEVEL_SIZE - 1));
+	int32_t node = m_slots[slot];
+	m_slots[slot] = -1;
+	while (node >= 0) {
+		int32_t next = m_nodes[node].next;
+		insert(node);
+		node = next;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_TIMERWHEEL_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_TIMERWHEEL_H
+
+#include <cstddef>
+#include <stdint.h>
+
+#include <vector>
+
+// Hierarchical timer wheel: 256 slots of one tick, then three levels of 64 slots each
+// covering 64 times the level below, about 38 days at 50ms ticks; later deadlines wait
+// in the last level and move down as it turns. Schedule and cancel are O(1), timers are
+// nodes of one vector linked into their slot. Not thread safe, the owner locks.
+class TimerWheel {
+public:
+	typedef uint64_t TimerId;	// 0 is never a timer
+
+	// times are in the caller's unit, TraceNow() microseconds for the registry
+	TimerWheel(int64_t tickLength, int64_t now);
+
+	// fires at the first advance() past deadline, a deadline already past on the next one
+	TimerId schedule(int64_t deadline, uint64_t payload);
+	// false when the timer already fired or was cancelled
+	bool cancel(TimerId id);
+	// appends the payloads of the timers due by now, in deadline order by tick
+	void advance(int64_t now, std::vector<uint64_t>& expired);
+
+	size_t size() const { return m_nCount; }
+
+private:
+	static const int ROOT_BITS = 8;
+	static const int LEVEL_BITS = 6;
+	static const int LEVELS = 4;
+	static const int SLOTS = (1 << ROOT_BITS) + (LEVELS - 1) * (1 << LEVEL_BITS);
+
+	struct Node {
+		int64_t expires;		// in ticks
+		uint64_t payload;
+		int32_t prev;			// -1 at either end of a slot
+		int32_t next;
+		int32_t slot;			// -1 while free
+		uint32_t generation;	// bumped on free, so a stale TimerId misses
+	};
+
+	void insert(int32_t node);
+	void unlink(int32_t node);
+	void release(int32_t node);
+	void cascade(int nLevel);
+
+	int64_t m_tickLength;
+	int64_t m_current;			// last tick advance() processed
+	std::vector<Node> m_nodes;
+	int32_t m_free;				// free list through Node::next
+	size_t m_nCount;
+	int32_t m_slots[SLOTS];
+};
+
+#endif
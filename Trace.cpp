@@ -0,0 +1,228 @@
+#include "StdAfx.h"
+
+#include "Trace.h"
+
+#include <chrono>
+#include <mutex>
+#include <string>
+
+std::atomic<bool> g_bTraceEnabled(false);
+
+namespace metrics {
+	Counter TraceDropped("tws_trace_dropped_total", "Trace spans dropped because a thread's buffer was full.");
+}
+
+namespace {
+
+// One thread writes a buffer, ExportTrace reads it: the writer publishes events by
+// advancing m_head, the export frees them by advancing m_tail. Chunks are allocated as
+// the ring first reaches them and kept, so a thread that records little costs little.
+class TraceBuffer {
+public:
+	static const int CHUNK_BITS = 10;
+	static const int CHUNK_SIZE = 1 << CHUNK_BITS;
+	static const int CHUNKS = 64;
+	static const uint64_t CAPACITY = (uint64_t)CHUNK_SIZE * CHUNKS;
+
+	explicit TraceBuffer(int nTid) : m_head(0), m_tail(0), m_bOwned(true), m_nTid(nTid), m_pNext(NULL)
+	{
+		for (int i = 0; i < CHUNKS; i++)
+			m_chunks[i].store(NULL, std::memory_order_relaxed);
+		m_szName[0] = '\0';
+	}
+
+	void push(const TraceEvent& event)
+	{
+		uint64_t head = m_head.load(std::memory_order_relaxed);
+		if (head - m_tail.load(std::memory_order_acquire) >= CAPACITY) {
+			metrics::TraceDropped.inc();
+			return;
+		}
+		std::atomic<TraceEvent*>& chunk = m_chunks[(head >> CHUNK_BITS) % CHUNKS];
+		TraceEvent *pChunk = chunk.load(std::memory_order_relaxed);
+		if (pChunk == NULL) {
+			pChunk = new TraceEvent[CHUNK_SIZE];
+			chunk.store(pChunk, std::memory_order_relaxed);
+		}
+		pChunk[head & (CHUNK_SIZE - 1)] = event;
+		m_head.store(head + 1, std::memory_order_release);
+	}
+
+	const TraceEvent& at(uint64_t n) const
+	{
+		return m_chunks[(n >> CHUNK_BITS) % CHUNKS].load(std::memory_order_relaxed)[n & (CHUNK_SIZE - 1)];
+	}
+
+	std::atomic<TraceEvent*> m_chunks[CHUNKS];
+	std::atomic<uint64_t> m_head;
+	std::atomic<uint64_t> m_tail;
+	// a thread that exits hands its buffer to the next new thread once it is exported
+	std::atomic<bool> m_bOwned;
+	int m_nTid;
+	char m_szName[32];		// under g_mutex
+	TraceBuffer *m_pNext;
+};
+
+std::atomic<TraceBuffer*> g_pBuffers(NULL);
+std::atomic<int> g_nNextTid(1);
+// serialises exports and thread names
+std::mutex g_mutex;
+std::string g_dir;
+int64_t g_origin = 0;
+int g_nExports = 0;
+
+TraceBuffer *AcquireBuffer(const char *pszName)
+{
+	for (TraceBuffer *p = g_pBuffers.load(std::memory_order_acquire); p != NULL; p = p->m_pNext) {
+		bool bOwned = false;
+		if (p->m_head.load(std::memory_order_acquire) == p->m_tail.load(std::memory_order_acquire)
+			&& p->m_bOwned.compare_exchange_strong(bOwned, true, std::memory_order_acquire)) {
+			std::lock_guard<std::mutex> lock(g_mutex);
+			sprintf_s(p->m_szName, sizeof(p->m_szName), "%s", pszName != NULL ? pszName : "");
+			return p;
+		}
+	}
+	TraceBuffer *p = new TraceBuffer(g_nNextTid.fetch_add(1, std::memory_order_relaxed));
+	if (pszName != NULL)
+		sprintf_s(p->m_szName, sizeof(p->m_szName), "%s", pszName);
+	TraceBuffer *pHead = g_pBuffers.load(std::memory_order_relaxed);
+	do {
+		p->m_pNext = pHead;
+	} while (!g_pBuffers.compare_exchange_weak(pHead, p, std::memory_order_release, std::memory_order_relaxed));
+	return p;
+}
+
+struct ThreadBuffer {
+	TraceBuffer *pBuffer;
+	const char *pszName;
+
+	ThreadBuffer() : pBuffer(NULL), pszName(NULL) {}
+	~ThreadBuffer()
+	{
+		if (pBuffer != NULL)
+			pBuffer->m_bOwned.store(false, std::memory_order_release);
+	}
+};
+
+thread_local ThreadBuffer t_buffer;
+
+TraceBuffer& CurrentBuffer()
+{
+	if (t_buffer.pBuffer == NULL)
+		t_buffer.pBuffer = AcquireBuffer(t_buffer.pszName);
+	return *t_buffer.pBuffer;
+}
+
+void AppendEvent(std::string& out, const TraceEvent& event, int nTid)
+{
+	char pszLine[512];
+	long long ts = (long long)(event.begin - g_origin);
+	if (event.bAsync) {
+		snprintf(pszLine, sizeof(pszLine),
+			",\n{\"ph\":\"b\",\"name\":\"%s\",\"cat\":\"%s\",\"id\":%lld,\"ts\":%lld,\"pid\":1,\"tid\":%d}"
+			",\n{\"ph\":\"e\",\"name\":\"%s\",\"cat\":\"%s\",\"id\":%lld,\"ts\":%lld,\"pid\":1,\"tid\":%d}",
+			event.pszName, event.pszCategory, (long long)event.value, ts, nTid,
+			event.pszName, event.pszCategory, (long long)event.value, ts + (long long)event.duration, nTid);
+	}
+	else if (event.pszArg != NULL) {
+		snprintf(pszLine, sizeof(pszLine),
+			",\n{\"ph\":\"X\",\"name\":\"%s\",\"cat\":\"%s\",\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":%d,\"args\":{\"%s\":%lld}}",
+			event.pszName, event.pszCategory, ts, (long long)event.duration, nTid, event.pszArg, (long long)event.value);
+	}
+	else {
+		snprintf(pszLine, sizeof(pszLine),
+			",\n{\"ph\":\"X\",\"name\":\"%s\",\"cat\":\"%s\",\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":%d}",
+			event.pszName, event.pszCategory, ts, (long long)event.duration, nTid);
+	}
+	out += pszLine;
+}
+
+}
+
+int64_t TraceNow()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void StartTrace(const char *pszDir)
+{
+	{
+		std::lock_guard<std::mutex> lock(g_mutex);
+		g_dir = pszDir;
+		g_origin = TraceNow();
+	}
+	CreateDirectory(pszDir, NULL);
+	g_bTraceEnabled.store(true, std::memory_order_relaxed);
+}
+
+void TraceThreadName(const char *pszName)
+{
+	t_buffer.pszName = pszName;
+	if (t_buffer.pBuffer == NULL)
+		return;
+	std::lock_guard<std::mutex> lock(g_mutex);
+	sprintf_s(t_buffer.pBuffer->m_szName, sizeof(t_buffer.pBuffer->m_szName), "%s", pszName);
+}
+
+void TraceComplete(const char *pszName, const char *pszCategory, int64_t begin, int64_t end, const char *pszArg, int64_t value)
+{
+	if (!TraceEnabled())
+		return;
+	TraceEvent event = { pszName, pszCategory, pszArg, begin, end - begin, value, false };
+	CurrentBuffer().push(event);
+}
+
+void TraceAsync(const char *pszName, const char *pszCategory, int64_t id, int64_t begin, int64_t end)
+{
+	if (!TraceEnabled())
+		return;
+	TraceEvent event = { pszName, pszCategory, NULL, begin, end - begin, id, true };
+	CurrentBuffer().push(event);
+}
+
+bool ExportTrace(const char *pszName)
+{
+	if (!TraceEnabled())
+		return true;
+	std::lock_guard<std::mutex> lock(g_mutex);
+	std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+		"{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"TestCppClient\"}}";
+	size_t nEvents = 0;
+	for (TraceBuffer *p = g_pBuffers.load(std::memory_order_acquire); p != NULL; p = p->m_pNext) {
+		uint64_t head = p->m_head.load(std::memory_order_acquire);
+		uint64_t tail = p->m_tail.load(std::memory_order_relaxed);
+		if (p->m_szName[0] != '\0') {
+			char pszLine[128];
+			snprintf(pszLine, sizeof(pszLine), ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+				p->m_nTid, p->m_szName);
+			out += pszLine;
+		}
+		for (uint64_t n = tail; n != head; n++)
+			AppendEvent(out, p->at(n), p->m_nTid);
+		nEvents += (size_t)(head - tail);
+		p->m_tail.store(head, std::memory_order_release);
+	}
+	out += "\n]}\n";
+	if (nEvents == 0)
+		return true;
+
+	SYSTEMTIME currentTime = {};
+	GetLocalTime(&currentTime);
+	char pszFileName[MAX_PATH];
+	sprintf_s(pszFileName, MAX_PATH, "%s\\%s_%04d%02d%02d_%02d%02d%02d_%d.json", g_dir.c_str(), pszName,
+		currentTime.wYear, currentTime.wMonth, currentTime.wDay, currentTime.wHour, currentTime.wMinute, currentTime.wSecond, ++g_nExports);
+	HANDLE hFile = CreateFile(pszFileName, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		printf("Trace: can't create %s\n", pszFileName);
+		return false;
+	}
+	DWORD dwWrite;
+	bool bOk = WriteFile(hFile, out.data(), (DWORD)out.size(), &dwWrite, 0) != 0;
+	CloseHandle(hFile);
+	if (!bOk) {
+		printf("Trace: can't write %s\n", pszFileName);
+		return false;
+	}
+	printf("Trace: %lu spans to %s\n", (unsigned long)nEvents, pszFileName);
+	return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_TRACE_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_TRACE_H
+
+#include "Metrics.h"
+
+#include <stdint.h>
+
+#include <atomic>
+
+// Spans recorded per thread and exported as Chrome trace-event JSON, to open in Perfetto
+// or chrome://tracing. Off until StartTrace; while off a span costs one relaxed load,
+// while on two clock reads and a store into the thread's own buffer, without locks.
+// Names and categories must be string literals: the export reads them later.
+struct TraceEvent {
+	const char *pszName;
+	const char *pszCategory;
+	const char *pszArg;		// name of value in the span's args, NULL for none
+	int64_t begin;			// TraceNow() microseconds
+	int64_t duration;
+	int64_t value;			// the argument, or the id of an async span
+	bool bAsync;			// a request that began on one thread and ended on another
+};
+
+extern std::atomic<bool> g_bTraceEnabled;
+
+inline bool TraceEnabled() { return g_bTraceEnabled.load(std::memory_order_relaxed); }
+// steady clock microseconds, the clock RequestRegistry stamps requests with
+int64_t TraceNow();
+
+// exports go to pszDir\<name>_<YYYYMMDD>_<HHMMSS>_<n>.json, n counting this run's exports
+void StartTrace(const char *pszDir);
+// the thread's row title in the viewer, kept even while tracing is off
+void TraceThreadName(const char *pszName);
+void TraceComplete(const char *pszName, const char *pszCategory, int64_t begin, int64_t end, const char *pszArg = NULL, int64_t value = 0);
+void TraceAsync(const char *pszName, const char *pszCategory, int64_t id, int64_t begin, int64_t end);
+// writes the spans recorded since the last export, from every thread
+bool ExportTrace(const char *pszName);
+
+class TraceSpan {
+public:
+	TraceSpan(const char *pszName, const char *pszCategory, const char *pszArg = NULL, int64_t value = 0)
+		: m_pszName(pszName), m_pszCategory(pszCategory), m_pszArg(pszArg), m_value(value)
+		, m_begin(TraceEnabled() ? TraceNow() : 0)
+	{
+	}
+	~TraceSpan()
+	{
+		if (m_begin != 0)
+			TraceComplete(m_pszName, m_pszCategory, m_begin, TraceNow(), m_pszArg, m_value);
+	}
+
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+	const char *m_pszName;
+	const char *m_pszCategory;
+	const char *m_pszArg;
+	int64_t m_value;
+	int64_t m_begin;
+};
+
+namespace metrics {
+	extern Counter TraceDropped;
+}
+
+#endif
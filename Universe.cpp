@@ -0,0 +1,152 @@
+#include "StdAfx.h"
+
+#include "Universe.h"
+#include "MappedFile.h"
+#include "SymbolTable.h"
+
+#include <mutex>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define UNIVERSE_SSE2 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace {
+
+struct UniverseSource {
+	UniverseList list;
+	const char *pszFileName;
+	UniverseExchange exchange;
+};
+
+const UniverseSource s_sources[] = {
+	{ UL_US, "C:\\bighouse\\US-Stock-Symbols\\nasdaq\\nasdaq_tickers.txt", UX_NASDAQ },
+	{ UL_US, "C:\\bighouse\\US-Stock-Symbols\\nyse\\nyse_tickers.txt", UX_NYSE },
+	{ UL_US, "C:\\bighouse\\US-Stock-Symbols\\amex\\amex_tickers.txt", UX_AMEX },
+	{ UL_ALL, "C:\\bighouse\\US-Stock-Symbols\\all\\all_tickers.txt", UX_NONE },
+	{ UL_NASDAQ100, "C:\\bighouse\\NASDAQ-100.txt", UX_NASDAQ },
+	{ UL_SHARESA, "C:\\bighouse\\SharesA.txt", UX_NONE },
+};
+
+std::mutex s_mutex;
+std::shared_ptr<const Universe> s_current;
+
+#ifdef UNIVERSE_SSE2
+inline unsigned LowestBit(unsigned mask)
+{
+#ifdef _MSC_VER
+	unsigned long nIndex;
+	_BitScanForward(&nIndex, mask);
+	return nIndex;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// The symbol is everything before the first '|', with surrounding blanks and the '\r'
+// of a CRLF file dropped. Blank lines give nothing.
+void AddLine(const char *pBegin, const char *pEnd, UniverseExchange exchange, std::vector<UniverseEntry>& list)
+{
+	const char *pBar = (const char *)memchr(pBegin, '|', pEnd - pBegin);
+	if (pBar != 0)
+		pEnd = pBar;
+	while (pBegin < pEnd && (*pBegin == ' ' || *pBegin == '\t'))
+		pBegin++;
+	while (pEnd > pBegin && (pEnd[-1] == '\r' || pEnd[-1] == ' ' || pEnd[-1] == '\t'))
+		pEnd--;
+	if (pBegin == pEnd)
+		return;
+
+	SymbolTable& symbols = SymbolTable::instance();
+	UniverseEntry entry;
+	entry.symbolId = symbols.intern(std::string_view(pBegin, pEnd - pBegin));
+	entry.exchange = exchange;
+	entry.pName = &symbols.name(entry.symbolId);
+	list.push_back(entry);
+}
+
+// Finds the line breaks 16 bytes at a time and hands each line to AddLine.
+void ParseLines(const char *pData, size_t nSize, UniverseExchange exchange, std::vector<UniverseEntry>& list)
+{
+	size_t nLineStart = 0;
+	size_t i = 0;
+#ifdef UNIVERSE_SSE2
+	const __m128i newline = _mm_set1_epi8('\n');
+	for (; i + 16 <= nSize; i += 16) {
+		__m128i block = _mm_loadu_si128((const __m128i *)(pData + i));
+		unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+		while (mask != 0) {
+			size_t nEnd = i + LowestBit(mask);
+			AddLine(pData + nLineStart, pData + nEnd, exchange, list);
+			nLineStart = nEnd + 1;
+			mask &= mask - 1;
+		}
+	}
+#endif
+	for (; i < nSize; i++) {
+		if (pData[i] == '\n') {
+			AddLine(pData + nLineStart, pData + i, exchange, list);
+			nLineStart = i + 1;
+		}
+	}
+	if (nLineStart < nSize)
+		AddLine(pData + nLineStart, pData + nSize, exchange, list);
+}
+
+} // namespace
+
+const char* UniverseExchangeName(UniverseExchange exchange)
+{
+	static const char *s_names[] = { "", "NASDAQ", "NYSE", "AMEX" };
+	return s_names[exchange];
+}
+
+std::shared_ptr<const Universe> Universe::current()
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+	if (!s_current) {
+		s_current = load();
+		if (!s_current)
+			s_current.reset(new Universe());
+	}
+	return s_current;
+}
+
+bool Universe::reload()
+{
+	// parse outside the lock, readers keep getting the old snapshot meanwhile
+	std::shared_ptr<const Universe> pUniverse = load();
+	if (!pUniverse)
+		return false;
+	std::lock_guard<std::mutex> lock(s_mutex);
+	s_current = pUniverse;
+	return true;
+}
+
+std::shared_ptr<const Universe> Universe::load()
+{
+	std::shared_ptr<Universe> pUniverse(new Universe());
+	MappedFile file;
+	size_t nLoaded = 0;
+	for (size_t i = 0; i < sizeof(s_sources) / sizeof(s_sources[0]); i++) {
+		const UniverseSource& source = s_sources[i];
+		if (!file.open(source.pszFileName)) {
+			printf("Universe: can't open %s\n", source.pszFileName);
+			continue;
+		}
+		ParseLines(file.data(), file.size(), source.exchange, pUniverse->m_lists[source.list]);
+		file.close();
+		nLoaded++;
+	}
+	// a reload with every file missing keeps the previous lists
+	if (nLoaded == 0)
+		return std::shared_ptr<const Universe>();
+	printf("Universe: %lu us, %lu all, %lu nasdaq100, %lu sharesA symbols\n",
+		(unsigned long)pUniverse->m_lists[UL_US].size(), (unsigned long)pUniverse->m_lists[UL_ALL].size(),
+		(unsigned long)pUniverse->m_lists[UL_NASDAQ100].size(), (unsigned long)pUniverse->m_lists[UL_SHARESA].size());
+	return pUniverse;
+}
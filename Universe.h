@@ -0,0 +1,50 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_UNIVERSE_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_UNIVERSE_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+enum UniverseExchange { UX_NONE, UX_NASDAQ, UX_NYSE, UX_AMEX };
+
+enum UniverseList {
+	UL_US,			// nasdaq, nyse and amex ticker files in that order
+	UL_ALL,			// all_tickers.txt
+	UL_NASDAQ100,	// NASDAQ-100.txt
+	UL_SHARESA,		// SharesA.txt, symbol before the '|'
+	UL_COUNT
+};
+
+// "NASDAQ", "NYSE", "AMEX" or "" for UX_NONE
+const char* UniverseExchangeName(UniverseExchange exchange);
+
+struct UniverseEntry {
+	uint32_t symbolId;			// SymbolTable id
+	UniverseExchange exchange;
+	const std::string* pName;	// owned by SymbolTable
+
+	const char* name() const { return pName->c_str(); }
+	const char* exchangeName() const { return UniverseExchangeName(exchange); }
+};
+
+// Immutable snapshot of the symbol files. Jobs take current() once and keep the pointer
+// for their whole run, so reload() never changes a list under a running crawler and the
+// request index a crawler used still finds the same symbol in its callbacks.
+class Universe {
+public:
+	static std::shared_ptr<const Universe> current();
+	// maps and parses the files again and publishes the result for later current() calls
+	static bool reload();
+
+	const std::vector<UniverseEntry>& list(UniverseList which) const { return m_lists[which]; }
+
+private:
+	static std::shared_ptr<const Universe> load();
+
+	std::vector<UniverseEntry> m_lists[UL_COUNT];
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include "StdAfx.h"
+
+#include "WorkerPool.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+WorkerPool::WorkerPool(int nThreads)
+	: m_nBusy(0)
+	, m_bStop(false)
+{
+	if (nThreads <= 0)
+		nThreads = (int)std::thread::hardware_concurrency() - 1;
+	if (nThreads < 1)
+		nThreads = 1;
+	for (int i = 0; i < nThreads; i++)
+		m_threads.push_back(std::thread(&WorkerPool::workerLoop, this));
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bStop = true;
+	}
+	m_wake.notify_all();
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_threads[i].join();
+}
+
+WorkerPool& WorkerPool::shared()
+{
+	static WorkerPool pool;
+	return pool;
+}
+
+void WorkerPool::post(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks.push_back(std::move(task));
+	}
+	metrics::WorkerQueueDepth.add(1);
+	m_wake.notify_one();
+}
+
+void WorkerPool::wait()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_idle.wait(lock, [this]() { return m_tasks.empty() && m_nBusy == 0; });
+}
+
+void WorkerPool::workerLoop()
+{
+	TraceThreadName("worker");
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;) {
+		m_wake.wait(lock, [this]() { return m_bStop || !m_tasks.empty(); });
+		// finish what was queued before stopping
+		if (m_tasks.empty())
+			return;
+		std::function<void()> task = std::move(m_tasks.front());
+		m_tasks.pop_front();
+		m_nBusy++;
+		lock.unlock();
+		metrics::WorkerQueueDepth.add(-1);
+		{
+			TraceSpan span("task", "worker");
+			task();
+		}
+		lock.lock();
+		m_nBusy--;
+		if (m_tasks.empty() && m_nBusy == 0)
+			m_idle.notify_all();
+	}
+}
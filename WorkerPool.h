@@ -0,0 +1,41 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_WORKERPOOL_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_WORKERPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads for work that shouldn't run on the EReader thread.
+class WorkerPool {
+public:
+	// 0 threads means one less than the number of cores, at least one
+	explicit WorkerPool(int nThreads = 0);
+	~WorkerPool();
+
+	// shared by the callbacks that hand work off
+	static WorkerPool& shared();
+
+	void post(std::function<void()> task);
+	// blocks until every task posted so far has run
+	void wait();
+
+private:
+	WorkerPool(const WorkerPool&);
+	WorkerPool& operator=(const WorkerPool&);
+
+	void workerLoop();
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_idle;
+	std::deque<std::function<void()>> m_tasks;
+	int m_nBusy;
+	bool m_bStop;
+	std::vector<std::thread> m_threads;
+};
+
+#endif
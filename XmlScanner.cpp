@@ -0,0 +1,121 @@
+#include "StdAfx.h"
+
+#include "XmlScanner.h"
+
+namespace {
+
+bool IsXmlSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool IsNameEnd(char c)
+{
+	return IsXmlSpace(c) || c == '/' || c == '>' || c == '=';
+}
+
+}
+
+std::string_view XmlAttributes::find(std::string_view name) const
+{
+	size_t nPos = 0;
+	size_t nSize = m_raw.size();
+	while (nPos < nSize) {
+		while (nPos < nSize && (IsXmlSpace(m_raw[nPos]) || m_raw[nPos] == '/'))
+			nPos++;
+		size_t nNameStart = nPos;
+		while (nPos < nSize && !IsNameEnd(m_raw[nPos]))
+			nPos++;
+		std::string_view attrName = m_raw.substr(nNameStart, nPos - nNameStart);
+		while (nPos < nSize && IsXmlSpace(m_raw[nPos]))
+			nPos++;
+		if (nPos >= nSize || m_raw[nPos] != '=') {
+			// a bare name, or junk; step over it
+			if (nPos == nNameStart)
+				nPos++;
+			continue;
+		}
+		nPos++;
+		while (nPos < nSize && IsXmlSpace(m_raw[nPos]))
+			nPos++;
+		if (nPos >= nSize || (m_raw[nPos] != '"' && m_raw[nPos] != '\''))
+			return std::string_view();
+		size_t nEnd = m_raw.find(m_raw[nPos], nPos + 1);
+		if (nEnd == std::string_view::npos)
+			return std::string_view();
+		if (attrName == name)
+			return m_raw.substr(nPos + 1, nEnd - nPos - 1);
+		nPos = nEnd + 1;
+	}
+	return std::string_view();
+}
+
+bool ScanXml(std::string_view document, XmlHandler& handler)
+{
+	size_t nPos = 0;
+	size_t nSize = document.size();
+	while (nPos < nSize) {
+		size_t nTag = document.find('<', nPos);
+		if (nTag == std::string_view::npos)
+			nTag = nSize;
+		if (nTag > nPos)
+			handler.text(document.substr(nPos, nTag - nPos));
+		if (nTag == nSize)
+			return true;
+
+		std::string_view rest = document.substr(nTag);
+		if (rest.compare(0, 4, "<!--") == 0) {
+			size_t nEnd = document.find("-->", nTag + 4);
+			if (nEnd == std::string_view::npos)
+				return false;
+			nPos = nEnd + 3;
+			continue;
+		}
+		if (rest.compare(0, 9, "<![CDATA[") == 0) {
+			size_t nEnd = document.find("]]>", nTag + 9);
+			if (nEnd == std::string_view::npos)
+				return false;
+			handler.text(document.substr(nTag + 9, nEnd - nTag - 9));
+			nPos = nEnd + 3;
+			continue;
+		}
+
+		// a '>' inside a quoted attribute value doesn't end the tag
+		size_t nEnd = nTag + 1;
+		char quote = 0;
+		while (nEnd < nSize && (quote != 0 || document[nEnd] != '>')) {
+			if (quote != 0) {
+				if (document[nEnd] == quote)
+					quote = 0;
+			}
+			else if (document[nEnd] == '"' || document[nEnd] == '\'')
+				quote = document[nEnd];
+			nEnd++;
+		}
+		if (nEnd >= nSize)
+			return false;
+		nPos = nEnd + 1;
+
+		std::string_view tag = document.substr(nTag + 1, nEnd - nTag - 1);
+		if (tag.empty() || tag[0] == '?' || tag[0] == '!')
+			continue;
+		if (tag[0] == '/') {
+			size_t nNameEnd = 1;
+			while (nNameEnd < tag.size() && !IsXmlSpace(tag[nNameEnd]))
+				nNameEnd++;
+			handler.endElement(tag.substr(1, nNameEnd - 1));
+			continue;
+		}
+		bool bEmpty = tag.back() == '/';
+		if (bEmpty)
+			tag.remove_suffix(1);
+		size_t nNameEnd = 0;
+		while (nNameEnd < tag.size() && !IsNameEnd(tag[nNameEnd]))
+			nNameEnd++;
+		std::string_view name = tag.substr(0, nNameEnd);
+		handler.startElement(name, XmlAttributes(tag.substr(nNameEnd)));
+		if (bEmpty)
+			handler.endElement(name);
+	}
+	return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#ifndef TWS_API_SAMPLES_TESTCPPCLIENT_XMLSCANNER_H
+#define TWS_API_SAMPLES_TESTCPPCLIENT_XMLSCANNER_H
+
+#include <string_view>
+
+// The attributes of one start tag, looked up in place without building a list.
+class XmlAttributes {
+public:
+	explicit XmlAttributes(std::string_view raw) : m_raw(raw) {}
+
+	// the raw value, entities left as they are; empty if the attribute is missing
+	std::string_view find(std::string_view name) const;
+
+private:
+	std::string_view m_raw;
+};
+
+class XmlHandler {
+public:
+	virtual ~XmlHandler() {}
+
+	virtual void startElement(std::string_view /*name*/, const XmlAttributes& /*attributes*/) {}
+	// character data between tags, whitespace included, entities not decoded
+	virtual void text(std::string_view /*text*/) {}
+	virtual void endElement(std::string_view /*name*/) {}
+};
+
+// SAX style pass over an XML document held in memory. Every string handed to the
+// handler points into the document, nothing is copied or allocated. Declarations,
+// comments and DOCTYPE are skipped, CDATA comes through as text. Returns false on a
+// truncated tag; the handler has seen everything before it.
+bool ScanXml(std::string_view document, XmlHandler& handler);
+
+#endif
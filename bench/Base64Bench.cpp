@@ -0,0 +1,55 @@
+#include "StdAfx.h"
+
+#include "Base64.h"
+#ifdef BENCH_UTILS_BASE64
+#include "Utils.h"
+#endif
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+// a news article sized payload, state.range(0) bytes before encoding
+std::string Encoded(size_t nSize)
+{
+	std::vector<uint8_t> data(nSize);
+	uint32_t seed = 2463534242u;
+	for (size_t i = 0; i < nSize; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		data[i] = (uint8_t)seed;
+	}
+	return Base64Encode(data.data(), data.size());
+}
+
+#ifdef BENCH_UTILS_BASE64
+void BM_UtilsBase64Decode(benchmark::State& state)
+{
+	std::string encoded = Encoded((size_t)state.range(0));
+	for (auto _ : state)
+		benchmark::DoNotOptimize(Utils::base64_decode(encoded));
+	state.SetBytesProcessed(state.iterations() * (int64_t)encoded.size());
+}
+BENCHMARK(BM_UtilsBase64Decode)->Arg(64 << 10)->Arg(1 << 20);
+#endif
+
+void BM_Base64Decode(benchmark::State& state)
+{
+	Base64Impl impl = (Base64Impl)state.range(1);
+	if (!Base64ImplSupported(impl)) {
+		state.SkipWithError("not supported on this CPU");
+		return;
+	}
+	state.SetLabel(Base64ImplName(impl));
+	std::string encoded = Encoded((size_t)state.range(0));
+	for (auto _ : state)
+		benchmark::DoNotOptimize(Base64Decode(encoded, impl));
+	state.SetBytesProcessed(state.iterations() * (int64_t)encoded.size());
+}
+BENCHMARK(BM_Base64Decode)->ArgsProduct({ { 64 << 10, 1 << 20 }, { B64_SCALAR, B64_SSSE3, B64_AVX2 } });
+
+}
@@ -0,0 +1,62 @@
+#include "StdAfx.h"
+
+#include "Contract.h"
+#include "ContractMsg.h"
+#include "Log.h"
+#include "biglog.h"
+
+#include <benchmark/benchmark.h>
+
+#include <stdio.h>
+
+#include <string>
+
+namespace {
+
+// one rate line appended the way WriteRateToFile does: open, write, close
+void BM_WriteLog(benchmark::State& state)
+{
+	char pszFileName[MAX_PATH];
+	DWORD nLength = GetTempPathA(MAX_PATH, pszFileName);
+	sprintf_s(pszFileName + nLength, MAX_PATH - nLength, "bench_writelog.txt");
+	char pszWrite[] = "AAPL,165,12.34\n";
+	gamelog::WriteLog(pszFileName, pszWrite, 0);
+	for (auto _ : state)
+		gamelog::WriteLog(pszFileName, pszWrite);
+	state.SetBytesProcessed(state.iterations() * (int64_t)(sizeof(pszWrite) - 1));
+	DeleteFile(pszFileName);
+}
+BENCHMARK(BM_WriteLog);
+
+Contract SampleContract()
+{
+	Contract contract;
+	contract.conId = 265598;
+	contract.symbol = "AAPL";
+	contract.secType = "OPT";
+	contract.lastTradeDateOrContractMonth = "20240119";
+	contract.strike = 165;
+	contract.right = "P";
+	contract.multiplier = "100";
+	contract.exchange = "SMART";
+	contract.primaryExchange = "NASDAQ";
+	contract.currency = "USD";
+	contract.localSymbol = "AAPL  240119P00165000";
+	contract.tradingClass = "AAPL";
+	return contract;
+}
+
+// printContractMsg's lines as the log thread formats them
+void BM_ContractMessage(benchmark::State& state)
+{
+	Contract contract = SampleContract();
+	std::string out;
+	for (auto _ : state) {
+		out.clear();
+		FormatContractMsg(contract, [&](const char *pszFormat, auto value) { LogAppendFormat(out, pszFormat, value); });
+		benchmark::DoNotOptimize(out.data());
+	}
+}
+BENCHMARK(BM_ContractMessage);
+
+}
@@ -0,0 +1,136 @@
+﻿#include "StdAfx.h"
+
+#include "ChainStore.h"
+#include "RateMath.h"
+
+#include <benchmark/benchmark.h>
+
+#include <math.h>
+#include <stdio.h>
+
+#include <vector>
+
+namespace {
+
+// xorshift, so every run sees the same data
+struct Random {
+	uint32_t seed = 2463534242u;
+
+	uint32_t next()
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return seed;
+	}
+	// log-uniform, the way underlying prices spread
+	double price(double lo, double hi) { return lo * pow(hi / lo, next() / 4294967296.0); }
+};
+
+std::vector<double> Prices(size_t nCount)
+{
+	Random random;
+	std::vector<double> prices(nCount);
+	for (size_t i = 0; i < nCount; i++)
+		prices[i] = random.price(1, 2000);
+	return prices;
+}
+
+// a listed-looking ladder: the price band's step from 30% to 130% of the price
+std::vector<double> Ladder(double price)
+{
+	double step = price >= 1000 ? 50 : price >= 500 ? 20 : price >= 200 ? 10 : price >= 80 ? 5 : price >= 50 ? 2.5 : price >= 20 ? 1 : 0.5;
+	std::vector<double> strikes;
+	for (double strike = floor(price * 0.3 / step) * step; strike <= price * 1.3; strike += step)
+		strikes.push_back(strike);
+	return strikes;
+}
+
+void BM_GetDays(benchmark::State& state)
+{
+	static const char *const dates[] = { "20240119", "20240216", "20240315", "20240621", "20241220", "20250117" };
+	int i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(get_days("20231201", dates[i]));
+		i = (i + 1) % 6;
+	}
+}
+BENCHMARK(BM_GetDays);
+
+void BM_StrikeTarget(benchmark::State& state)
+{
+	std::vector<double> prices = Prices(4096);
+	size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(StrikeTarget(prices[i]));
+		i = (i + 1) & 4095;
+	}
+}
+BENCHMARK(BM_StrikeTarget);
+
+// the whole choice tickPrice makes per underlying: target, then the ladder walk
+void BM_PickStrike(benchmark::State& state)
+{
+	std::vector<double> prices = Prices(256);
+	std::vector<std::vector<double>> ladders;
+	for (size_t i = 0; i < prices.size(); i++)
+		ladders.push_back(Ladder(prices[i]));
+	size_t i = 0;
+	for (auto _ : state) {
+		const std::vector<double>& ladder = ladders[i];
+		benchmark::DoNotOptimize(PickStrike(ladder.data(), (int)ladder.size(), StrikeTarget(prices[i])));
+		i = (i + 1) & 255;
+	}
+}
+BENCHMARK(BM_PickStrike);
+
+// WriteRateToFile's yield and text line, without the file
+void BM_FormatRateLine(benchmark::State& state)
+{
+	std::vector<double> prices = Prices(4096);
+	char pszWrite[1024];
+	size_t i = 0;
+	for (auto _ : state) {
+		double strike = StrikeTarget(prices[i]);
+		double yield = PutYield(strike, strike * 0.02, 30);
+		benchmark::DoNotOptimize(FormatRateLine(pszWrite, sizeof(pszWrite), "AAPL", strike, yield));
+		i = (i + 1) & 4095;
+	}
+}
+BENCHMARK(BM_FormatRateLine);
+
+// strike lookup from a mapped chain file, as tickPrice does it, for state.range(0) symbols
+void BM_ChainLookup(benchmark::State& state)
+{
+	ChainMap chains;
+	std::vector<double> prices = Prices((size_t)state.range(0));
+	char pszSymbol[16];
+	for (size_t i = 0; i < prices.size(); i++) {
+		sprintf_s(pszSymbol, sizeof(pszSymbol), "S%05d", (int)i);
+		chains[pszSymbol] = Ladder(prices[i]);
+	}
+	// the chain file goes to the temp directory, not next to the real ones
+	char pszDir[MAX_PATH];
+	GetTempPathA(MAX_PATH, pszDir);
+	SetChainDir(pszDir);
+	ChainFile file;
+	if (!WriteChainFile("bench", chains) || !file.open("bench")) {
+		state.SkipWithError("cannot write the bench chain file");
+		return;
+	}
+	Random random;
+	for (auto _ : state) {
+		sprintf_s(pszSymbol, sizeof(pszSymbol), "S%05d", (int)(random.next() % prices.size()));
+		int nCount = 0;
+		const double *strikes = file.strikes(file.find(pszSymbol), nCount);
+		benchmark::DoNotOptimize(strikes);
+		benchmark::DoNotOptimize(nCount);
+	}
+	file.close();
+	char pszFileName[MAX_PATH];
+	sprintf_s(pszFileName, MAX_PATH, "%sbench.chain", pszDir);
+	DeleteFile(pszFileName);
+}
+BENCHMARK(BM_ChainLookup)->Arg(500)->Arg(5000);
+
+}
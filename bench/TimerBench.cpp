@@ -0,0 +1,50 @@
+#include "StdAfx.h"
+
+#include "TimerWheel.h"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+namespace {
+
+const int64_t TICK = 50000;		// RETRY_TICK_MS in microseconds
+
+// state.range(0) outstanding deadlines spread over 4 to 60 seconds, like a rate scan's
+// quote requests, then one more scheduled and cancelled per iteration
+void BM_TimerScheduleCancel(benchmark::State& state)
+{
+	TimerWheel wheel(TICK, 0);
+	int nCount = (int)state.range(0);
+	for (int i = 0; i < nCount; i++)
+		wheel.schedule(4000000 + (int64_t)(i % 1121) * 50000, i);
+	uint64_t payload = 0;
+	for (auto _ : state) {
+		wheel.cancel(wheel.schedule(4000000 + (int64_t)(payload % 1121) * 50000, payload));
+		payload++;
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TimerScheduleCancel)->Arg(1000)->Arg(100000)->Arg(1000000);
+
+// one tick of the sender thread over state.range(0) deadlines, each firing re-armed
+void BM_TimerAdvance(benchmark::State& state)
+{
+	TimerWheel wheel(TICK, 0);
+	int nCount = (int)state.range(0);
+	for (int i = 0; i < nCount; i++)
+		wheel.schedule(4000000 + (int64_t)(i % 1121) * 50000, i);
+	std::vector<uint64_t> expired;
+	int64_t now = 0;
+	for (auto _ : state) {
+		now += TICK;
+		expired.clear();
+		wheel.advance(now, expired);
+		for (size_t i = 0; i < expired.size(); i++)
+			wheel.schedule(now + 4000000, expired[i]);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TimerAdvance)->Arg(1000)->Arg(100000)->Arg(1000000);
+
+}
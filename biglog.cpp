@@ -1,6 +1,8 @@
 #include "StdAfx.h"
 #include "stdio.h"
 #include "biglog.h"
+#include "Metrics.h"
+#include "Trace.h"
 
 void gamelog::GetAppPath(char *pPath)
 {
@@ -12,11 +14,20 @@ void gamelog::GetAppPath(char *pPath)
 
 void gamelog::WriteLog(char *pszFileName, char *pszBuffer, int nFlag)
 {
+	TraceSpan span("WriteLog", "disk");
 	HANDLE hLog = OpenLogFile(pszFileName, nFlag);
 	WriteLogWithHandle(hLog, pszBuffer);
 	CloseHandle(hLog);
 }
 
+void gamelog::WriteLog(const char *pszFileName, const char *pData, size_t nLength, int nFlag)
+{
+	TraceSpan span("WriteLog", "disk", "bytes", (int64_t)nLength);
+	HANDLE hLog = OpenLogFile((char *)pszFileName, nFlag);
+	WriteLogWithHandle(hLog, pData, nLength);
+	CloseHandle(hLog);
+}
+
 void gamelog::WriteGameLog(char *pszFileName, char *pszBuffer, int nFlag)
 {
 	HANDLE hLog = OpenAppPathLogFile(pszFileName, 1);
@@ -76,7 +87,8 @@ void gamelog::WriteLogWithDateTime(HANDLE hFile, char *pszBuffer)
 	GetTimeFormatA(LOCALE_USER_DEFAULT, TIME_FORCE24HOURFORMAT, &sysTime, "HH:mm:ss", szTime, 16);
 	GetDateFormatA(LOCALE_USER_DEFAULT, LOCALE_USE_CP_ACP, &sysTime, "yyyy-MM-dd", szDate, 16);
 	sprintf_s(pszWriteBuf, 2048, "[%s %s]--%s", szDate, szTime, pszBuffer);
-	WriteFile(hFile, pszWriteBuf, strlen(pszWriteBuf), &dwWrite, 0);
+	if (WriteFile(hFile, pszWriteBuf, strlen(pszWriteBuf), &dwWrite, 0))
+		metrics::BytesWritten.inc(MW_LOG, dwWrite);
 }
 
 
@@ -88,5 +100,15 @@ void gamelog::WriteLogWithHandle(HANDLE hFile, char *pszBuffer)
 		return;
 	/*if (strlen(pszBuffer)>2048)
 		return;*/
-	WriteFile(hFile, pszBuffer, strlen(pszBuffer), &dwWrite, 0);
+	if (WriteFile(hFile, pszBuffer, strlen(pszBuffer), &dwWrite, 0))
+		metrics::BytesWritten.inc(MW_LOG, dwWrite);
+}
+
+void gamelog::WriteLogWithHandle(HANDLE hFile, const char *pData, size_t nLength)
+{
+	DWORD dwWrite;
+	if (hFile == 0 || pData == 0)
+		return;
+	if (WriteFile(hFile, pData, (DWORD)nLength, &dwWrite, 0))
+		metrics::BytesWritten.inc(MW_LOG, dwWrite);
 }
@@ -3,10 +3,13 @@ namespace gamelog {
 	extern HANDLE OpenLogFile(char *pszFileName, int nFlag);// nFlag =2:ȡķʽ, 1 ׷ӵķʽ򿪣0ʾдķʽ
 	extern HANDLE OpenAppPathLogFile(char *pszFileName, int nFlag);
 	extern void   WriteLogWithHandle(HANDLE hFile, char *pszBuffer);
+	extern void   WriteLogWithHandle(HANDLE hFile, const char *pData, size_t nLength);
 	extern void   GetAppPath(char *pPath);
 	extern void   WriteLogWithDateTime(HANDLE hFile, char *pszBuffer);
 	extern void   WriteGameLog(char *pszFileName, char *pszBuffer, int nFlag);
 	extern void   WriteLog(char *pszFileName, char *pszBuffer, int nFlag=1);
+	// for buffers whose length is known, or that may hold zeros
+	extern void   WriteLog(const char *pszFileName, const char *pData, size_t nLength, int nFlag);
 };
 
 #define ADD_FLAG 1
\ No newline at end of file